@@ -0,0 +1,224 @@
+#include "BarnesHutRepulsion.h"
+
+#include <sph/utils/CommonDefinitions.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+namespace {
+    // Spreads the lower 16 bits such that there is a zero bit between each of them
+    uint32_t spreadBits(uint32_t value)
+    {
+        value &= 0x0000FFFF;
+        value = (value | (value << 8)) & 0x00FF00FF;
+        value = (value | (value << 4)) & 0x0F0F0F0F;
+        value = (value | (value << 2)) & 0x33333333;
+        value = (value | (value << 1)) & 0x55555555;
+        return value;
+    }
+}
+
+BarnesHutRepulsion::BarnesHutRepulsion(float theta)
+{
+    // a cell is never approximated for a point inside of it as long as theta < 1 / sqrt(2)
+    theta = std::clamp(theta, 0.f, 0.7f);
+    _thetaSq = theta * theta;
+}
+
+void BarnesHutRepulsion::sortPoints(const std::vector<float>& positions)
+{
+    const size_t numPoints = positions.size() / 2;
+
+    float minX = std::numeric_limits<float>::max(), minY = std::numeric_limits<float>::max();
+    float maxX = std::numeric_limits<float>::lowest(), maxY = std::numeric_limits<float>::lowest();
+    for (size_t i = 0; i < numPoints; i++)
+    {
+        minX = std::min(minX, positions[2 * i]);
+        maxX = std::max(maxX, positions[2 * i]);
+        minY = std::min(minY, positions[2 * i + 1]);
+        maxY = std::max(maxY, positions[2 * i + 1]);
+    }
+
+    const float range = std::max({ maxX - minX, maxY - minY, 1e-6f });
+    const float scale = 65536.f / range;
+
+    _mortonCodes.resize(numPoints);
+
+    SPH_PARALLEL
+    for (int64_t i = 0; i < static_cast<int64_t>(numPoints); i++)
+    {
+        const auto qx = std::min(static_cast<uint32_t>((positions[2 * i] - minX) * scale), 65535u);
+        const auto qy = std::min(static_cast<uint32_t>((positions[2 * i + 1] - minY) * scale), 65535u);
+        const uint64_t code = spreadBits(qx) | (spreadBits(qy) << 1);
+        _mortonCodes[i] = (code << 32) | static_cast<uint64_t>(i);
+    }
+
+    std::sort(_mortonCodes.begin(), _mortonCodes.end());
+
+    _order.resize(numPoints);
+    // padded such that the leaf blocks can read _maxLeafSize lanes after any point
+    _sortedX.assign(numPoints + _maxLeafSize, 0.f);
+    _sortedY.assign(numPoints + _maxLeafSize, 0.f);
+
+    SPH_PARALLEL
+    for (int64_t sorted = 0; sorted < static_cast<int64_t>(numPoints); sorted++)
+    {
+        const auto i = static_cast<uint32_t>(_mortonCodes[sorted] & 0xFFFFFFFF);
+        _order[sorted] = i;
+        _sortedX[sorted] = positions[2 * i];
+        _sortedY[sorted] = positions[2 * i + 1];
+    }
+
+    _nodes.clear();
+    _nodes.reserve(numPoints / 2 + 1);
+    buildNode(0, static_cast<uint32_t>(numPoints), 0, range);
+}
+
+uint32_t BarnesHutRepulsion::buildNode(uint32_t begin, uint32_t end, uint32_t depth, float width)
+{
+    const auto nodeID = static_cast<uint32_t>(_nodes.size());
+    _nodes.emplace_back();
+
+    {
+        Node& node = _nodes[nodeID];
+        node.begin = begin;
+        node.end = end;
+        node.count = end - begin;
+        node.widthSq = width * width;
+    }
+
+    double centerX = 0, centerY = 0;
+
+    if (end - begin <= _maxLeafSize || depth == _maxDepth)
+    {
+        for (uint32_t sorted = begin; sorted < end; sorted++)
+        {
+            centerX += _sortedX[sorted];
+            centerY += _sortedY[sorted];
+        }
+
+        _nodes[nodeID].isLeaf = 1;
+    }
+    else
+    {
+        // the points of each quadrant are contiguous in Morton order
+        const uint32_t shift = 32 + 2 * (_maxDepth - 1 - depth);
+        uint32_t childBegin = begin;
+
+        for (uint64_t quadrant = 0; quadrant < 4 && childBegin < end; quadrant++)
+        {
+            const auto childEnd = static_cast<uint32_t>(std::partition_point(_mortonCodes.begin() + childBegin, _mortonCodes.begin() + end,
+                [shift, quadrant](uint64_t code) { return ((code >> shift) & 3) <= quadrant; }) - _mortonCodes.begin());
+
+            if (childEnd > childBegin)
+            {
+                const uint32_t childID = buildNode(childBegin, childEnd, depth + 1, 0.5f * width);
+                const Node& child = _nodes[childID];
+                centerX += static_cast<double>(child.centerX) * child.count;
+                centerY += static_cast<double>(child.centerY) * child.count;
+            }
+
+            childBegin = childEnd;
+        }
+    }
+
+    Node& node = _nodes[nodeID];
+    node.centerX = static_cast<float>(centerX / node.count);
+    node.centerY = static_cast<float>(centerY / node.count);
+    node.skip = static_cast<uint32_t>(_nodes.size());
+
+    return nodeID;
+}
+
+double BarnesHutRepulsion::compute(const std::vector<float>& positions, std::vector<float>& forces)
+{
+    const size_t numPoints = positions.size() / 2;
+    forces.resize(positions.size());
+
+    if (numPoints == 0)
+        return 0;
+
+    sortPoints(positions);
+
+    const auto numNodes = static_cast<uint32_t>(_nodes.size());
+    _kernelSums.resize(numPoints);
+
+    SPH_PARALLEL
+    for (int64_t sorted = 0; sorted < static_cast<int64_t>(numPoints); sorted++)
+    {
+        const float xi = _sortedX[sorted];
+        const float yi = _sortedY[sorted];
+
+        double kernelSum = 0, forceX = 0, forceY = 0;
+
+        // one accumulator per lane of the leaf blocks, reduced after the traversal
+        float laneKernelSums[_maxLeafSize] = {}, laneForcesX[_maxLeafSize] = {}, laneForcesY[_maxLeafSize] = {};
+
+        uint32_t nodeID = 0;
+        while (nodeID < numNodes)
+        {
+            const Node& node = _nodes[nodeID];
+
+            if (node.isLeaf)
+            {
+                // blocks of _maxLeafSize lanes with the points after the leaf masked out, the fixed width loop vectorizes
+                // the point itself adds w_ii = 1 and no force
+                for (uint32_t first = node.begin; first < node.end; first += _maxLeafSize)
+                {
+                    const float* blockX = _sortedX.data() + first;
+                    const float* blockY = _sortedY.data() + first;
+                    const uint32_t blockSize = node.end - first;
+
+                    for (uint32_t lane = 0; lane < _maxLeafSize; lane++)
+                    {
+                        const float dx = xi - blockX[lane];
+                        const float dy = yi - blockY[lane];
+                        const float w = (lane < blockSize ? 1.f : 0.f) / (1.f + dx * dx + dy * dy);
+                        laneKernelSums[lane] += w;
+                        laneForcesX[lane] += w * w * dx;
+                        laneForcesY[lane] += w * w * dy;
+                    }
+                }
+
+                nodeID = node.skip;
+                continue;
+            }
+
+            const float dx = xi - node.centerX;
+            const float dy = yi - node.centerY;
+            const float distSq = dx * dx + dy * dy;
+
+            if (node.widthSq < _thetaSq * distSq)
+            {
+                const float w = 1.f / (1.f + distSq);
+                const float count = static_cast<float>(node.count);
+                kernelSum += count * w;
+                forceX += count * w * w * dx;
+                forceY += count * w * w * dy;
+                nodeID = node.skip;
+                continue;
+            }
+
+            nodeID++;
+        }
+
+        for (uint32_t lane = 0; lane < _maxLeafSize; lane++)
+        {
+            kernelSum += laneKernelSums[lane];
+            forceX += laneForcesX[lane];
+            forceY += laneForcesY[lane];
+        }
+
+        const uint32_t i = _order[sorted];
+        _kernelSums[i] = kernelSum - 1.0;
+        forces[2 * i] = static_cast<float>(forceX);
+        forces[2 * i + 1] = static_cast<float>(forceY);
+    }
+
+    double normalization = 0;
+    for (const double kernelSum : _kernelSums)
+        normalization += kernelSum;
+
+    return normalization;
+}
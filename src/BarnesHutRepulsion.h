@@ -0,0 +1,60 @@
+#pragma once
+
+#include "CpuTsneComputation.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// ////////////////// ///
+/// BarnesHutRepulsion ///
+/// ////////////////// ///
+
+/**
+ * Barnes-Hut t-SNE repulsion on a flat quadtree.
+ * Points are sorted along a Morton curve such that every tree node covers a contiguous range of them,
+ * the nodes are stored in depth-first order with the index of the node after their sub tree, which allows a stackless traversal.
+ * The traversal is parallel over the points in Morton order. Leaves are read as fixed width blocks of the padded coordinate arrays
+ * with the points after the leaf masked out, into one accumulator per lane, such that the leaf loop vectorizes without reassociation.
+ */
+class BarnesHutRepulsion : public TsneRepulsion
+{
+public:
+    /** @param theta Cell width to distance ratio below which a node is approximated by its center of mass, at most 0.7 */
+    BarnesHutRepulsion(float theta = 0.5f);
+
+    double compute(const std::vector<float>& positions, std::vector<float>& forces) override;
+
+    /** sum_{j != i} w_ij per point of the last compute */
+    const std::vector<double>& getKernelSums() const { return _kernelSums; }
+
+private:
+    struct Node
+    {
+        float       centerX = 0;        /** Center of mass */
+        float       centerY = 0;
+        float       widthSq = 0;        /** Squared cell width */
+        uint32_t    count = 0;          /** Number of points */
+        uint32_t    begin = 0;          /** First point in Morton order */
+        uint32_t    end = 0;
+        uint32_t    skip = 0;           /** Node after the sub tree of this node */
+        uint32_t    isLeaf = 0;
+    };
+
+    static constexpr uint32_t _maxDepth = 16;           /** Morton codes use 16 bits per dimension */
+    static constexpr uint32_t _maxLeafSize = 8;
+
+    void sortPoints(const std::vector<float>& positions);
+    uint32_t buildNode(uint32_t begin, uint32_t end, uint32_t depth, float width);
+
+private:
+    float                       _thetaSq = 0.25f;
+
+    // Buffers, kept between iterations
+    std::vector<uint64_t>       _mortonCodes = {};      /** Morton code and point index, sorted */
+    std::vector<uint32_t>       _order = {};            /** Point index in Morton order */
+    std::vector<float>          _sortedX = {};          /** Padded by _maxLeafSize */
+    std::vector<float>          _sortedY = {};
+    std::vector<Node>           _nodes = {};
+    std::vector<double>         _kernelSums = {};       /** sum_{j != i} w_ij per point */
+};
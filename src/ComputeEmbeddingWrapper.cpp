@@ -5,10 +5,12 @@
 #include <sph/utils/Logger.hpp>
 #include <sph/utils/Progressbar.hpp>
 
+#include <algorithm>
 #include <cassert>
 #include <cstdint>
 #include <limits>
 #include <memory>
+#include <mutex>
 #include <new>
 #include <type_traits>
 #include <utility>
@@ -26,89 +28,151 @@ void EmbedWorker::compute(uint32_t iterations, bool init)
 {
     static_assert(_updateSteps > 0);
 
-    if (iterations == 0)
+    if (iterations == 0 || _isRetired)
         return;
 
+    std::scoped_lock computeLock(_computeMutex);
+
     emit started();
 
     resetStop();
 
-    auto checkPublishExtends = [this]() {
-        if (_currentIteration >= _publishExtendsIter + _updateSteps)
-            return;
-        if (_currentIteration >= _publishExtendsIter)
-            emit publishExtends(computeExtends());
-    };
-
-    utils::ProgressBar progress(iterations);
-
-    int32_t remainingIter = iterations;
+    // a new run invalidates all slices that are still queued from a previous run
+    _runID++;
+    _runIterations = iterations;
+    _remainingIterations = iterations;
+    _progress = std::make_unique<utils::ProgressBar>(iterations);
 
     if (init)
     {
-        uint32_t firstUpdate = _updateSteps;
-        if (iterations <= _updateSteps)
-        {
-            firstUpdate = iterations;
-            remainingIter = 0;
-        }
-        else
-            remainingIter = iterations - _updateSteps;
+        _lastCheckpointIteration = 0;
+
+        const uint32_t firstUpdate = std::min(iterations, _updateSteps);
 
         initGradientDescent(firstUpdate);
 
         _currentIteration += firstUpdate;
+        _remainingIterations -= firstUpdate;
         checkPublishExtends();
     }
 
     Log::info("ComputeEmbedding:: Gradient descent...");
 
-    while(remainingIter > 0 && remainingIter >= _updateSteps)
+    scheduleSlice();
+}
+
+void EmbedWorker::continueComputation(uint32_t iterations)
+{
+    // extend a run that is still in progress instead of restarting it
+    if (!_isRetired && !_shouldStop && _remainingIterations > 0)
     {
-        if (_shouldStop)
-            return;
+        std::scoped_lock computeLock(_computeMutex);
+        _runIterations += iterations;
+        _remainingIterations += iterations;
+        return;
+    }
 
-        continueGradientDescent(_updateSteps);
-        _currentIteration += _updateSteps;
-        checkPublishExtends();
-        remainingIter -= _updateSteps;
+    compute(iterations, /* init = */ false);
+}
 
-        progress.update(static_cast<uint64_t>(iterations) - remainingIter);
-    }
+void EmbedWorker::computeSlice(uint64_t runID)
+{
+    if (runID != _runID || _isRetired)
+        return;
 
-    if (remainingIter != 0)
-    {
-        if (remainingIter < 0)
-        {
-            assert(iterations < _updateSteps);
-            remainingIter = iterations;
-        }
+    std::scoped_lock computeLock(_computeMutex);
+
+    // Jobs on the same pool thread take turns after each slice, the prioritized job gets longer slices
+    const uint32_t sliceSteps = _hasPriority ? _prioritySliceSteps : _sliceSteps;
 
+    for (uint32_t step = 0; step < sliceSteps && _remainingIterations > 0; step++)
+    {
         if (_shouldStop)
             return;
 
-        continueGradientDescent(remainingIter);
-        _currentIteration += remainingIter;
+        const uint32_t iterations = std::min(_remainingIterations, _updateSteps);
+
+        continueGradientDescent(iterations);
+        _currentIteration += iterations;
+        _remainingIterations -= iterations;
         checkPublishExtends();
+
+        _progress->update(static_cast<uint64_t>(_runIterations) - _remainingIterations);
+    }
+
+    if (_shouldStop)
+        return;
+
+    if (_remainingIterations > 0)
+    {
+        checkpoint(/* force = */ false);
+        scheduleSlice();
+        return;
     }
 
-    progress.finish();
+    checkpoint(/* force = */ true);
+    _progress->finish();
 
     emit finished(computeExtends());
 }
 
-void EmbedWorker::continueComputation(uint32_t iterations)
+void EmbedWorker::scheduleSlice()
 {
-    compute(iterations, /* init = */ false);
+    QMetaObject::invokeMethod(this, [this, runID = _runID]() { computeSlice(runID); }, Qt::QueuedConnection);
+}
+
+void EmbedWorker::setCheckpoint(const std::filesystem::path& path, uint64_t key)
+{
+    std::scoped_lock computeLock(_computeMutex);
+    _checkpointPath = path;
+    _checkpointKey = key;
+}
+
+void EmbedWorker::checkpoint(bool force)
+{
+    if (!usesCpuTsne() || _checkpointPath.empty())
+        return;
+
+    const uint32_t iteration = _cpuTsneComputation.getIteration();
+
+    if (iteration == _lastCheckpointIteration || (!force && iteration < _lastCheckpointIteration + _checkpointInterval))
+        return;
+
+    _lastCheckpointIteration = iteration;
+    EmbeddingCheckpoint::save(_checkpointPath, _checkpointKey, _cpuTsneComputation.getState());
+}
+
+void EmbedWorker::checkPublishExtends()
+{
+    if (_currentIteration >= _publishExtendsIter + _updateSteps)
+        return;
+    if (_currentIteration >= _publishExtendsIter)
+        emit publishExtends(computeExtends());
+}
+
+void EmbedWorker::retire()
+{
+    _isRetired = true;
+    stop();
+
+    // wait until a running computation has returned
+    std::scoped_lock computeLock(_computeMutex);
 }
 
 void EmbedWorker::stop()
 {
     _shouldStop = true;
+    _remainingIterations = 0;
 
-    if (_normScheme == utils::NormalizationScheme::TSNE) {
+    if (usesCpuTsne()) {
+        _cpuTsneComputation.stop();
+    }
+    else if (_normScheme == utils::NormalizationScheme::TSNE) {
         _tsneComputation.stop();
     }
+    else if (usesCpuUmap()) {
+        _cpuUmapComputation.stop();
+    }
     else {
         _umapComputation.stop();
     }
@@ -120,9 +184,15 @@ void EmbedWorker::resetStop()
 {
     _shouldStop = false;
 
-    if (_normScheme == utils::NormalizationScheme::TSNE) {
+    if (usesCpuTsne()) {
+        _cpuTsneComputation.resetStop();
+    }
+    else if (_normScheme == utils::NormalizationScheme::TSNE) {
         _tsneComputation.resetStop();
     }
+    else if (usesCpuUmap()) {
+        _cpuUmapComputation.resetStop();
+    }
     else {
         _umapComputation.resetStop();
     }
@@ -130,10 +200,18 @@ void EmbedWorker::resetStop()
 
 void EmbedWorker::initGradientDescent(uint32_t iterations)
 {
-    if (_normScheme == utils::NormalizationScheme::TSNE) {
+    if (usesCpuTsne()) {
+        _cpuTsneComputation.compute(iterations);
+        emit embeddingUpdate(_cpuTsneComputation.getEmbedding());
+    }
+    else if (_normScheme == utils::NormalizationScheme::TSNE) {
         _tsneComputation.compute(iterations, false);
         emit embeddingUpdate(_tsneComputation.getEmbedding().getContainer());
     }
+    else if (usesCpuUmap()) {
+        _cpuUmapComputation.compute(iterations);
+        emit embeddingUpdate(_cpuUmapComputation.getEmbedding());
+    }
     else {
         _umapComputation.initProbabilityDistribution();
         _umapComputation.runGradientDescentForEpochs(iterations);
@@ -143,26 +221,39 @@ void EmbedWorker::initGradientDescent(uint32_t iterations)
 
 void EmbedWorker::continueGradientDescent(uint32_t iterations)
 {
-    if (_normScheme == utils::NormalizationScheme::TSNE) {
+    if (usesCpuTsne()) {
+        _cpuTsneComputation.continueGradientDescent(iterations);
+        emit embeddingUpdate(_cpuTsneComputation.getEmbedding());
+    }
+    else if (_normScheme == utils::NormalizationScheme::TSNE) {
         _tsneComputation.continueGradientDescent(iterations, false);
         emit embeddingUpdate(_tsneComputation.getEmbedding().getContainer());
     }
+    else if (usesCpuUmap()) {
+        _cpuUmapComputation.continueGradientDescent(iterations);
+        emit embeddingUpdate(_cpuUmapComputation.getEmbedding());
+    }
     else {
         _umapComputation.runGradientDescentForEpochs(iterations);
         emit embeddingUpdate(_umapComputation.getEmbedding());
     }
 }
 
+const std::vector<float>& EmbedWorker::getEmbedding() const
+{
+    if (usesCpuTsne())
+        return _cpuTsneComputation.getEmbedding();
+    else if (_normScheme == utils::NormalizationScheme::TSNE)
+        return _tsneComputation.getEmbedding().getContainer();
+    else if (usesCpuUmap())
+        return _cpuUmapComputation.getEmbedding();
+    else
+        return _umapComputation.getEmbedding();
+}
+
 sph::utils::EmbeddingExtends EmbedWorker::computeExtends() const
 {
-    if (_normScheme == utils::NormalizationScheme::TSNE) {
-        auto& emb = _tsneComputation.getEmbedding().getContainer();
-        return utils::computeExtends(emb);
-    }
-    else {
-        auto& emb = _umapComputation.getEmbedding();
-        return utils::computeExtends(emb);
-    }
+    return utils::computeExtends(getEmbedding());
 }
 
 /// /////////////////////// ///
@@ -172,21 +263,29 @@ sph::utils::EmbeddingExtends EmbedWorker::computeExtends() const
 ComputeEmbeddingWrapper::ComputeEmbeddingWrapper(const std::string& name)
 {
     _analysisName = name;
-
-    // Offscreen buffer must be created in the UI thread because it is a QWindow
-    _offscreenBuffer->moveToThread(&_workerThread);
-    _offscreenBuffer->getContext()->moveToThread(&_workerThread);
 }
 
 ComputeEmbeddingWrapper::~ComputeEmbeddingWrapper()
 {
-    _workerThread.quit();
-    _workerThread.wait();
-    _workerThread.deleteLater();
+    if (!_jobHandle.isValid())
+        return;
+
+    // The worker lives in a pool thread: make sure it does not compute anymore and delete it there
+    _embeddingService->resetPriorityWorker(_embedWorker.get());
+    disconnect(_embedWorker.get(), nullptr, this, nullptr);
+    _embedWorker->retire();
+    _embedWorker.release()->deleteLater();
+    _jobHandle.reset();
 }
 
 void ComputeEmbeddingWrapper::startComputation(const utils::Graph& knnGraph, const TsneEmbeddingParameters& params)
 {
+    if (_tsneEngine != TsneEngine::LIBRARY)
+    {
+        Log::warn("ComputeEmbeddingWrapper::startComputation: the CPU t-SNE engines expect a probability distribution, using the library gradient descent for " + _analysisName);
+        setTsneEngine(TsneEngine::LIBRARY);
+    }
+
     _embedWorker->getTsneComp().setNeighborGraph(&knnGraph);
 
     compute(params);
@@ -195,6 +294,7 @@ void ComputeEmbeddingWrapper::startComputation(const utils::Graph& knnGraph, con
 void ComputeEmbeddingWrapper::startComputation(const SparseMatHDI& probDist, const TsneEmbeddingParameters& params)
 {
     _embedWorker->getTsneComp().setProbabilityDistribution(&probDist);
+    _embedWorker->getCpuTsneComp().setProbabilityDistribution(&probDist);
 
     compute(params);
 }
@@ -202,6 +302,7 @@ void ComputeEmbeddingWrapper::startComputation(const SparseMatHDI& probDist, con
 void ComputeEmbeddingWrapper::startComputation(const utils::Graph& knnGraph, const UmapEmbeddingParameters& params)
 {
     _embedWorker->getUmapComp().setNeighborGraph(&knnGraph);
+    _embedWorker->setUseCpuUmap(false);
 
     compute(params);
 }
@@ -209,6 +310,8 @@ void ComputeEmbeddingWrapper::startComputation(const utils::Graph& knnGraph, con
 void ComputeEmbeddingWrapper::startComputation(const SparseMatHDI& probDist, const UmapEmbeddingParameters& params)
 {
     _embedWorker->getUmapComp().setNeighborMatrix(&probDist);
+    _embedWorker->getCpuUmapComp().setNeighborMatrix(&probDist);
+    _embedWorker->setUseCpuUmap(true);
 
     compute(params);
 }
@@ -242,86 +345,171 @@ void ComputeEmbeddingWrapper::updateInitEmbedding(const uint64_t newLevel, const
     utils::randomEmbeddingInit(_initEmbedding, _initRadius, _initRadius);
 }
 
-void ComputeEmbeddingWrapper::compute(const TsneEmbeddingParameters& params)
+bool ComputeEmbeddingWrapper::ensureJob()
+{
+    if (_jobHandle.isValid())
+        return true;
+
+    if (_embeddingService == nullptr)
+    {
+        Log::error("ComputeEmbeddingWrapper::ensureJob: no embedding service set for " + _analysisName);
+        return false;
+    }
+
+    _embedWorker->setName(_analysisName);
+    _jobHandle = _embeddingService->submit(_embedWorker.get());
+
+    // To worker
+    connect(this, &ComputeEmbeddingWrapper::startWorker, _embedWorker.get(), &EmbedWorker::compute);
+    connect(this, &ComputeEmbeddingWrapper::continueWorker, _embedWorker.get(), &EmbedWorker::continueComputation);
+    connect(this, &ComputeEmbeddingWrapper::stopWorker, _embedWorker.get(), &EmbedWorker::stop, Qt::DirectConnection);
+
+    // From worker
+    connect(_embedWorker.get(), &EmbedWorker::started, this, &ComputeEmbeddingWrapper::workerStarted);
+    connect(_embedWorker.get(), &EmbedWorker::stopped, this, &ComputeEmbeddingWrapper::workerEnded);
+    connect(_embedWorker.get(), &EmbedWorker::embeddingUpdate, this, &ComputeEmbeddingWrapper::embeddingUpdate);
+    connect(_embedWorker.get(), &EmbedWorker::finished, this, [this](utils::EmbeddingExtends emdExtends) {
+        _emdExtendsFinal = emdExtends;
+        Log::info("ComputeEmbeddingWrapper::publishExtends: Embedding extends at iteration {0} are {1} ", _embedWorker->getCurrentIterations(), _emdExtendsFinal.getMinMaxString());
+        emit finished();
+        emit workerEnded();
+        }); 
+    connect(_embedWorker.get(), &EmbedWorker::publishExtends, this, [this](utils::EmbeddingExtends emdExtends) {
+        _emdExtendsTarget = emdExtends;
+        Log::info("ComputeEmbeddingWrapper::publishExtends: Embedding extends at iteration {0} are {1} ", _embedWorker->getCurrentIterations(), _emdExtendsTarget.getMinMaxString());
+    });
+
+    return true;
+}
+
+bool ComputeEmbeddingWrapper::setupTsneEngine(const TsneEmbeddingParameters& params)
 {
     _embedWorker->setNormScheme(utils::NormalizationScheme::TSNE);
+
+    if (_tsneEngine == TsneEngine::HIERARCHY && _tsneRepulsion == nullptr)
+    {
+        Log::warn("ComputeEmbeddingWrapper::compute: no hierarchy repulsion set, using the Barnes-Hut CPU engine for " + _analysisName);
+        setTsneEngine(TsneEngine::BARNES_HUT);
+    }
+
+    _embedWorker->setTsneEngine(_tsneEngine);
+
+    if (_tsneEngine == TsneEngine::LIBRARY)
+        return false;
+
+    auto& cpuTsneComputation = _embedWorker->getCpuTsneComp();
+    cpuTsneComputation.setParams(params);
+
+    if (_tsneRepulsion)
+        cpuTsneComputation.setRepulsion(_tsneEngine, _tsneRepulsion);
+    else
+        cpuTsneComputation.setEngine(_tsneEngine);
+
+    return true;
+}
+
+void ComputeEmbeddingWrapper::resumeComputation(const SparseMatHDI& probDist, const TsneEmbeddingParameters& params, CpuTsneState&& state)
+{
+    if (!ensureJob())
+        return;
+
+    _tsneParams = params;
+    _resumeFromInit = false;
+
+    _embedWorker->getTsneComp().setProbabilityDistribution(&probDist);
+    _embedWorker->getCpuTsneComp().setProbabilityDistribution(&probDist);
+
+    if (!setupTsneEngine(params))
+    {
+        Log::error("ComputeEmbeddingWrapper::resumeComputation: only the CPU t-SNE engines can resume, " + _analysisName);
+        return;
+    }
+
+    const uint32_t iteration = state.iteration;
+    _initEmbedding = state.embedding;
+    _embedWorker->getCpuTsneComp().restoreState(std::move(state));
+    setNumIterations(iteration);
+
+    emit embeddingUpdate(_initEmbedding);
+
+    if (params.numIterations <= iteration)
+        return;
+
+    Log::info("ComputeEmbeddingWrapper::resumeComputation: resume t-SNE at iteration {0} for {1} iterations", iteration, params.numIterations - iteration);
+
+    emit startWorker(params.numIterations - iteration, /* init = */ false);
+}
+
+void ComputeEmbeddingWrapper::compute(const TsneEmbeddingParameters& params)
+{
+    if (!ensureJob())
+        return;
+
+    _tsneParams = params;
+    _resumeFromInit = false;
+
+    TsneEmbeddingParameters tsneParams = params;
+
+    // The plugin's CPU engines need neither the library setup nor a GL context
+    if (setupTsneEngine(tsneParams))
+    {
+        _embedWorker->getCpuTsneComp().setInitialEmbedding(_initEmbedding);
+
+        Log::info("ComputeEmbeddingWrapper::compute: start {0} t-SNE iterations (CPU engine)", tsneParams.numIterations);
+
+        emit embeddingUpdate(_initEmbedding);
+        emit startWorker(tsneParams.numIterations);
+        return;
+    }
+
+    // The GL context belongs to the pool thread and is only created when a GPU gradient descent is requested
+    OffscreenBufferQt* offscreenBuffer = nullptr;
+    if (tsneParams.gradientDescentType != GradientDescentType::CPU)
+    {
+        offscreenBuffer = _jobHandle.getOffscreenBuffer();
+
+        if (offscreenBuffer == nullptr)
+        {
+            Log::warn("ComputeEmbeddingWrapper::compute: no OpenGL context available, falling back to CPU gradient descent");
+            tsneParams.gradientDescentType = GradientDescentType::CPU;
+        }
+    }
+
     auto& tsneComputation = _embedWorker->getTsneComp();
-    tsneComputation.setParams(params);
+    tsneComputation.setParams(tsneParams);
     tsneComputation.setInitialEmbedding(_initEmbedding);    // updates params.gradDescentParams._presetEmbedding, i.e. call after setParams()
-    tsneComputation.setOffscreenBuffer(dynamic_cast<OffscreenBuffer*>(_offscreenBuffer.get()));
+    tsneComputation.setOffscreenBuffer(dynamic_cast<OffscreenBuffer*>(offscreenBuffer));
 
-    if (!_workerThread.isRunning())
-    {
-        _embedWorker->setName(_analysisName);
-        _embedWorker->moveToThread(&_workerThread);
-
-        // To worker
-        connect(this, &ComputeEmbeddingWrapper::startWorker, _embedWorker.get(), &EmbedWorker::compute);
-        connect(this, &ComputeEmbeddingWrapper::continueWorker, _embedWorker.get(), &EmbedWorker::continueComputation);
-        connect(this, &ComputeEmbeddingWrapper::stopWorker, _embedWorker.get(), &EmbedWorker::stop, Qt::DirectConnection);
-
-        // From worker
-        connect(_embedWorker.get(), &EmbedWorker::started, this, &ComputeEmbeddingWrapper::workerStarted);
-        connect(_embedWorker.get(), &EmbedWorker::stopped, this, &ComputeEmbeddingWrapper::workerEnded);
-        connect(_embedWorker.get(), &EmbedWorker::embeddingUpdate, this, &ComputeEmbeddingWrapper::embeddingUpdate);
-        connect(_embedWorker.get(), &EmbedWorker::finished, this, [this](utils::EmbeddingExtends emdExtends) {
-            _emdExtendsFinal = emdExtends;
-            Log::info("ComputeEmbeddingWrapper::publishExtends: Embedding extends at iteration {0} are {1} ", _embedWorker->getCurrentIterations(), _emdExtendsFinal.getMinMaxString());
-            emit finished();
-            emit workerEnded();
-            }); 
-        connect(_embedWorker.get(), &EmbedWorker::publishExtends, this, [this](utils::EmbeddingExtends emdExtends) {
-            _emdExtendsTarget = emdExtends;
-            Log::info("ComputeEmbeddingWrapper::publishExtends: Embedding extends at iteration {0} are {1} ", _embedWorker->getCurrentIterations(), _emdExtendsTarget.getMinMaxString());
-        });
-
-        // Start thread
-        _workerThread.start();
-    }
-
-    Log::info("ComputeEmbeddingWrapper::compute: start {0} t-SNE iterations", params.numIterations);
+    Log::info("ComputeEmbeddingWrapper::compute: start {0} t-SNE iterations", tsneParams.numIterations);
 
     // Update core with init embedding
     emit embeddingUpdate(_initEmbedding);
 
     // Start computation in thread
-    emit startWorker(params.numIterations);
+    emit startWorker(tsneParams.numIterations);
 }
 
 void ComputeEmbeddingWrapper::compute(const UmapEmbeddingParameters& params)
 {
+    if (!ensureJob())
+        return;
+
+    _umapParams = params;
+    _resumeFromInit = false;
+
     _embedWorker->setNormScheme(utils::NormalizationScheme::UMAP);
-    auto& umapComputation = _embedWorker->getUmapComp();
-    umapComputation.setParams(params);
-    umapComputation.setInitialEmbedding(_initEmbedding);    // updates params.gradDescentParams._presetEmbedding, i.e. call after setParams()
 
-    if (!_workerThread.isRunning())
+    if (_embedWorker->usesCpuUmap())
     {
-        _embedWorker->setName(_analysisName);
-        _embedWorker->moveToThread(&_workerThread);
-
-        // To worker
-        connect(this, &ComputeEmbeddingWrapper::startWorker, _embedWorker.get(), &EmbedWorker::compute);
-        connect(this, &ComputeEmbeddingWrapper::continueWorker, _embedWorker.get(), &EmbedWorker::continueComputation);
-        connect(this, &ComputeEmbeddingWrapper::stopWorker, _embedWorker.get(), &EmbedWorker::stop, Qt::DirectConnection);
-
-        // From worker
-        connect(_embedWorker.get(), &EmbedWorker::started, this, &ComputeEmbeddingWrapper::workerStarted);
-        connect(_embedWorker.get(), &EmbedWorker::stopped, this, &ComputeEmbeddingWrapper::workerEnded);
-        connect(_embedWorker.get(), &EmbedWorker::embeddingUpdate, this, &ComputeEmbeddingWrapper::embeddingUpdate);
-        connect(_embedWorker.get(), &EmbedWorker::finished, this, [this](utils::EmbeddingExtends emdExtends) {
-            _emdExtendsFinal = emdExtends;
-            Log::info("ComputeEmbeddingWrapper::publishExtends: Embedding extends at iteration {0} are {1} ", _embedWorker->getCurrentIterations(), _emdExtendsFinal.getMinMaxString());
-            emit finished();
-            emit workerEnded();
-            }); 
-        connect(_embedWorker.get(), &EmbedWorker::publishExtends, this, [this](utils::EmbeddingExtends emdExtends) {
-            _emdExtendsTarget = emdExtends;
-            Log::info("ComputeEmbeddingWrapper::publishExtends: Embedding extends at iteration {0} are {1} ", _embedWorker->getCurrentIterations(), _emdExtendsTarget.getMinMaxString());
-        });
-
-        // Start thread
-        _workerThread.start();
+        auto& cpuUmapComputation = _embedWorker->getCpuUmapComp();
+        cpuUmapComputation.setParams(params);
+        cpuUmapComputation.setInitialEmbedding(_initEmbedding);
+    }
+    else
+    {
+        auto& umapComputation = _embedWorker->getUmapComp();
+        umapComputation.setParams(params);
+        umapComputation.setInitialEmbedding(_initEmbedding);    // updates params.gradDescentParams._presetEmbedding, i.e. call after setParams()
     }
 
     Log::info("ComputeEmbeddingWrapper::compute: start {0} UMAP iterations", params.numEpochs);
@@ -337,7 +525,44 @@ void ComputeEmbeddingWrapper::continueComputation(uint32_t iterations)
 {
     Log::info("ComputeEmbeddingWrapper::compute: continue {0} iterations", iterations);
 
-    emit continueWorker(iterations);
+    if (!_resumeFromInit)
+    {
+        // the learning rate of UMAP decays over the epochs, make room for the new ones
+        if (_embedWorker->usesCpuUmap())
+            _embedWorker->getCpuUmapComp().extendSchedule(iterations);
+
+        emit continueWorker(iterations);
+        return;
+    }
+
+    // The gradient descent state (and GPU buffers) do not know the replaced layout, start again from it without exaggeration and at the final momentum
+    if (_embedWorker->getNormScheme() == utils::NormalizationScheme::TSNE)
+    {
+        auto tsneParams = _tsneParams;
+        tsneParams.numIterations = iterations;
+        tsneParams.gradDescentParams._remove_exaggeration_iter = 0;
+        tsneParams.gradDescentParams._exponential_decay_iter = 0;
+        tsneParams.gradDescentParams._mom_switching_iter = 0;
+        compute(tsneParams);
+    }
+    else
+    {
+        auto umapParams = _umapParams;
+        umapParams.numEpochs = iterations;
+        compute(umapParams);
+    }
+}
+
+void ComputeEmbeddingWrapper::replaceEmbedding(std::vector<float>&& embedding)
+{
+    assert(embedding.size() == _initEmbedding.size());
+
+    stopComputation();
+
+    _initEmbedding = std::move(embedding);
+    _resumeFromInit = true;
+
+    emit embeddingUpdate(_initEmbedding);
 }
 
 void ComputeEmbeddingWrapper::restartComputation(const TsneEmbeddingParameters& params)
@@ -359,6 +584,18 @@ void ComputeEmbeddingWrapper::stopComputation()
     emit stopWorker();
 }
 
+void ComputeEmbeddingWrapper::requestPriority()
+{
+    if (_embeddingService != nullptr)
+        _embeddingService->setPriorityWorker(_embedWorker.get());
+}
+
+void ComputeEmbeddingWrapper::setEmbeddingService(EmbeddingService* service)
+{
+    assert(!_jobHandle.isValid());     // the worker cannot change its pool thread
+    _embeddingService = service;
+}
+
 /// ///////////////// ///
 /// OffscreenBufferQt ///
 /// ///////////////// ///
@@ -371,23 +608,62 @@ OffscreenBufferQt::OffscreenBufferQt() :
     create();
 }
 
-void OffscreenBufferQt::initialize()
+bool OffscreenBufferQt::createContext()
 {
-    QOpenGLContext* globalContext = QOpenGLContext::globalShareContext();
-    _context->setFormat(globalContext->format());
+    if (_context.isNull())
+        _context = new QOpenGLContext(this);
 
-    if (!_context->create())
-        qFatal("Cannot create requested OpenGL context.");
+    if (const QOpenGLContext* globalContext = QOpenGLContext::globalShareContext())
+        _context->setFormat(globalContext->format());
 
-    bindContext();
+    if (!_context->create() || !_context->makeCurrent(this)) {
+        Log::warn("OffscreenBufferQt::createContext: cannot create the requested OpenGL context");
+        return false;
+    }
 
 #ifndef __APPLE__
     if (!gladLoadGL()) {
-        qFatal("No OpenGL context is currently bound, therefore OpenGL function loading has failed.");
+        Log::warn("OffscreenBufferQt::createContext: OpenGL function loading has failed");
+        releaseContext();
+        return false;
     }
 #endif // Not __APPLE__
 
     _isInitialized = true;
+    return true;
+}
+
+void OffscreenBufferQt::initialize()
+{
+    // The context of a pool thread is shared by all embedding workers on that thread.
+    // It is created by the embedding service before the buffer is handed out, such that a failure falls back to the CPU
+    if (!_isInitialized && !createContext())
+    {
+        Log::warn("OffscreenBufferQt::initialize: no OpenGL context for the GPU gradient descent");
+        return;
+    }
+
+    bindContext();
+}
+
+bool OffscreenBufferQt::isAvailable()
+{
+    static const bool available = []() -> bool {
+        const QOpenGLContext* globalContext = QOpenGLContext::globalShareContext();
+
+        QOpenGLContext testContext;
+        if (globalContext != nullptr)
+            testContext.setFormat(globalContext->format());
+
+        if (globalContext == nullptr || !testContext.create()) {
+            Log::info("OffscreenBufferQt::isAvailable: no OpenGL context available, only CPU gradient descent can be used");
+            return false;
+        }
+
+        return true;
+        }();
+
+    return available;
 }
 
 void OffscreenBufferQt::bindContext()
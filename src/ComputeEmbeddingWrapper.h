@@ -1,14 +1,23 @@
 #pragma once
 
+#include "CpuTsneComputation.h"
+#include "CpuUmapComputation.h"
+#include "EmbeddingCheckpoint.h"
+#include "EmbeddingService.h"
+
 #include <sph/EmbedTsne.hpp>
 #include <sph/EmbedUmap.hpp>
 #include <sph/utils/CommonDefinitions.hpp>
 #include <sph/utils/Embedding.hpp>
 #include <sph/utils/Graph.hpp>
+#include <sph/utils/Progressbar.hpp>
 #include <sph/utils/Settings.hpp>
 
+#include <atomic>
+#include <filesystem>
 #include <limits>
 #include <memory>
+#include <mutex>
 
 #include <QOpenGLContext>
 #include <QPointer>
@@ -37,15 +46,36 @@ public: // Setter
     void setPublishExtendsIter(uint32_t publishExtendsIter) { _publishExtendsIter = publishExtendsIter; }
     void setNumIterations(uint32_t num) { _currentIteration = num; }
     void setNormScheme(sph::utils::NormalizationScheme scheme) { _normScheme = scheme; }
+    void setPriority(bool hasPriority) { _hasPriority = hasPriority; }
+    void setTsneEngine(TsneEngine engine) { _tsneEngine = engine; }
+    void setUseCpuUmap(bool useCpuUmap) { _useCpuUmap = useCpuUmap; }
+
+    /** The CPU t-SNE engines periodically save their state to path, an empty path disables checkpoints */
+    void setCheckpoint(const std::filesystem::path& path, uint64_t key);
 
 public: // Getter
     std::string getName() const { return _analysisParentName; }
     uint32_t getCurrentIterations() const { return _currentIteration; }
     uint32_t getPublishExtendsIter() const { return _publishExtendsIter; }
     sph::utils::NormalizationScheme getNormScheme() const { return _normScheme; }
+    bool hasPriority() const { return _hasPriority; }
     const size_t getWorkerID() const { return _workerID; }
     sph::TsneComputation& getTsneComp() { return _tsneComputation; }
     sph::UmapComputation& getUmapComp() { return _umapComputation; }
+    CpuTsneComputation& getCpuTsneComp() { return _cpuTsneComputation; }
+    const CpuTsneComputation& getCpuTsneComp() const { return _cpuTsneComputation; }
+    CpuUmapComputation& getCpuUmapComp() { return _cpuUmapComputation; }
+    const CpuUmapComputation& getCpuUmapComp() const { return _cpuUmapComputation; }
+    TsneEngine getTsneEngine() const { return _tsneEngine; }
+
+    /** Whether the t-SNE gradient descent runs in one of the plugin's CPU engines instead of the library */
+    bool usesCpuTsne() const { return _normScheme == sph::utils::NormalizationScheme::TSNE && _tsneEngine != TsneEngine::LIBRARY; }
+
+    /** Whether UMAP runs in the plugin's multithreaded, resumable engine instead of the library */
+    bool usesCpuUmap() const { return _normScheme == sph::utils::NormalizationScheme::UMAP && _useCpuUmap; }
+
+    /** Current layout of the active engine */
+    const std::vector<float>& getEmbedding() const;
 
     inline constexpr uint32_t getUpdateStep() const { return _updateSteps; }
 
@@ -55,6 +85,9 @@ public slots:
     void stop();
     void resetStop();
 
+    /** Stops for good and waits for a running computation to return, called before the worker is deleted */
+    void retire();
+
 signals:
     void embeddingUpdate(const std::vector<float>& emb);
     void finished(sph::utils::EmbeddingExtends extends);
@@ -66,16 +99,41 @@ private:
     void initGradientDescent(uint32_t iterations);
     void continueGradientDescent(uint32_t iterations);
     sph::utils::EmbeddingExtends computeExtends() const;
+    void checkPublishExtends();
+
+    /** Saves the state of the CPU t-SNE engines every _checkpointInterval iterations, or now if forced */
+    void checkpoint(bool force);
+
+    /** Computes a few update steps and re-queues itself, so that all jobs on a pool thread progress in turn */
+    void computeSlice(uint64_t runID);
+    void scheduleSlice();
 
 private:
     static size_t                       _workerCount;
     static constexpr uint32_t           _updateSteps = 10;
+    static constexpr uint32_t           _sliceSteps = 2;                // Number of update steps per slice
+    static constexpr uint32_t           _prioritySliceSteps = 8;        // Number of update steps per slice for the prioritized job
+    static constexpr uint32_t           _checkpointInterval = 250;      // Iterations between checkpoints
 
     sph::TsneComputation                _tsneComputation = {};
     sph::UmapComputation                _umapComputation = {};
+    CpuTsneComputation                  _cpuTsneComputation = {};
+    TsneEngine                          _tsneEngine = TsneEngine::LIBRARY;
+    CpuUmapComputation                  _cpuUmapComputation = {};
+    bool                                _useCpuUmap = true;             // The library UMAP is only used for kNN graphs
+    std::filesystem::path               _checkpointPath = {};           // Checkpoints are disabled for empty paths
+    uint64_t                            _checkpointKey = 0;
+    uint32_t                            _lastCheckpointIteration = 0;
     uint32_t                            _currentIteration = 0;          // Current gradient descent iteration
     uint32_t                            _publishExtendsIter = 0;        // Iteration at which to publish extends
+    uint64_t                            _runID = 0;                     // Identifies the current compute run
+    std::atomic<uint32_t>               _runIterations = 0;             // Total iterations of the current run
+    std::atomic<uint32_t>               _remainingIterations = 0;       // Remaining iterations of the current run
+    std::unique_ptr<sph::utils::ProgressBar> _progress = nullptr;
     volatile bool                       _shouldStop = false;
+    std::atomic<bool>                   _hasPriority = false;
+    std::atomic<bool>                   _isRetired = false;
+    std::mutex                          _computeMutex = {};
     sph::utils::NormalizationScheme     _normScheme = sph::utils::NormalizationScheme::TSNE;
 
     size_t                              _workerID = ++_workerCount;     // Debugging counter
@@ -102,19 +160,37 @@ public:
     
     void continueComputation(uint32_t iterations);
     void stopComputation();
+
+    /** Gives this embedding longer compute slices than all other jobs in the embedding service */
+    void requestPriority();
     void restartComputation(const sph::TsneEmbeddingParameters& params);
     void restartComputation(const sph::UmapEmbeddingParameters& params);
 
+    /** Continues a CPU t-SNE engine from a checkpoint state until params.numIterations, the engine must be set before */
+    void resumeComputation(const sph::SparseMatHDI& probDist, const sph::TsneEmbeddingParameters& params, CpuTsneState&& state);
+
     void initEmbedding(const uint64_t newLevel, uint64_t numEmbPoints, std::vector<float>&& embedding);    // for first time embedding
     void initEmbedding(const uint64_t newLevel, uint64_t numEmbPoints);                                    // for first time embedding
     void updateInitEmbedding(const uint64_t newLevel, const uint64_t levelSize);
 
+    /** Stops the computation and replaces its layout, e.g. after a local re-optimization. The next continue resumes from it without exaggeration */
+    void replaceEmbedding(std::vector<float>&& embedding);
+
 public: // Setter
 
+    /** Pool on which the embedding worker runs, must be set before the first computation */
+    void setEmbeddingService(EmbeddingService* service);
     void setCurrentLevel(uint64_t level) { _currentLevel = level; }
     void setNumIterations(uint32_t num) { _embedWorker->setNumIterations(num); }
     void setPublishExtendsIter(uint32_t num) { _embedWorker->setPublishExtendsIter(num); }
     void setNormScheme(sph::utils::NormalizationScheme scheme) { _embedWorker->setNormScheme(scheme); }
+    void setCheckpoint(const std::filesystem::path& path, uint64_t key) { _embedWorker->setCheckpoint(path, key); }
+
+    /**
+     * Gradient descent engine of the following t-SNE computations, the library one is used with the gradient descent type of the parameters
+     * @param repulsion Required by engines that depend on the embedded points, e.g. TsneEngine::HIERARCHY
+     */
+    void setTsneEngine(TsneEngine engine, std::shared_ptr<TsneRepulsion> repulsion = nullptr) { _tsneEngine = engine; _tsneRepulsion = std::move(repulsion); }
 
 public: // Getter
     auto& getInitEmbedding() { return _initEmbedding; };
@@ -122,8 +198,8 @@ public: // Getter
 
     bool canContinue() const { return (_embedWorker == nullptr) ? false : _embedWorker->getCurrentIterations() >= 1; }
     uint32_t getCurrentIterations() const { return _embedWorker->getCurrentIterations(); }
-    const std::vector<float>& getEmbedding() const { return _embedWorker->getTsneComp().getEmbedding().getContainer(); }
-    bool threadIsRunning() const { return _workerThread.isRunning(); }
+    const std::vector<float>& getEmbedding() const { return _embedWorker->getEmbedding(); }
+    bool threadIsRunning() const { return _jobHandle.isValid(); }
 
 signals: // Outgoing signals
     void embeddingUpdate(const std::vector<float>& emb);
@@ -139,15 +215,21 @@ signals: // Local signals
 
 private:
     void compute(const sph::TsneEmbeddingParameters& params);
+
+    /** Sets up the worker for t-SNE, returns whether one of the plugin's CPU engines is used */
+    bool setupTsneEngine(const sph::TsneEmbeddingParameters& params);
     void compute(const sph::UmapEmbeddingParameters& params);
     void resizeInitEmbedding(uint64_t numEmbPoints);
 
+    /** Submits the worker to the embedding service on first use and connects it */
+    bool ensureJob();
+
 private:
     // Embedding Computation
-    QThread                             _workerThread       = QThread{};
+    EmbeddingService*                   _embeddingService   = nullptr;  /** Thread pool, owned by the plugin */
+    EmbeddingJobHandle                  _jobHandle          = {};       /** Pool thread reserved for _embedWorker */
     std::string                         _analysisName       = "";
     std::unique_ptr<EmbedWorker>        _embedWorker        = std::make_unique<EmbedWorker>();
-    std::unique_ptr<OffscreenBufferQt>  _offscreenBuffer    = std::make_unique<OffscreenBufferQt>();
 
     // Data
     std::vector<float>                  _embedding          = {};       /** current positions */
@@ -157,6 +239,11 @@ private:
 
     // Settings
     float                               _initRadius         = 1.f;
+    sph::TsneEmbeddingParameters        _tsneParams         = {};       /** Settings of the last t-SNE computation */
+    sph::UmapEmbeddingParameters        _umapParams         = {};       /** Settings of the last UMAP computation */
+    bool                                _resumeFromInit     = false;    /** The layout was replaced, continue re-initializes the gradient descent */
+    TsneEngine                          _tsneEngine         = TsneEngine::LIBRARY;
+    std::shared_ptr<TsneRepulsion>      _tsneRepulsion      = nullptr;  /** Repulsion of engines that depend on the embedded points */
     uint64_t                            _currentLevel       = std::numeric_limits<uint64_t>::max();
 };
 
@@ -171,6 +258,12 @@ public:
 
     QOpenGLContext* getContext() { return _context; }
 
+    /** Whether an OpenGL context can be created on this machine, probed once in the UI thread */
+    static bool isAvailable();
+
+    /** Creates the context and loads the OpenGL functions in the calling thread, leaves the context current on success */
+    bool createContext();
+
     void initialize() override;
     void bindContext() override;
     void releaseContext() override;
@@ -0,0 +1,207 @@
+#include "CpuTsneComputation.h"
+
+#include "BarnesHutRepulsion.h"
+#include "FftRepulsion.h"
+
+#include <sph/utils/Logger.hpp>
+
+#include <hdi/data/map_mem_eff.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <utility>
+
+using namespace sph;
+
+namespace {
+    // Defaults of the HDI gradient descent
+    constexpr float initialMomentum = 0.2f;
+    constexpr float finalMomentum   = 0.5f;
+    constexpr float minimumGain     = 0.1f;
+}
+
+CpuTsneComputation::CpuTsneComputation()
+{
+    setEngine(_engine);
+}
+
+CpuTsneComputation::~CpuTsneComputation() = default;
+
+void CpuTsneComputation::setEngine(TsneEngine engine)
+{
+    assert(engine != TsneEngine::LIBRARY && engine != TsneEngine::HIERARCHY);
+
+    if (_repulsion && engine == _engine)
+        return;
+
+    _engine = engine;
+
+    switch (engine)
+    {
+    case TsneEngine::BARNES_HUT:
+        _repulsion = std::make_shared<BarnesHutRepulsion>();
+        break;
+    case TsneEngine::FFT_INTERPOLATION:
+    default:
+        _repulsion = std::make_shared<FftRepulsion>();
+        break;
+    }
+}
+
+void CpuTsneComputation::setRepulsion(TsneEngine engine, std::shared_ptr<TsneRepulsion> repulsion)
+{
+    assert(engine != TsneEngine::LIBRARY && repulsion != nullptr);
+
+    _engine = engine;
+    _repulsion = std::move(repulsion);
+}
+
+void CpuTsneComputation::compute(uint32_t iterations)
+{
+    assert(_probDist != nullptr);
+    assert(_state.embedding.size() == _probDist->size() * 2);
+
+    const size_t numPoints = _probDist->size();
+
+    _state.gains.assign(numPoints * 2, 1.f);
+    _state.updates.assign(numPoints * 2, 0.f);
+    _state.iteration = 0;
+
+    prepare();
+
+    // negative factors select the automatic exaggeration
+    const double exaggerationFactor = _params.gradDescentParams._exaggeration_factor;
+    _state.exaggerationFactor = exaggerationFactor > 0 ? static_cast<float>(exaggerationFactor) : 4.f + numPoints / 60000.f;
+
+    _state.learningRate = std::max(200.f, static_cast<float>(numPoints) / _state.exaggerationFactor);
+
+    Log::info("CpuTsneComputation::compute: {0} points, exaggeration {1}, learning rate {2}", numPoints, _state.exaggerationFactor, _state.learningRate);
+
+    continueGradientDescent(iterations);
+}
+
+void CpuTsneComputation::restoreState(CpuTsneState&& state)
+{
+    assert(_probDist != nullptr);
+    assert(state.embedding.size() == _probDist->size() * 2);
+    assert(state.gains.size() == state.embedding.size() && state.updates.size() == state.embedding.size());
+
+    _state = std::move(state);
+    prepare();
+
+    Log::info("CpuTsneComputation::restoreState: {0} points at iteration {1}", _probDist->size(), _state.iteration);
+}
+
+void CpuTsneComputation::prepare()
+{
+    const size_t numPoints = _probDist->size();
+
+    _attraction.resize(numPoints * 2);
+
+    // p_ij = P_ij / sum(P), the plugin's probability distributions are symmetric
+    std::vector<double> rowSums(numPoints, 0);
+    SPH_PARALLEL
+    for (int64_t row = 0; row < static_cast<int64_t>(numPoints); row++)
+        for (const auto& [col, value] : (*_probDist)[row])
+            rowSums[row] += value;
+
+    double probDistSum = 0;
+    for (const double rowSum : rowSums)
+        probDistSum += rowSum;
+
+    _probDistNormalization = probDistSum > 0 ? static_cast<float>(1. / probDistSum) : 0.f;
+}
+
+void CpuTsneComputation::continueGradientDescent(uint32_t iterations)
+{
+    for (uint32_t iter = 0; iter < iterations && !_shouldStop; iter++)
+        iterate();
+}
+
+float CpuTsneComputation::currentExaggeration() const
+{
+    const auto& gradDescentParams = _params.gradDescentParams;
+    const uint32_t removeExaggerationIter = gradDescentParams._remove_exaggeration_iter;
+    const uint32_t decayIter = gradDescentParams._exponential_decay_iter;
+
+    if (_state.iteration < removeExaggerationIter)
+        return _state.exaggerationFactor;
+
+    // linear decay like the HDI gradient descent
+    if (_state.iteration < removeExaggerationIter + decayIter)
+    {
+        const float decay = 1.f - static_cast<float>(_state.iteration - removeExaggerationIter) / decayIter;
+        return 1.f + (_state.exaggerationFactor - 1.f) * decay;
+    }
+
+    return 1.f;
+}
+
+void CpuTsneComputation::computeAttraction()
+{
+    const auto& probDist = *_probDist;
+
+    SPH_PARALLEL
+    for (int64_t i = 0; i < static_cast<int64_t>(probDist.size()); i++)
+    {
+        const float xi = _state.embedding[2 * i];
+        const float yi = _state.embedding[2 * i + 1];
+
+        float attrX = 0, attrY = 0;
+        for (const auto& [j, value] : probDist[i])
+        {
+            const float dx = xi - _state.embedding[2 * j];
+            const float dy = yi - _state.embedding[2 * j + 1];
+            const float w = value / (1.f + dx * dx + dy * dy);
+            attrX += w * dx;
+            attrY += w * dy;
+        }
+
+        _attraction[2 * i] = attrX * _probDistNormalization;
+        _attraction[2 * i + 1] = attrY * _probDistNormalization;
+    }
+}
+
+void CpuTsneComputation::iterate()
+{
+    const int64_t numValues = static_cast<int64_t>(_state.embedding.size());
+    if (numValues == 0)
+        return;
+
+    const float exaggeration = currentExaggeration();
+    const float momentum = _state.iteration < _params.gradDescentParams._mom_switching_iter ? initialMomentum : finalMomentum;
+
+    computeAttraction();
+    const double normalization = _repulsion->compute(_state.embedding, _repulsionForces);
+    const float invNormalization = normalization > 0 ? static_cast<float>(1. / normalization) : 0.f;
+
+    SPH_PARALLEL
+    for (int64_t v = 0; v < numValues; v++)
+    {
+        const float gradient = 4.f * (exaggeration * _attraction[v] - _repulsionForces[v] * invNormalization);
+
+        _state.gains[v] = (std::signbit(gradient) != std::signbit(_state.updates[v])) ? _state.gains[v] + 0.2f : std::max(_state.gains[v] * 0.8f, minimumGain);
+        _state.updates[v] = momentum * _state.updates[v] - _state.learningRate * _state.gains[v] * gradient;
+        _state.embedding[v] += _state.updates[v];
+    }
+
+    // keep the embedding centered
+    double meanX = 0, meanY = 0;
+    for (int64_t v = 0; v < numValues; v += 2)
+    {
+        meanX += _state.embedding[v];
+        meanY += _state.embedding[v + 1];
+    }
+    meanX /= (numValues / 2);
+    meanY /= (numValues / 2);
+
+    SPH_PARALLEL
+    for (int64_t v = 0; v < numValues; v += 2)
+    {
+        _state.embedding[v] -= static_cast<float>(meanX);
+        _state.embedding[v + 1] -= static_cast<float>(meanY);
+    }
+
+    _state.iteration++;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <sph/EmbedTsne.hpp>
+#include <sph/utils/CommonDefinitions.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/** Gradient descent implementations of t-SNE, the library one (GPU or Barnes-Hut) and the CPU engines of the plugin */
+enum class TsneEngine
+{
+    LIBRARY,            /** sph::TsneComputation with the gradient descent type of the parameters */
+    FFT_INTERPOLATION,  /** CpuTsneComputation with FftRepulsion */
+    BARNES_HUT,         /** CpuTsneComputation with BarnesHutRepulsion */
+    HIERARCHY,          /** CpuTsneComputation with HierarchyRepulsion, which depends on the embedded level and is set with setRepulsion() */
+};
+
+/// ///////////// ///
+/// TsneRepulsion ///
+/// ///////////// ///
+
+/** Approximates the repulsive t-SNE forces of all points */
+class TsneRepulsion
+{
+public:
+    virtual ~TsneRepulsion() = default;
+
+    /**
+     * Computes the unnormalized repulsive forces sum_j w_ij^2 (y_i - y_j) with w_ij = 1 / (1 + |y_i - y_j|^2)
+     * @param positions 2D positions of all points
+     * @param forces Resized to positions
+     * @return Normalization sum_{i != j} w_ij
+     */
+    virtual double compute(const std::vector<float>& positions, std::vector<float>& forces) = 0;
+};
+
+/** Optimizer state of CpuTsneComputation, everything that is needed to resume the gradient descent */
+struct CpuTsneState
+{
+    std::vector<float>              embedding = {};
+    std::vector<float>              gains = {};
+    std::vector<float>              updates = {};       /** Previous update, i.e. the momentum term */
+    uint32_t                        iteration = 0;      /** Determines the exaggeration and momentum phase */
+    float                           exaggerationFactor = 1.f;
+    float                           learningRate = 200.f;
+};
+
+/// ////////////////// ///
+/// CpuTsneComputation ///
+/// ////////////////// ///
+
+/**
+ * Multithreaded t-SNE gradient descent on the CPU, mirrors the interface of sph::TsneComputation.
+ * Expects a symmetric probability distribution, the exaggeration and momentum schedule follow the gradient descent parameters.
+ */
+class CpuTsneComputation
+{
+public:
+    CpuTsneComputation();
+    ~CpuTsneComputation();
+
+    void setProbabilityDistribution(const sph::SparseMatHDI* probDist) { _probDist = probDist; }
+    void setParams(const sph::TsneEmbeddingParameters& params) { _params = params; }
+    void setInitialEmbedding(const std::vector<float>& embedding) { _state.embedding = embedding; }
+    void setEngine(TsneEngine engine);
+
+    /** For engines that need more information than the positions, e.g. the hierarchy */
+    void setRepulsion(TsneEngine engine, std::shared_ptr<TsneRepulsion> repulsion);
+
+    /** Resets the optimizer state and runs iterations */
+    void compute(uint32_t iterations);
+    void continueGradientDescent(uint32_t iterations);
+
+    /** Continues from a saved state instead of the initial embedding, set the probability distribution and parameters first */
+    void restoreState(CpuTsneState&& state);
+
+    void stop() { _shouldStop = true; }
+    void resetStop() { _shouldStop = false; }
+
+public: // Getter
+    const std::vector<float>& getEmbedding() const { return _state.embedding; }
+    uint32_t getIteration() const { return _state.iteration; }
+    const CpuTsneState& getState() const { return _state; }
+    TsneEngine getEngine() const { return _engine; }
+
+private:
+    /** Normalization of the probability distribution and buffers */
+    void prepare();
+    void iterate();
+    float currentExaggeration() const;
+
+    /** Attractive forces sum_j p_ij w_ij (y_i - y_j), parallel over the rows of the probability distribution */
+    void computeAttraction();
+
+private:
+    const sph::SparseMatHDI*        _probDist = nullptr;
+    sph::TsneEmbeddingParameters    _params = {};
+    TsneEngine                      _engine = TsneEngine::FFT_INTERPOLATION;
+    std::shared_ptr<TsneRepulsion>  _repulsion = nullptr;
+
+    CpuTsneState                    _state = {};
+
+    // Buffers
+    std::vector<float>              _attraction = {};
+    std::vector<float>              _repulsionForces = {};
+
+    float                           _probDistNormalization = 1.f;   /** 1 / sum of all probability entries */
+    std::atomic<bool>               _shouldStop = false;
+};
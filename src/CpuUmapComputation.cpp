@@ -0,0 +1,171 @@
+#include "CpuUmapComputation.h"
+
+#include <sph/utils/Logger.hpp>
+
+#include <hdi/data/map_mem_eff.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+using namespace sph;
+
+namespace {
+    // Counter based random numbers, splitmix64 finalizer
+    uint64_t mix(uint64_t value)
+    {
+        value += 0x9E3779B97F4A7C15ull;
+        value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+        value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+        return value ^ (value >> 31);
+    }
+
+    float clip(float value, float limit)
+    {
+        return std::clamp(value, -limit, limit);
+    }
+}
+
+void CpuUmapComputation::setNeighborMatrix(const SparseMatHDI* neighborMatrix)
+{
+    _neighborMatrix = neighborMatrix;
+    _rowOffsets.clear();
+}
+
+void CpuUmapComputation::prepareEdges()
+{
+    assert(_neighborMatrix != nullptr);
+
+    const auto& neighborMatrix = *_neighborMatrix;
+    const size_t numPoints = neighborMatrix.size();
+
+    _rowOffsets.assign(numPoints + 1, 0);
+    for (size_t row = 0; row < numPoints; row++)
+        _rowOffsets[row + 1] = _rowOffsets[row] + neighborMatrix[row].size();
+
+    const uint64_t numEdges = _rowOffsets.back();
+    _columns.resize(numEdges);
+    _epochsPerSample.resize(numEdges);
+
+    std::vector<float> rowMaxima(numPoints, 0.f);
+
+    SPH_PARALLEL
+    for (int64_t row = 0; row < static_cast<int64_t>(numPoints); row++)
+    {
+        uint64_t edge = _rowOffsets[row];
+        for (const auto& [col, value] : neighborMatrix[row])
+        {
+            _columns[edge] = static_cast<uint32_t>(col);
+            _epochsPerSample[edge] = value;
+            rowMaxima[row] = std::max(rowMaxima[row], value);
+            edge++;
+        }
+    }
+
+    // the strongest edge is sampled every epoch
+    const float maxWeight = *std::max_element(rowMaxima.begin(), rowMaxima.end());
+
+    SPH_PARALLEL
+    for (int64_t edge = 0; edge < static_cast<int64_t>(numEdges); edge++)
+        _epochsPerSample[edge] = _epochsPerSample[edge] > 0 ? maxWeight / _epochsPerSample[edge] : std::numeric_limits<float>::max();
+
+    Log::info("CpuUmapComputation::prepareEdges: {0} points with {1} edges", numPoints, numEdges);
+}
+
+void CpuUmapComputation::compute(uint32_t epochs)
+{
+    assert(_neighborMatrix != nullptr);
+    assert(_embedding.size() == _neighborMatrix->size() * 2);
+
+    if (_rowOffsets.empty())
+        prepareEdges();
+
+    _epochOfNextSample = _epochsPerSample;
+    _epochOfNextNegativeSample.resize(_epochsPerSample.size());
+
+    SPH_PARALLEL
+    for (int64_t edge = 0; edge < static_cast<int64_t>(_epochsPerSample.size()); edge++)
+        _epochOfNextNegativeSample[edge] = _epochsPerSample[edge] / _negativeSampleRate;
+
+    _epoch = 0;
+    _numEpochs = std::max(_params.numEpochs, epochs);
+
+    continueGradientDescent(epochs);
+}
+
+void CpuUmapComputation::continueGradientDescent(uint32_t epochs)
+{
+    for (uint32_t epoch = 0; epoch < epochs && !_shouldStop; epoch++)
+        runEpoch();
+}
+
+void CpuUmapComputation::runEpoch()
+{
+    const int64_t numPoints = static_cast<int64_t>(_embedding.size() / 2);
+    if (numPoints == 0)
+        return;
+
+    // linear decay, the schedule may have been extended by continuing
+    const float alpha = _learningRate * std::max(1.f - static_cast<float>(_epoch) / std::max<uint32_t>(_numEpochs, 1), 0.f);
+    const auto epoch = static_cast<float>(_epoch);
+
+    _previousEmbedding = _embedding;
+
+    SPH_PARALLEL
+    for (int64_t i = 0; i < numPoints; i++)
+    {
+        float xi = _previousEmbedding[2 * i];
+        float yi = _previousEmbedding[2 * i + 1];
+
+        uint64_t randomState = mix(_seed ^ (static_cast<uint64_t>(_epoch) << 32) ^ static_cast<uint64_t>(i));
+
+        for (uint64_t edge = _rowOffsets[i]; edge < _rowOffsets[i + 1]; edge++)
+        {
+            if (_epochOfNextSample[edge] > epoch)
+                continue;
+
+            // attraction
+            const uint32_t j = _columns[edge];
+            float dx = xi - _previousEmbedding[2 * j];
+            float dy = yi - _previousEmbedding[2 * j + 1];
+            float distSq = dx * dx + dy * dy;
+
+            if (distSq > 0)
+            {
+                const float gradCoeff = -2.f * _a * _b * std::pow(distSq, _b - 1.f) / (_a * std::pow(distSq, _b) + 1.f);
+                xi += alpha * clip(gradCoeff * dx, _gradientClip);
+                yi += alpha * clip(gradCoeff * dy, _gradientClip);
+            }
+
+            _epochOfNextSample[edge] += _epochsPerSample[edge];
+
+            // repulsion from random points
+            const float epochsPerNegativeSample = _epochsPerSample[edge] / _negativeSampleRate;
+            const auto numNegativeSamples = static_cast<uint32_t>(std::max((epoch - _epochOfNextNegativeSample[edge]) / epochsPerNegativeSample, 0.f));
+
+            for (uint32_t sample = 0; sample < numNegativeSamples; sample++)
+            {
+                randomState = mix(randomState);
+                const auto k = static_cast<int64_t>(randomState % static_cast<uint64_t>(numPoints));
+                if (k == i)
+                    continue;
+
+                dx = xi - _previousEmbedding[2 * k];
+                dy = yi - _previousEmbedding[2 * k + 1];
+                distSq = dx * dx + dy * dy;
+
+                const float gradCoeff = distSq > 0 ? 2.f * _b / ((0.001f + distSq) * (_a * std::pow(distSq, _b) + 1.f)) : 0.f;
+                xi += alpha * (gradCoeff > 0 ? clip(gradCoeff * dx, _gradientClip) : _gradientClip);
+                yi += alpha * (gradCoeff > 0 ? clip(gradCoeff * dy, _gradientClip) : _gradientClip);
+            }
+
+            _epochOfNextNegativeSample[edge] += numNegativeSamples * epochsPerNegativeSample;
+        }
+
+        _embedding[2 * i] = xi;
+        _embedding[2 * i + 1] = yi;
+    }
+
+    _epoch++;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <sph/EmbedUmap.hpp>
+#include <sph/utils/CommonDefinitions.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+/// ////////////////// ///
+/// CpuUmapComputation ///
+/// ////////////////// ///
+
+/**
+ * Multithreaded UMAP layout optimization with resumable state, mirrors the interface of sph::UmapComputation.
+ * Each epoch moves all points in parallel, a point only moves itself and reads all others from the positions of the previous epoch.
+ * The negative samples are drawn from a counter based random generator seeded by epoch and point, such that
+ * the state between epochs consists of the positions, the epoch and the sampling schedule of the edges only.
+ */
+class CpuUmapComputation
+{
+public:
+    /** The edges are prepared once per matrix, restarts re-use them */
+    void setNeighborMatrix(const sph::SparseMatHDI* neighborMatrix);
+    void setParams(const sph::UmapEmbeddingParameters& params) { _params = params; }
+    void setInitialEmbedding(const std::vector<float>& embedding) { _embedding = embedding; }
+
+    /** Resets the optimizer state and runs epochs, the learning rate decays over params.numEpochs */
+    void compute(uint32_t epochs);
+    void continueGradientDescent(uint32_t epochs);
+
+    /** Adds epochs to the learning rate schedule, e.g. before continuing a finished computation */
+    void extendSchedule(uint32_t epochs) { _numEpochs += epochs; }
+
+    void stop() { _shouldStop = true; }
+    void resetStop() { _shouldStop = false; }
+
+public: // Getter
+    const std::vector<float>& getEmbedding() const { return _embedding; }
+    uint32_t getEpoch() const { return _epoch; }
+
+private:
+    void prepareEdges();
+    void runEpoch();
+
+private:
+    // Curve parameters for min_dist = 0.1 and spread = 1 as in umap-learn
+    static constexpr float          _a = 1.577f;
+    static constexpr float          _b = 0.8951f;
+    static constexpr float          _learningRate = 1.f;
+    static constexpr float          _negativeSampleRate = 5.f;
+    static constexpr float          _gradientClip = 4.f;
+    static constexpr uint64_t       _seed = 0x5EED'0F'5A'4Dull;
+
+    const sph::SparseMatHDI*        _neighborMatrix = nullptr;
+    sph::UmapEmbeddingParameters    _params = {};
+
+    // Edges in CSR layout of the neighbor matrix
+    std::vector<uint64_t>           _rowOffsets = {};
+    std::vector<uint32_t>           _columns = {};
+    std::vector<float>              _epochsPerSample = {};
+
+    // Optimizer state
+    std::vector<float>              _embedding = {};
+    std::vector<float>              _epochOfNextSample = {};
+    std::vector<float>              _epochOfNextNegativeSample = {};
+    uint32_t                        _epoch = 0;
+    std::atomic<uint32_t>           _numEpochs = 0;         /** Length of the learning rate schedule */
+
+    // Buffers
+    std::vector<float>              _previousEmbedding = {};
+
+    std::atomic<bool>               _shouldStop = false;
+};
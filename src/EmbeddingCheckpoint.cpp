@@ -0,0 +1,176 @@
+#include "EmbeddingCheckpoint.h"
+
+#include <sph/utils/Logger.hpp>
+
+#include <hdi/data/map_mem_eff.h>
+
+#include <algorithm>
+#include <fstream>
+#include <system_error>
+#include <vector>
+
+using namespace sph;
+
+namespace {
+    // FNV-1a
+    class KeyHasher
+    {
+    public:
+        template<typename T>
+        void add(const T& value)
+        {
+            const auto* bytes = reinterpret_cast<const unsigned char*>(&value);
+            for (size_t b = 0; b < sizeof(T); b++)
+                _hash = (_hash ^ bytes[b]) * 0x100000001B3ull;
+        }
+
+        void add(const std::string& value)
+        {
+            for (const char c : value)
+                add(c);
+        }
+
+        uint64_t value() const { return _hash; }
+
+    private:
+        uint64_t _hash = 0xCBF29CE484222325ull;
+    };
+
+    template<typename T>
+    void write(std::ofstream& file, const T& value)
+    {
+        file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template<typename T>
+    bool read(std::ifstream& file, T& value)
+    {
+        return static_cast<bool>(file.read(reinterpret_cast<char*>(&value), sizeof(T)));
+    }
+
+    void writeValues(std::ofstream& file, const std::vector<float>& values)
+    {
+        file.write(reinterpret_cast<const char*>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(float)));
+    }
+
+    bool readValues(std::ifstream& file, std::vector<float>& values, uint64_t numValues)
+    {
+        values.resize(numValues);
+        return static_cast<bool>(file.read(reinterpret_cast<char*>(values.data()), static_cast<std::streamsize>(numValues * sizeof(float))));
+    }
+}
+
+uint64_t EmbeddingCheckpoint::computeKey(const std::string& dataName, int64_t level, const SparseMatHDI& probDist, TsneEngine engine, const TsneEmbeddingParameters& params)
+{
+    const auto& gradDescentParams = params.gradDescentParams;
+
+    KeyHasher hasher;
+    hasher.add(dataName);
+    hasher.add(level);
+    hasher.add(static_cast<uint64_t>(probDist.size()));
+
+    // the sizes of the rows stay the same for different hierarchy settings on the data level, their entries do not
+    for (const auto& row : probDist)
+        hasher.add(static_cast<uint32_t>(row.size()));
+
+    const size_t rowStep = std::max<size_t>(probDist.size() / _numHashedRows, 1);
+    for (size_t row = 0; row < probDist.size(); row += rowStep)
+    {
+        for (const auto& [col, value] : probDist[row])
+        {
+            hasher.add(col);
+            hasher.add(value);
+        }
+    }
+
+    hasher.add(engine);
+    hasher.add(gradDescentParams._exaggeration_factor);
+    hasher.add(gradDescentParams._remove_exaggeration_iter);
+    hasher.add(gradDescentParams._mom_switching_iter);
+    hasher.add(gradDescentParams._exponential_decay_iter);
+
+    return hasher.value();
+}
+
+std::filesystem::path EmbeddingCheckpoint::getPath(const std::filesystem::path& cacheDirectory, int64_t level)
+{
+    return cacheDirectory / ("embedding-checkpoint-level-" + std::to_string(level) + ".cache");
+}
+
+bool EmbeddingCheckpoint::save(const std::filesystem::path& path, uint64_t key, const CpuTsneState& state)
+{
+    std::error_code errorCode;
+    std::filesystem::create_directories(path.parent_path(), errorCode);
+
+    std::filesystem::path tmpPath = path;
+    tmpPath += ".tmp";
+
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!file)
+        {
+            Log::warn("EmbeddingCheckpoint::save: cannot write " + tmpPath.string());
+            return false;
+        }
+
+        write(file, _magic);
+        write(file, _version);
+        write(file, key);
+        write(file, state.iteration);
+        write(file, state.exaggerationFactor);
+        write(file, state.learningRate);
+        write(file, static_cast<uint64_t>(state.embedding.size()));
+        writeValues(file, state.embedding);
+        writeValues(file, state.gains);
+        writeValues(file, state.updates);
+
+        if (!file)
+        {
+            Log::warn("EmbeddingCheckpoint::save: writing " + tmpPath.string() + " failed");
+            return false;
+        }
+    }
+
+    std::filesystem::rename(tmpPath, path, errorCode);
+    if (errorCode)
+    {
+        Log::warn("EmbeddingCheckpoint::save: cannot replace " + path.string() + ": " + errorCode.message());
+        return false;
+    }
+
+    Log::info("EmbeddingCheckpoint::save: iteration {0} to {1}", state.iteration, path.string());
+    return true;
+}
+
+std::optional<CpuTsneState> EmbeddingCheckpoint::load(const std::filesystem::path& path, uint64_t key, uint64_t numPoints)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return std::nullopt;
+
+    uint32_t magic = 0, version = 0;
+    uint64_t fileKey = 0, numValues = 0;
+    CpuTsneState state;
+
+    if (!read(file, magic) || !read(file, version) || magic != _magic || version != _version)
+    {
+        Log::warn("EmbeddingCheckpoint::load: " + path.string() + " is not a checkpoint of this version");
+        return std::nullopt;
+    }
+
+    // another level content or other parameters
+    if (!read(file, fileKey) || fileKey != key)
+        return std::nullopt;
+
+    if (!read(file, state.iteration) || !read(file, state.exaggerationFactor) || !read(file, state.learningRate) || !read(file, numValues) || numValues != numPoints * 2)
+        return std::nullopt;
+
+    if (!readValues(file, state.embedding, numValues) || !readValues(file, state.gains, numValues) || !readValues(file, state.updates, numValues))
+    {
+        Log::warn("EmbeddingCheckpoint::load: " + path.string() + " is truncated");
+        return std::nullopt;
+    }
+
+    Log::info("EmbeddingCheckpoint::load: resuming from iteration {0} of {1}", state.iteration, path.string());
+    return state;
+}
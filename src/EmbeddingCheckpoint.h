@@ -0,0 +1,40 @@
+#pragma once
+
+#include "CpuTsneComputation.h"
+
+#include <sph/EmbedTsne.hpp>
+#include <sph/utils/CommonDefinitions.hpp>
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+
+/// /////////////////// ///
+/// EmbeddingCheckpoint ///
+/// /////////////////// ///
+
+/**
+ * Saves and loads the gradient descent state of the CPU t-SNE engines, such that long embeddings survive a crash or closing the plugin.
+ * A checkpoint is only loaded for the same key, which identifies the data, level and gradient descent parameters.
+ */
+class EmbeddingCheckpoint
+{
+public:
+    /** Hashes everything that must match for resuming, not the total number of iterations. The matrix entries are hashed for a sample of rows */
+    static uint64_t computeKey(const std::string& dataName, int64_t level, const sph::SparseMatHDI& probDist, TsneEngine engine, const sph::TsneEmbeddingParameters& params);
+
+    /** Checkpoint file of a level in the cache directory */
+    static std::filesystem::path getPath(const std::filesystem::path& cacheDirectory, int64_t level);
+
+    /** Writes to a temporary file first such that an interrupted write does not leave a broken checkpoint */
+    static bool save(const std::filesystem::path& path, uint64_t key, const CpuTsneState& state);
+
+    /** State for numPoints points if the checkpoint exists and its key matches */
+    static std::optional<CpuTsneState> load(const std::filesystem::path& path, uint64_t key, uint64_t numPoints);
+
+private:
+    static constexpr uint32_t _magic = 0x53504843;      /** "SPHC" */
+    static constexpr uint32_t _version = 2;
+    static constexpr size_t   _numHashedRows = 1 << 16;
+};
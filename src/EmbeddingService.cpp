@@ -0,0 +1,182 @@
+#include "EmbeddingService.h"
+
+#include "ComputeEmbeddingWrapper.h"
+
+#include <sph/utils/Logger.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <utility>
+
+using namespace sph;
+
+/// ////////////////// ///
+/// EmbeddingJobHandle ///
+/// ////////////////// ///
+
+EmbeddingJobHandle::EmbeddingJobHandle(EmbeddingService* service, size_t slotID) :
+    _service(service),
+    _slotID(slotID)
+{
+}
+
+EmbeddingJobHandle::~EmbeddingJobHandle()
+{
+    reset();
+}
+
+EmbeddingJobHandle::EmbeddingJobHandle(EmbeddingJobHandle&& other) noexcept :
+    _service(std::exchange(other._service, nullptr)),
+    _slotID(other._slotID)
+{
+}
+
+EmbeddingJobHandle& EmbeddingJobHandle::operator=(EmbeddingJobHandle&& other) noexcept
+{
+    if (this != &other)
+    {
+        reset();
+        _service = std::exchange(other._service, nullptr);
+        _slotID = other._slotID;
+    }
+
+    return *this;
+}
+
+void EmbeddingJobHandle::reset()
+{
+    if (_service != nullptr)
+        _service->release(_slotID);
+
+    _service = nullptr;
+}
+
+QThread* EmbeddingJobHandle::getThread() const
+{
+    return isValid() ? _service->getThread(_slotID) : nullptr;
+}
+
+OffscreenBufferQt* EmbeddingJobHandle::getOffscreenBuffer() const
+{
+    return isValid() ? _service->getOffscreenBuffer(_slotID) : nullptr;
+}
+
+/// //////////////// ///
+/// EmbeddingService ///
+/// //////////////// ///
+
+EmbeddingService::EmbeddingService(QObject* parent) :
+    QObject(parent)
+{
+}
+
+EmbeddingService::~EmbeddingService()
+{
+    for (auto& slot : _slots)
+    {
+        slot->thread.quit();
+        slot->thread.wait();
+    }
+}
+
+size_t EmbeddingService::defaultPoolSize()
+{
+    return static_cast<size_t>(std::clamp(QThread::idealThreadCount() / 4, 1, 4));
+}
+
+void EmbeddingService::setPoolSize(size_t poolSize)
+{
+    _poolSize = std::max<size_t>(poolSize, 1);
+    Log::info("EmbeddingService::setPoolSize: {0} embedding threads", _poolSize);
+}
+
+void EmbeddingService::setPriorityWorker(EmbedWorker* worker)
+{
+    if (_priorityWorker == worker)
+        return;
+
+    if (_priorityWorker != nullptr)
+        _priorityWorker->setPriority(false);
+
+    _priorityWorker = worker;
+
+    if (_priorityWorker != nullptr)
+        _priorityWorker->setPriority(true);
+}
+
+void EmbeddingService::resetPriorityWorker(const EmbedWorker* worker)
+{
+    if (_priorityWorker == worker)
+        setPriorityWorker(nullptr);
+}
+
+size_t EmbeddingService::getNumJobs() const
+{
+    size_t numJobs = 0;
+    for (const auto& slot : _slots)
+        numJobs += slot->numJobs;
+    return numJobs;
+}
+
+EmbeddingJobHandle EmbeddingService::submit(EmbedWorker* worker)
+{
+    assert(worker != nullptr);
+
+    while (_slots.size() < _poolSize)
+        _slots.emplace_back(std::make_unique<PoolSlot>());
+
+    // least busy slot among the currently active pool
+    const auto poolEnd = _slots.begin() + static_cast<std::ptrdiff_t>(_poolSize);
+    const auto slotIt = std::min_element(_slots.begin(), poolEnd, [](const auto& a, const auto& b) { return a->numJobs < b->numJobs; });
+    const size_t slotID = static_cast<size_t>(std::distance(_slots.begin(), slotIt));
+
+    PoolSlot& slot = *_slots[slotID];
+
+    if (!slot.thread.isRunning())
+    {
+        slot.thread.setObjectName(QString("SPH embedding %1").arg(slotID));
+        slot.thread.start();
+    }
+
+    slot.numJobs++;
+    worker->moveToThread(&slot.thread);
+
+    Log::info("EmbeddingService::submit: worker {0} on embedding thread {1} ({2} jobs)", worker->getWorkerID(), slotID, slot.numJobs);
+
+    return EmbeddingJobHandle(this, slotID);
+}
+
+void EmbeddingService::release(size_t slotID)
+{
+    assert(slotID < _slots.size() && _slots[slotID]->numJobs > 0);
+    _slots[slotID]->numJobs--;
+}
+
+OffscreenBufferQt* EmbeddingService::getOffscreenBuffer(size_t slotID)
+{
+    PoolSlot& slot = *_slots[slotID];
+
+    if (slot.offscreenBuffer)
+        return slot.offscreenBuffer.get();
+
+    if (slot.offscreenBufferFailed || !OffscreenBufferQt::isAvailable())
+        return nullptr;
+
+    // Offscreen buffer must be created in the UI thread because it is a QWindow
+    slot.offscreenBuffer = std::make_unique<OffscreenBufferQt>();
+
+    // Create the context here and not lazily in the pool thread, where a failure could no longer fall back to the CPU
+    if (!slot.offscreenBuffer->createContext())
+    {
+        Log::warn("EmbeddingService::getOffscreenBuffer: no OpenGL context for embedding thread {0}", slotID);
+        slot.offscreenBuffer.reset();
+        slot.offscreenBufferFailed = true;
+        return nullptr;
+    }
+
+    slot.offscreenBuffer->releaseContext();
+    slot.offscreenBuffer->moveToThread(&slot.thread);
+    slot.offscreenBuffer->getContext()->moveToThread(&slot.thread);
+
+    return slot.offscreenBuffer.get();
+}
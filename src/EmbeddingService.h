@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include <QObject>
+#include <QThread>
+
+class EmbedWorker;
+class EmbeddingService;
+class OffscreenBufferQt;
+
+/// ////////////////// ///
+/// EmbeddingJobHandle ///
+/// ////////////////// ///
+
+/** Reserves a pool thread of the EmbeddingService for one embedding worker, releases it on destruction */
+class EmbeddingJobHandle
+{
+public:
+    EmbeddingJobHandle() = default;
+    EmbeddingJobHandle(EmbeddingService* service, size_t slotID);
+    ~EmbeddingJobHandle();
+
+    EmbeddingJobHandle(const EmbeddingJobHandle&) = delete;
+    EmbeddingJobHandle& operator=(const EmbeddingJobHandle&) = delete;
+    EmbeddingJobHandle(EmbeddingJobHandle&& other) noexcept;
+    EmbeddingJobHandle& operator=(EmbeddingJobHandle&& other) noexcept;
+
+    void reset();
+
+public: // Getter
+    bool isValid() const { return _service != nullptr; }
+    size_t getSlotID() const { return _slotID; }
+    QThread* getThread() const;
+
+    /** Offscreen buffer of the pool thread, created on first use. Returns nullptr if no OpenGL context is available */
+    OffscreenBufferQt* getOffscreenBuffer() const;
+
+private:
+    EmbeddingService*   _service = nullptr;
+    size_t              _slotID = 0;
+};
+
+/// //////////////// ///
+/// EmbeddingService ///
+/// //////////////// ///
+
+/** Plugin-wide pool of worker threads (each with one offscreen GL context) on which all embedding workers run */
+class EmbeddingService : public QObject
+{
+    Q_OBJECT
+public:
+    EmbeddingService(QObject* parent = nullptr);
+    ~EmbeddingService() override;
+
+    /** Moves the worker to the least busy pool thread, the returned handle keeps that thread reserved */
+    EmbeddingJobHandle submit(EmbedWorker* worker);
+
+public: // Setter
+    /** Only affects jobs that are submitted afterwards, running jobs stay on their thread */
+    void setPoolSize(size_t poolSize);
+
+    /** The prioritized worker (e.g. the embedding the user currently looks at) computes longer slices than all others */
+    void setPriorityWorker(EmbedWorker* worker);
+
+    /** Removes the priority if worker has it */
+    void resetPriorityWorker(const EmbedWorker* worker);
+
+public: // Getter
+    size_t getPoolSize() const { return _poolSize; }
+    size_t getNumJobs() const;
+
+    static size_t defaultPoolSize();
+
+private:
+    friend class EmbeddingJobHandle;
+
+    struct PoolSlot
+    {
+        QThread                             thread = QThread{};
+        std::unique_ptr<OffscreenBufferQt>  offscreenBuffer = nullptr;  /** only created for GPU gradient descent */
+        bool                                offscreenBufferFailed = false;  /** the context could not be created, use the CPU */
+        size_t                              numJobs = 0;
+    };
+
+    void release(size_t slotID);
+    QThread* getThread(size_t slotID) { return &_slots[slotID]->thread; }
+    OffscreenBufferQt* getOffscreenBuffer(size_t slotID);
+
+private:
+    std::vector<std::unique_ptr<PoolSlot>>  _slots = {};                    /** Grows to the largest pool size, threads are started on first use */
+    size_t                                  _poolSize = defaultPoolSize();
+    EmbedWorker*                            _priorityWorker = nullptr;
+};
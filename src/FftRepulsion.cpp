@@ -0,0 +1,381 @@
+#include "FftRepulsion.h"
+
+#include <sph/utils/CommonDefinitions.hpp>
+#include <sph/utils/Logger.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <numbers>
+
+using namespace sph;
+
+namespace {
+    // without the NaN handling of std::complex multiplication
+    inline std::complex<double> multiply(const std::complex<double>& a, const std::complex<double>& b)
+    {
+        return { a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real() };
+    }
+}
+
+FftRepulsion::FftRepulsion(uint32_t minNumBoxes) :
+    _minNumBoxes(std::max(minNumBoxes, 1u))
+{
+}
+
+size_t FftRepulsion::getFftSize(size_t minSize)
+{
+    const size_t powerOfTwo = std::bit_ceil(minSize);
+    const size_t threeTimesPowerOfTwo = 3 * std::bit_ceil((minSize + 2) / 3);
+    return std::min(powerOfTwo, threeTimesPowerOfTwo);
+}
+
+void FftRepulsion::prepareFft(size_t fftSize)
+{
+    if (fftSize == _fftSize)
+        return;
+
+    _fftSize = fftSize;
+    _powerOfTwoSize = fftSize % 3 == 0 ? fftSize / 3 : fftSize;
+
+    assert(std::has_single_bit(_powerOfTwoSize));
+
+    _twiddles.resize(fftSize);
+    for (size_t k = 0; k < fftSize; k++)
+        _twiddles[k] = std::polar(1.0, -2.0 * std::numbers::pi * static_cast<double>(k) / static_cast<double>(fftSize));
+
+    const auto numBits = static_cast<uint32_t>(std::countr_zero(_powerOfTwoSize));
+    _bitReversal.resize(_powerOfTwoSize);
+    for (size_t i = 0; i < _powerOfTwoSize; i++)
+    {
+        uint32_t reversed = 0;
+        for (uint32_t bit = 0; bit < numBits; bit++)
+            if (i & (size_t{ 1 } << bit))
+                reversed |= 1u << (numBits - 1 - bit);
+        _bitReversal[i] = reversed;
+    }
+
+    const size_t gridSize = fftSize * fftSize;
+    _kernels.resize(gridSize);
+    _chargesOne.resize(gridSize);
+    _chargesXY.resize(gridSize);
+
+    // kernels have to be transformed again for the new size
+    _numBoxes = 0;
+}
+
+void FftRepulsion::fftPowerOfTwo(std::complex<double>* values, bool inverse) const
+{
+    const size_t n = _powerOfTwoSize;
+
+    for (size_t i = 0; i < n; i++)
+        if (i < _bitReversal[i])
+            std::swap(values[i], values[_bitReversal[i]]);
+
+    for (size_t length = 2; length <= n; length <<= 1)
+    {
+        const size_t half = length / 2;
+        const size_t twiddleStep = _fftSize / length;
+
+        for (size_t start = 0; start < n; start += length)
+        {
+            for (size_t k = 0; k < half; k++)
+            {
+                const std::complex<double> twiddle = inverse ? std::conj(_twiddles[k * twiddleStep]) : _twiddles[k * twiddleStep];
+                const std::complex<double> even = values[start + k];
+                const std::complex<double> odd = multiply(twiddle, values[start + k + half]);
+                values[start + k] = even + odd;
+                values[start + k + half] = even - odd;
+            }
+        }
+    }
+}
+
+void FftRepulsion::fft1D(std::complex<double>* values, std::complex<double>* scratch, bool inverse) const
+{
+    if (_powerOfTwoSize == _fftSize)
+    {
+        fftPowerOfTwo(values, inverse);
+        return;
+    }
+
+    // one radix 3 step: transform the three interleaved sub sequences and combine them
+    const size_t n = _fftSize;
+    const size_t m = _powerOfTwoSize;
+
+    for (size_t j = 0; j < m; j++)
+        for (size_t s = 0; s < 3; s++)
+            scratch[s * m + j] = values[3 * j + s];
+
+    for (size_t s = 0; s < 3; s++)
+        fftPowerOfTwo(scratch + s * m, inverse);
+
+    for (size_t k = 0; k < n; k++)
+    {
+        const size_t j = k < m ? k : (k < 2 * m ? k - m : k - 2 * m);
+        const size_t k2 = 2 * k < n ? 2 * k : 2 * k - n;
+        const std::complex<double> twiddle1 = inverse ? std::conj(_twiddles[k]) : _twiddles[k];
+        const std::complex<double> twiddle2 = inverse ? std::conj(_twiddles[k2]) : _twiddles[k2];
+        values[k] = scratch[j] + multiply(twiddle1, scratch[m + j]) + multiply(twiddle2, scratch[2 * m + j]);
+    }
+}
+
+void FftRepulsion::fft2D(Grid& grid, bool inverse) const
+{
+    const int64_t n = static_cast<int64_t>(_fftSize);
+
+    SPH_PARALLEL
+    for (int64_t row = 0; row < n; row++)
+    {
+        std::vector<std::complex<double>> scratch(n);
+        fft1D(grid.data() + row * n, scratch.data(), inverse);
+    }
+
+    // columns are copied to be contiguous, in blocks such that the grid is read row by row
+    constexpr int64_t blockSize = 8;
+    const int64_t numBlocks = (n + blockSize - 1) / blockSize;
+
+    SPH_PARALLEL
+    for (int64_t block = 0; block < numBlocks; block++)
+    {
+        const int64_t firstCol = block * blockSize;
+        const int64_t numCols = std::min(blockSize, n - firstCol);
+
+        std::vector<std::complex<double>> columns(numCols * n), scratch(n);
+        for (int64_t row = 0; row < n; row++)
+            for (int64_t col = 0; col < numCols; col++)
+                columns[col * n + row] = grid[row * n + firstCol + col];
+
+        for (int64_t col = 0; col < numCols; col++)
+            fft1D(columns.data() + col * n, scratch.data(), inverse);
+
+        for (int64_t row = 0; row < n; row++)
+            for (int64_t col = 0; col < numCols; col++)
+                grid[row * n + firstCol + col] = columns[col * n + row];
+    }
+}
+
+void FftRepulsion::updateKernels(uint32_t numNodes, float nodeSpacing)
+{
+    const int64_t fftSize = static_cast<int64_t>(_fftSize);
+
+    // Kernels as circulant embedding: node offsets in [-(numNodes - 1), numNodes - 1]
+    SPH_PARALLEL
+    for (int64_t row = 0; row < fftSize; row++)
+    {
+        const int64_t offsetRow = row < numNodes ? row : (row > fftSize - numNodes ? row - fftSize : std::numeric_limits<int64_t>::max());
+
+        for (int64_t col = 0; col < fftSize; col++)
+        {
+            const int64_t offsetCol = col < numNodes ? col : (col > fftSize - numNodes ? col - fftSize : std::numeric_limits<int64_t>::max());
+
+            double w = 0;
+            if (offsetRow != std::numeric_limits<int64_t>::max() && offsetCol != std::numeric_limits<int64_t>::max())
+            {
+                const double dy = offsetRow * static_cast<double>(nodeSpacing);
+                const double dx = offsetCol * static_cast<double>(nodeSpacing);
+                w = 1.0 / (1.0 + dx * dx + dy * dy);
+            }
+
+            _kernels[row * fftSize + col] = { w, w * w };
+        }
+    }
+
+    fft2D(_kernels, false);
+}
+
+double FftRepulsion::compute(const std::vector<float>& positions, std::vector<float>& forces)
+{
+    const size_t numPoints = positions.size() / 2;
+    forces.resize(positions.size());
+
+    if (numPoints == 0)
+        return 0;
+
+    float minX = std::numeric_limits<float>::max(), minY = std::numeric_limits<float>::max();
+    float maxX = std::numeric_limits<float>::lowest(), maxY = std::numeric_limits<float>::lowest();
+    for (size_t i = 0; i < numPoints; i++)
+    {
+        minX = std::min(minX, positions[2 * i]);
+        maxX = std::max(maxX, positions[2 * i]);
+        minY = std::min(minY, positions[2 * i + 1]);
+        maxY = std::max(maxY, positions[2 * i + 1]);
+    }
+
+    const float range = std::max({ maxX - minX, maxY - minY, 1e-3f });
+
+    // At most one embedding unit per box as in FIt-SNE, the FFT size covers the zero padded grid.
+    // The kernels only depend on the number of boxes and their width, they are kept while the embedding fits into the grid and fills at least half of it
+    const float gridWidth = static_cast<float>(_numBoxes) * _boxWidth;
+    const bool updateGrid = _numBoxes == 0 || range > gridWidth || 2.f * _gridSlack * range < gridWidth;
+    if (updateGrid)
+    {
+        const float paddedRange = _gridSlack * range;
+        const auto requestedNumBoxes = std::max(static_cast<uint32_t>(std::ceil(paddedRange)), _minNumBoxes);
+        prepareFft(getFftSize(size_t{ 2 } * _numInterpolationNodes * requestedNumBoxes));
+
+        _numBoxes = static_cast<uint32_t>(_fftSize / (2 * _numInterpolationNodes));
+        _boxWidth = paddedRange / static_cast<float>(_numBoxes);
+
+        updateKernels(_numBoxes * _numInterpolationNodes, _boxWidth / _numInterpolationNodes);
+    }
+
+    const uint32_t numBoxes = _numBoxes;
+    const float nodeSpacing = _boxWidth / _numInterpolationNodes;
+    const int64_t fftSize = static_cast<int64_t>(_fftSize);
+
+    // Lagrange weights of the three equispaced nodes (at 0.5, 1.5, 2.5 node spacings) of each point's box
+    _baseNodes.resize(numPoints * 2);
+    _weights.resize(numPoints * 6);
+
+    const float mins[2] = { minX, minY };
+
+    SPH_PARALLEL
+    for (int64_t i = 0; i < static_cast<int64_t>(numPoints); i++)
+    {
+        for (size_t dim = 0; dim < 2; dim++)
+        {
+            const float u = (positions[2 * i + dim] - mins[dim]) / nodeSpacing;
+            const uint32_t box = std::min(static_cast<uint32_t>(u / _numInterpolationNodes), numBoxes - 1);
+            const float t = u - static_cast<float>(box * _numInterpolationNodes);
+
+            _baseNodes[2 * i + dim] = box * _numInterpolationNodes;
+            _weights[6 * i + 3 * dim + 0] = 0.5f * (t - 1.5f) * (t - 2.5f);
+            _weights[6 * i + 3 * dim + 1] = -(t - 0.5f) * (t - 2.5f);
+            _weights[6 * i + 3 * dim + 2] = 0.5f * (t - 0.5f) * (t - 1.5f);
+        }
+    }
+
+    // counting sort by box row
+    _boxRowOffsets.assign(numBoxes + 1, 0);
+    for (size_t i = 0; i < numPoints; i++)
+        _boxRowOffsets[_baseNodes[2 * i + 1] / _numInterpolationNodes + 1]++;
+    for (uint32_t box = 0; box < numBoxes; box++)
+        _boxRowOffsets[box + 1] += _boxRowOffsets[box];
+
+    _pointsByBoxRow.resize(numPoints);
+    {
+        std::vector<uint32_t> fill(_boxRowOffsets.begin(), _boxRowOffsets.end() - 1);
+        for (size_t i = 0; i < numPoints; i++)
+            _pointsByBoxRow[fill[_baseNodes[2 * i + 1] / _numInterpolationNodes]++] = static_cast<uint32_t>(i);
+    }
+
+    // Spread the charges 1, x and y, box rows do not share nodes
+    std::fill(_chargesOne.begin(), _chargesOne.end(), std::complex<double>(0));
+    std::fill(_chargesXY.begin(), _chargesXY.end(), std::complex<double>(0));
+
+    SPH_PARALLEL
+    for (int64_t boxRow = 0; boxRow < static_cast<int64_t>(numBoxes); boxRow++)
+    {
+        for (uint32_t sorted = _boxRowOffsets[boxRow]; sorted < _boxRowOffsets[boxRow + 1]; sorted++)
+        {
+            const uint32_t i = _pointsByBoxRow[sorted];
+            const double x = positions[2 * i];
+            const double y = positions[2 * i + 1];
+
+            for (uint32_t ky = 0; ky < _numInterpolationNodes; ky++)
+            {
+                for (uint32_t kx = 0; kx < _numInterpolationNodes; kx++)
+                {
+                    const int64_t cell = (_baseNodes[2 * i + 1] + ky) * fftSize + _baseNodes[2 * i] + kx;
+                    const double weight = static_cast<double>(_weights[6 * i + 3 + ky]) * _weights[6 * i + kx];
+
+                    _chargesOne[cell] += weight;
+                    _chargesXY[cell] += std::complex<double>(weight * x, weight * y);
+                }
+            }
+        }
+    }
+
+    fft2D(_chargesOne, false);
+    fft2D(_chargesXY, false);
+
+    // convolutions of real charges with real kernels stay real, so two of them share a complex grid
+    const int64_t gridSize = fftSize * fftSize;
+    SPH_PARALLEL
+    for (int64_t cell = 0; cell < gridSize; cell++)
+    {
+        _chargesOne[cell] = multiply(_chargesOne[cell], _kernels[cell]);
+        _chargesXY[cell] *= _kernels[cell].imag();
+    }
+
+    fft2D(_chargesOne, true);
+    fft2D(_chargesXY, true);
+
+    // Interpolate the potentials back to the points
+    const double inverseFftScale = 1.0 / static_cast<double>(gridSize);
+    _kernelSums.resize(numPoints);
+
+    SPH_PARALLEL
+    for (int64_t i = 0; i < static_cast<int64_t>(numPoints); i++)
+    {
+        double phi[4] = { 0, 0, 0, 0 };
+
+        for (uint32_t ky = 0; ky < _numInterpolationNodes; ky++)
+        {
+            for (uint32_t kx = 0; kx < _numInterpolationNodes; kx++)
+            {
+                const int64_t cell = (_baseNodes[2 * i + 1] + ky) * fftSize + _baseNodes[2 * i] + kx;
+                const double weight = static_cast<double>(_weights[6 * i + 3 + ky]) * _weights[6 * i + kx];
+
+                phi[0] += weight * _chargesOne[cell].real();
+                phi[1] += weight * _chargesOne[cell].imag();
+                phi[2] += weight * _chargesXY[cell].real();
+                phi[3] += weight * _chargesXY[cell].imag();
+            }
+        }
+
+        for (double& value : phi)
+            value *= inverseFftScale;
+
+        // the sums include the point itself with w_ii = 1, which cancels in the forces
+        _kernelSums[i] = phi[0] - 1.0;
+        forces[2 * i] = static_cast<float>(positions[2 * i] * phi[1] - phi[2]);
+        forces[2 * i + 1] = static_cast<float>(positions[2 * i + 1] * phi[1] - phi[3]);
+    }
+
+    double normalization = 0;
+    for (const double kernelSum : _kernelSums)
+        normalization += kernelSum;
+
+#ifndef NDEBUG
+    if (updateGrid)
+        checkAgainstExact(positions, forces);
+#endif
+
+    return normalization;
+}
+
+#ifndef NDEBUG
+void FftRepulsion::checkAgainstExact(const std::vector<float>& positions, const std::vector<float>& forces) const
+{
+    const size_t numPoints = positions.size() / 2;
+    const size_t numSamples = std::min<size_t>(numPoints, 64);
+    const size_t sampleStep = numPoints / numSamples;
+
+    double errorSq = 0, normSq = 0;
+    for (size_t sample = 0; sample < numSamples; sample++)
+    {
+        const size_t i = sample * sampleStep;
+
+        double forceX = 0, forceY = 0;
+        for (size_t j = 0; j < numPoints; j++)
+        {
+            const double dx = positions[2 * i] - positions[2 * j];
+            const double dy = positions[2 * i + 1] - positions[2 * j + 1];
+            const double w = 1.0 / (1.0 + dx * dx + dy * dy);
+            forceX += w * w * dx;
+            forceY += w * w * dy;
+        }
+
+        errorSq += (forces[2 * i] - forceX) * (forces[2 * i] - forceX) + (forces[2 * i + 1] - forceY) * (forces[2 * i + 1] - forceY);
+        normSq += forceX * forceX + forceY * forceY;
+    }
+
+    const double relativeError = normSq > 0 ? std::sqrt(errorSq / normSq) : 0;
+    if (relativeError > 0.05)
+        Log::warn("FftRepulsion: relative force error {0} with {1} boxes of width {2}", relativeError, _numBoxes, _boxWidth);
+}
+#endif
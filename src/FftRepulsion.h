@@ -0,0 +1,71 @@
+#pragma once
+
+#include "CpuTsneComputation.h"
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// //////////// ///
+/// FftRepulsion ///
+/// //////////// ///
+
+/**
+ * Interpolation based t-SNE repulsion (as in FIt-SNE, Linderman et al. 2019):
+ * charges are spread to an equispaced grid with Lagrange polynomials, the kernel sums on the grid are convolutions computed with FFTs,
+ * and the grid potentials are interpolated back to the points. Linear in the number of points.
+ * Boxes are at most one embedding unit wide, such that the grid and the FFT size grow with the range of the embedding.
+ */
+class FftRepulsion : public TsneRepulsion
+{
+public:
+    FftRepulsion(uint32_t minNumBoxes = 40);
+
+    double compute(const std::vector<float>& positions, std::vector<float>& forces) override;
+
+private:
+    using Grid = std::vector<std::complex<double>>;
+
+    static constexpr uint32_t _numInterpolationNodes = 3;   /** per box and dimension */
+    static constexpr float    _gridSlack = 1.05f;           /** The grid is wider than the embedding such that the kernels are re-used while the embedding grows */
+
+    /** Smallest FFT size of the form 2^k or 3 * 2^k that is at least minSize */
+    static size_t getFftSize(size_t minSize);
+
+    /** In-place 2D FFT of a square grid with a side length of 2^k or 3 * 2^k */
+    void fft2D(Grid& grid, bool inverse) const;
+    void fft1D(std::complex<double>* values, std::complex<double>* scratch, bool inverse) const;
+    void fftPowerOfTwo(std::complex<double>* values, bool inverse) const;
+    void prepareFft(size_t fftSize);
+
+    /** Transforms of the kernels on the node offsets, only depend on the number of nodes and their spacing */
+    void updateKernels(uint32_t numNodes, float nodeSpacing);
+
+#ifndef NDEBUG
+    /** Compares the forces of a sample of points with the exact sums, warns if the interpolation is off */
+    void checkAgainstExact(const std::vector<float>& positions, const std::vector<float>& forces) const;
+#endif
+
+private:
+    uint32_t                                _minNumBoxes = 40;
+
+    size_t                                  _fftSize = 0;
+    size_t                                  _powerOfTwoSize = 0;    /** _fftSize or _fftSize / 3 */
+    std::vector<std::complex<double>>       _twiddles = {};         /** exp(-2 pi i k / _fftSize) */
+    std::vector<uint32_t>                   _bitReversal = {};      /** for _powerOfTwoSize */
+
+    // Grid of the current kernels
+    uint32_t                                _numBoxes = 0;
+    float                                   _boxWidth = 0;
+
+    // Buffers, kept between iterations
+    std::vector<uint32_t>                   _baseNodes = {};        /** First interpolation node per point and dimension */
+    std::vector<float>                      _weights = {};          /** Lagrange weights per point, dimension and node */
+    std::vector<uint32_t>                   _boxRowOffsets = {};    /** Points sorted by their box row, boxes do not share nodes such that rows are spread in parallel */
+    std::vector<uint32_t>                   _pointsByBoxRow = {};
+    std::vector<double>                     _kernelSums = {};       /** sum_j w_ij per point */
+    Grid                                    _kernels = {};          /** FFT of w + i w^2, both kernels are real and even such that their transforms are the real and imaginary parts */
+    Grid                                    _chargesOne = {};       /** Spread charges 1, in place of the potentials w * 1 + i w^2 * 1 */
+    Grid                                    _chargesXY = {};        /** Spread charges x + i y, in place of the potentials w^2 * x + i w^2 * y */
+};
@@ -0,0 +1,257 @@
+#include "HierarchyRepulsion.h"
+
+#include <sph/utils/CommonDefinitions.hpp>
+#include <sph/utils/Logger.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <numeric>
+#include <utility>
+
+using namespace sph;
+
+HierarchyRepulsion::HierarchyRepulsion(const utils::Hierarchy& hierarchy, int64_t level, float theta) :
+    HierarchyRepulsion(hierarchy, level, [&hierarchy, level]() {
+        std::vector<uint64_t> levelIDs(hierarchy.mapFromLevelToPixel[level].size());
+        std::iota(levelIDs.begin(), levelIDs.end(), uint64_t{ 0 });
+        return levelIDs;
+        }(), theta)
+{
+}
+
+HierarchyRepulsion::HierarchyRepulsion(const utils::Hierarchy& hierarchy, int64_t level, const std::vector<uint64_t>& levelIDs, float theta) :
+    HierarchyRepulsion(hierarchy.mapFromLevelToPixel, hierarchy.mapFromPixelToLevel(), level, levelIDs, theta)
+{
+}
+
+HierarchyRepulsion::HierarchyRepulsion(const std::vector<vvui64>& mappingLevelToData, const std::vector<vui64>& mappingDataToLevel, int64_t level, const std::vector<uint64_t>& levelIDs, float theta) :
+    _numPoints(levelIDs.size())
+{
+    const auto numLevels = static_cast<int64_t>(mappingLevelToData.size());
+    assert(level + 1 < numLevels && mappingDataToLevel.size() == mappingLevelToData.size());
+
+    // a point is never approximated by its own ancestors as long as theta < 1
+    theta = std::clamp(theta, 0.f, 0.9f);
+    _thetaSq = theta * theta;
+
+    // Superpixel IDs of the current tree nodes on their level, starting with the embedded points
+    std::vector<uint64_t> nodeIDs = levelIDs;
+
+    for (int64_t aggregateLevel = level + 1; aggregateLevel < numLevels; aggregateLevel++)
+    {
+        const auto& mappingChildToData = mappingLevelToData[aggregateLevel - 1];
+        const auto& mappingDataToParent = mappingDataToLevel[aggregateLevel];
+        const int64_t numChildren = static_cast<int64_t>(nodeIDs.size());
+
+        // superpixels are nested, any pixel of a superpixel identifies its parent
+        std::vector<uint64_t> parents(numChildren);
+        SPH_PARALLEL
+        for (int64_t child = 0; child < numChildren; child++)
+            parents[child] = mappingDataToParent[mappingChildToData[nodeIDs[child]].front()];
+
+        std::vector<uint64_t> parentIDs = parents;
+        std::sort(parentIDs.begin(), parentIDs.end());
+        parentIDs.erase(std::unique(parentIDs.begin(), parentIDs.end()), parentIDs.end());
+
+        // compact parent indices, children are grouped by them
+        std::vector<uint32_t> parentIndices(numChildren);
+        SPH_PARALLEL
+        for (int64_t child = 0; child < numChildren; child++)
+            parentIndices[child] = static_cast<uint32_t>(std::lower_bound(parentIDs.begin(), parentIDs.end(), parents[child]) - parentIDs.begin());
+
+        AggregateLevel& aggregates = _aggregateLevels.emplace_back();
+        const size_t numAggregates = parentIDs.size();
+
+        aggregates.childOffsets.assign(numAggregates + 1, 0);
+        for (const uint32_t parentIndex : parentIndices)
+            aggregates.childOffsets[parentIndex + 1]++;
+        for (size_t aggregate = 0; aggregate < numAggregates; aggregate++)
+            aggregates.childOffsets[aggregate + 1] += aggregates.childOffsets[aggregate];
+
+        aggregates.children.resize(numChildren);
+        std::vector<uint32_t> fill(aggregates.childOffsets.begin(), aggregates.childOffsets.end() - 1);
+        for (int64_t child = 0; child < numChildren; child++)
+            aggregates.children[fill[parentIndices[child]]++] = static_cast<uint32_t>(child);
+
+        aggregates.count.resize(numAggregates);
+        aggregates.centerX.resize(numAggregates);
+        aggregates.centerY.resize(numAggregates);
+        aggregates.radius.resize(numAggregates);
+
+        nodeIDs = std::move(parentIDs);
+
+        if (nodeIDs.size() <= _maxTopAggregates)
+            break;
+    }
+
+    // counts do not change during the gradient descent
+    for (size_t levelIndex = 0; levelIndex < _aggregateLevels.size(); levelIndex++)
+    {
+        AggregateLevel& aggregates = _aggregateLevels[levelIndex];
+        const AggregateLevel* childLevel = levelIndex == 0 ? nullptr : &_aggregateLevels[levelIndex - 1];
+
+        SPH_PARALLEL
+        for (int64_t aggregate = 0; aggregate < static_cast<int64_t>(aggregates.numAggregates()); aggregate++)
+        {
+            uint32_t count = 0;
+            for (uint32_t c = aggregates.childOffsets[aggregate]; c < aggregates.childOffsets[aggregate + 1]; c++)
+            {
+                const uint32_t child = aggregates.children[c];
+                count += childLevel ? childLevel->count[child] : 1;
+            }
+
+            aggregates.count[aggregate] = count;
+        }
+    }
+
+    Log::info("HierarchyRepulsion: {0} points on level {1}, {2} aggregate levels with {3} top aggregates", levelIDs.size(), level, _aggregateLevels.size(), nodeIDs.size());
+}
+
+void HierarchyRepulsion::updateAggregates(const std::vector<float>& positions)
+{
+    for (size_t levelIndex = 0; levelIndex < _aggregateLevels.size(); levelIndex++)
+    {
+        AggregateLevel& aggregates = _aggregateLevels[levelIndex];
+        const AggregateLevel* childLevel = levelIndex == 0 ? nullptr : &_aggregateLevels[levelIndex - 1];
+
+        SPH_PARALLEL
+        for (int64_t aggregate = 0; aggregate < static_cast<int64_t>(aggregates.numAggregates()); aggregate++)
+        {
+            const uint32_t first = aggregates.childOffsets[aggregate];
+            const uint32_t last = aggregates.childOffsets[aggregate + 1];
+
+            // centroid of the member points, child aggregates are weighted by their number of points
+            double x = 0, y = 0;
+            for (uint32_t c = first; c < last; c++)
+            {
+                const uint32_t child = aggregates.children[c];
+                if (childLevel)
+                {
+                    x += static_cast<double>(childLevel->count[child]) * childLevel->centerX[child];
+                    y += static_cast<double>(childLevel->count[child]) * childLevel->centerY[child];
+                }
+                else
+                {
+                    x += positions[2 * child];
+                    y += positions[2 * child + 1];
+                }
+            }
+
+            const auto centerX = static_cast<float>(x / aggregates.count[aggregate]);
+            const auto centerY = static_cast<float>(y / aggregates.count[aggregate]);
+
+            // covers all members
+            float radius = 0;
+            for (uint32_t c = first; c < last; c++)
+            {
+                const uint32_t child = aggregates.children[c];
+                if (childLevel)
+                    radius = std::max(radius, std::hypot(childLevel->centerX[child] - centerX, childLevel->centerY[child] - centerY) + childLevel->radius[child]);
+                else
+                    radius = std::max(radius, std::hypot(positions[2 * child] - centerX, positions[2 * child + 1] - centerY));
+            }
+
+            aggregates.centerX[aggregate] = centerX;
+            aggregates.centerY[aggregate] = centerY;
+            aggregates.radius[aggregate] = radius;
+        }
+    }
+}
+
+double HierarchyRepulsion::compute(const std::vector<float>& positions, std::vector<float>& forces)
+{
+    const size_t numPoints = positions.size() / 2;
+    assert(numPoints == _numPoints);
+
+    forces.resize(positions.size());
+
+    if (numPoints == 0 || _aggregateLevels.empty())
+        return 0;
+
+    updateAggregates(positions);
+
+    _kernelSums.resize(numPoints);
+
+    const auto topLevel = static_cast<uint32_t>(_aggregateLevels.size() - 1);
+    const size_t numTopAggregates = _aggregateLevels.back().numAggregates();
+    const size_t chunkSize = (numPoints + _numChunks - 1) / _numChunks;
+
+    SPH_PARALLEL
+    for (int64_t chunk = 0; chunk < static_cast<int64_t>(_numChunks); chunk++)
+    {
+        // stack entries are (aggregate level, aggregate)
+        std::vector<std::pair<uint32_t, uint32_t>> stack;
+
+        const size_t first = chunk * chunkSize;
+        const size_t last = std::min(first + chunkSize, numPoints);
+
+        for (size_t i = first; i < last; i++)
+        {
+            const float xi = positions[2 * i];
+            const float yi = positions[2 * i + 1];
+
+            double kernelSum = 0, forceX = 0, forceY = 0;
+
+            stack.clear();
+            for (uint32_t aggregate = 0; aggregate < numTopAggregates; aggregate++)
+                stack.emplace_back(topLevel, aggregate);
+
+            while (!stack.empty())
+            {
+                const auto [levelIndex, aggregate] = stack.back();
+                stack.pop_back();
+
+                const AggregateLevel& aggregates = _aggregateLevels[levelIndex];
+
+                const float dx = xi - aggregates.centerX[aggregate];
+                const float dy = yi - aggregates.centerY[aggregate];
+                const float distSq = dx * dx + dy * dy;
+                const float radius = aggregates.radius[aggregate];
+
+                // far field
+                if (radius * radius < _thetaSq * distSq)
+                {
+                    const float w = 1.f / (1.f + distSq);
+                    const float count = static_cast<float>(aggregates.count[aggregate]);
+                    kernelSum += count * w;
+                    forceX += count * w * w * dx;
+                    forceY += count * w * w * dy;
+                    continue;
+                }
+
+                const uint32_t firstChild = aggregates.childOffsets[aggregate];
+                const uint32_t lastChild = aggregates.childOffsets[aggregate + 1];
+
+                if (levelIndex > 0)
+                {
+                    for (uint32_t c = firstChild; c < lastChild; c++)
+                        stack.emplace_back(levelIndex - 1, aggregates.children[c]);
+                    continue;
+                }
+
+                // near field, the point itself adds w_ii = 1 and no force
+                for (uint32_t c = firstChild; c < lastChild; c++)
+                {
+                    const uint32_t j = aggregates.children[c];
+                    const float pdx = xi - positions[2 * j];
+                    const float pdy = yi - positions[2 * j + 1];
+                    const float w = 1.f / (1.f + pdx * pdx + pdy * pdy);
+                    kernelSum += w;
+                    forceX += w * w * pdx;
+                    forceY += w * w * pdy;
+                }
+            }
+
+            _kernelSums[i] = kernelSum - 1.0;
+            forces[2 * i] = static_cast<float>(forceX);
+            forces[2 * i + 1] = static_cast<float>(forceY);
+        }
+    }
+
+    double normalization = 0;
+    for (const double kernelSum : _kernelSums)
+        normalization += kernelSum;
+
+    return normalization;
+}
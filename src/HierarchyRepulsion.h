@@ -0,0 +1,77 @@
+#pragma once
+
+#include "CpuTsneComputation.h"
+
+#include <sph/utils/CommonDefinitions.hpp>
+#include <sph/utils/Hierarchy.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// ////////////////// ///
+/// HierarchyRepulsion ///
+/// ////////////////// ///
+
+/**
+ * t-SNE repulsion that uses the superpixel hierarchy as the space partitioning tree.
+ * The aggregates of the coarser levels are tracked through the hierarchy mappings, each iteration they are placed at the centroid of
+ * their member points' current positions and get the radius that covers all members.
+ * An aggregate repels like its number of member points at the centroid (monopole), which matches the exact per-point t-SNE repulsion.
+ * Weighting by represented size would move the centroid towards large superpixels without changing the repulsion mass.
+ * A point is repelled by a whole aggregate if that is far away compared to its radius, otherwise by its children, on the lowest aggregate
+ * level by the member points exactly.
+ * Unlike a quadtree the tree is not rebuilt every iteration, and its aggregates are semantically coherent, i.e. compact in the embedding.
+ */
+class HierarchyRepulsion : public TsneRepulsion
+{
+public:
+    /**
+     * @param hierarchy Superpixel hierarchy, only used during construction
+     * @param level Level of the embedded points
+     * @param levelIDs Superpixels on level in embedding order
+     * @param theta Radius to distance ratio below which an aggregate is approximated, smaller than 1
+     */
+    HierarchyRepulsion(const sph::utils::Hierarchy& hierarchy, int64_t level, const std::vector<uint64_t>& levelIDs, float theta = 0.5f);
+
+    /** All superpixels on level */
+    HierarchyRepulsion(const sph::utils::Hierarchy& hierarchy, int64_t level, float theta = 0.5f);
+
+    /**
+     * @param mappingLevelToData Image points of each superpixel, per level
+     * @param mappingDataToLevel Superpixel of each image point, per level
+     */
+    HierarchyRepulsion(const std::vector<sph::vvui64>& mappingLevelToData, const std::vector<sph::vui64>& mappingDataToLevel, int64_t level, const std::vector<uint64_t>& levelIDs, float theta = 0.5f);
+
+    double compute(const std::vector<float>& positions, std::vector<float>& forces) override;
+
+    /** Whether there is a coarser level than level, otherwise the hierarchy cannot be used as a repulsion tree */
+    static bool canUse(const sph::utils::Hierarchy& hierarchy, int64_t level) { return level + 1 < static_cast<int64_t>(hierarchy.getNumLevels()); }
+
+    size_t getNumAggregateLevels() const { return _aggregateLevels.size(); }
+
+private:
+    /** Aggregates of one coarser level, children are aggregates of the level below or, on the lowest level, points */
+    struct AggregateLevel
+    {
+        std::vector<uint32_t>   childOffsets = {};      /** CSR offsets into children */
+        std::vector<uint32_t>   children = {};
+        std::vector<uint32_t>   count = {};             /** Number of points */
+        std::vector<float>      centerX = {};
+        std::vector<float>      centerY = {};
+        std::vector<float>      radius = {};
+
+        size_t numAggregates() const { return childOffsets.size() - 1; }
+    };
+
+    static constexpr size_t _maxTopAggregates = 256;    /** Stop ascending the hierarchy once a level is this small */
+    static constexpr size_t _numChunks = 256;           /** Points are processed in chunks, each with its own traversal stack */
+
+    void updateAggregates(const std::vector<float>& positions);
+
+private:
+    float                           _thetaSq = 0.25f;
+    size_t                          _numPoints = 0;
+    std::vector<AggregateLevel>     _aggregateLevels = {};  /** From fine to coarse */
+    std::vector<double>             _kernelSums = {};       /** sum_j w_ij per point */
+};
@@ -0,0 +1,159 @@
+#include "LandmarkEmbedding.h"
+
+#include <sph/utils/Logger.hpp>
+
+#include <hdi/data/map_mem_eff.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <numbers>
+#include <random>
+#include <utility>
+
+using namespace sph;
+
+LandmarkEmbedding::LandmarkEmbedding(const utils::Hierarchy& hierarchy, int64_t level, int64_t landmarkLevel) :
+    _level(level),
+    _landmarkLevel(landmarkLevel)
+{
+    assert(landmarkLevel > level);
+
+    const auto& mappingLevelToData      = hierarchy.mapFromLevelToPixel[level];
+    const auto& mappingDataToLandmarks  = hierarchy.mapFromPixelToLevel()[landmarkLevel];
+    const uint64_t numPoints            = mappingLevelToData.size();
+
+    _numLandmarks = hierarchy.mapFromLevelToPixel[landmarkLevel].size();
+    _ancestors.resize(numPoints);
+
+    // superpixels are nested, any pixel of a superpixel identifies its ancestor
+    SPH_PARALLEL
+    for (int64_t superpixel = 0; superpixel < static_cast<int64_t>(numPoints); superpixel++)
+    {
+        assert(!mappingLevelToData[superpixel].empty());
+        _ancestors[superpixel] = mappingDataToLandmarks[mappingLevelToData[superpixel].front()];
+    }
+
+    // the largest child represents its ancestor
+    std::vector<uint64_t> landmarks(_numLandmarks, std::numeric_limits<uint64_t>::max());
+    for (uint64_t superpixel = 0; superpixel < numPoints; superpixel++)
+    {
+        uint64_t& landmark = landmarks[_ancestors[superpixel]];
+        if (landmark == std::numeric_limits<uint64_t>::max() || mappingLevelToData[superpixel].size() > mappingLevelToData[landmark].size())
+            landmark = superpixel;
+    }
+
+    _isLandmark.resize(numPoints, false);
+    for (const uint64_t landmark : landmarks)
+        if (landmark != std::numeric_limits<uint64_t>::max())
+            _isLandmark[landmark] = true;
+
+    // uniform in the unit disk
+    std::mt19937 rng(static_cast<uint32_t>(level));
+    std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+    _offsets.resize(numPoints * 2, 0.f);
+    for (uint64_t superpixel = 0; superpixel < numPoints; superpixel++)
+    {
+        const float radius = std::sqrt(unit(rng));
+        const float angle = 2.f * std::numbers::pi_v<float> * unit(rng);
+
+        if (_isLandmark[superpixel])
+            continue;
+
+        _offsets[2 * superpixel] = radius * std::cos(angle);
+        _offsets[2 * superpixel + 1] = radius * std::sin(angle);
+    }
+
+    Log::info("LandmarkEmbedding: {0} points on level {1} are placed by {2} landmarks of level {3}", numPoints, level, _numLandmarks, landmarkLevel);
+}
+
+int64_t LandmarkEmbedding::findLandmarkLevel(const utils::Hierarchy& hierarchy, int64_t level, uint64_t maxLandmarks)
+{
+    const auto numLevels = static_cast<int64_t>(hierarchy.getNumLevels());
+
+    if (hierarchy.mapFromLevelToPixel[level].size() <= maxLandmarks)
+        return -1;
+
+    for (int64_t landmarkLevel = level + 1; landmarkLevel < numLevels; landmarkLevel++)
+        if (hierarchy.mapFromLevelToPixel[landmarkLevel].size() <= maxLandmarks)
+            return landmarkLevel;
+
+    return -1;
+}
+
+std::vector<float> LandmarkEmbedding::scatter(const std::vector<float>& landmarkEmbedding) const
+{
+    assert(landmarkEmbedding.size() == _numLandmarks * 2);
+
+    // jitter by about half the mean spacing of the landmarks
+    float minX = std::numeric_limits<float>::max(), minY = std::numeric_limits<float>::max();
+    float maxX = std::numeric_limits<float>::lowest(), maxY = std::numeric_limits<float>::lowest();
+    for (uint64_t landmark = 0; landmark < _numLandmarks; landmark++)
+    {
+        minX = std::min(minX, landmarkEmbedding[2 * landmark]);
+        maxX = std::max(maxX, landmarkEmbedding[2 * landmark]);
+        minY = std::min(minY, landmarkEmbedding[2 * landmark + 1]);
+        maxY = std::max(maxY, landmarkEmbedding[2 * landmark + 1]);
+    }
+
+    const float area = std::max((maxX - minX) * (maxY - minY), 0.f);
+    const float jitter = 0.5f * std::sqrt(area / std::max<float>(static_cast<float>(_numLandmarks), 1.f));
+
+    const uint64_t numPoints = getNumPoints();
+    std::vector<float> embedding(numPoints * 2);
+
+    SPH_PARALLEL
+    for (int64_t superpixel = 0; superpixel < static_cast<int64_t>(numPoints); superpixel++)
+    {
+        const uint64_t ancestor = _ancestors[superpixel];
+        embedding[2 * superpixel] = landmarkEmbedding[2 * ancestor] + jitter * _offsets[2 * superpixel];
+        embedding[2 * superpixel + 1] = landmarkEmbedding[2 * ancestor + 1] + jitter * _offsets[2 * superpixel + 1];
+    }
+
+    return embedding;
+}
+
+std::vector<float> LandmarkEmbedding::interpolate(const SparseMatHDI& probDist, const std::vector<float>& landmarkEmbedding, uint32_t numIterations) const
+{
+    assert(probDist.size() == getNumPoints());
+
+    const uint64_t numPoints = getNumPoints();
+    const std::vector<float> scattered = scatter(landmarkEmbedding);
+
+    // Jacobi iterations: landmarks stay fixed, all others move halfway between their scattered position and the mean of their neighbors
+    std::vector<float> current = scattered;
+    std::vector<float> next(numPoints * 2);
+
+    for (uint32_t iter = 0; iter < numIterations; iter++)
+    {
+        SPH_PARALLEL
+        for (int64_t superpixel = 0; superpixel < static_cast<int64_t>(numPoints); superpixel++)
+        {
+            next[2 * superpixel] = scattered[2 * superpixel];
+            next[2 * superpixel + 1] = scattered[2 * superpixel + 1];
+
+            if (_isLandmark[superpixel])
+                continue;
+
+            float weightSum = 0, x = 0, y = 0;
+            for (const auto& [neighbor, value] : probDist[superpixel])
+            {
+                weightSum += value;
+                x += value * current[2 * neighbor];
+                y += value * current[2 * neighbor + 1];
+            }
+
+            if (weightSum <= 0)
+                continue;
+
+            next[2 * superpixel] = 0.5f * (scattered[2 * superpixel] + x / weightSum);
+            next[2 * superpixel + 1] = 0.5f * (scattered[2 * superpixel + 1] + y / weightSum);
+        }
+
+        std::swap(current, next);
+    }
+
+    return current;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <sph/utils/CommonDefinitions.hpp>
+#include <sph/utils/Hierarchy.hpp>
+
+#include <cstdint>
+#include <vector>
+
+/// ///////////////// ///
+/// LandmarkEmbedding ///
+/// ///////////////// ///
+
+/**
+ * Places the superpixels of a dense level based on the embedding of a coarser level.
+ * Each coarse superpixel is represented by its largest child, the landmark, all other superpixels are interpolated over their transition matrix rows.
+ */
+class LandmarkEmbedding
+{
+public:
+    /** Fine level superpixels are mapped to their ancestor on landmarkLevel */
+    LandmarkEmbedding(const sph::utils::Hierarchy& hierarchy, int64_t level, int64_t landmarkLevel);
+
+    /** Finest level above level with at most maxLandmarks superpixels, -1 if level is small enough or no such level exists */
+    static int64_t findLandmarkLevel(const sph::utils::Hierarchy& hierarchy, int64_t level, uint64_t maxLandmarks);
+
+    /** Fine level layout with each superpixel placed at (and jittered around) the position of its ancestor, landmarks are not jittered */
+    std::vector<float> scatter(const std::vector<float>& landmarkEmbedding) const;
+
+    /** Smooths the scattered layout by repeatedly moving each non-landmark towards the transition weighted mean of its neighbors */
+    std::vector<float> interpolate(const sph::SparseMatHDI& probDist, const std::vector<float>& landmarkEmbedding, uint32_t numIterations = 10) const;
+
+public: // Getter
+    int64_t getLevel() const { return _level; }
+    int64_t getLandmarkLevel() const { return _landmarkLevel; }
+    uint64_t getNumLandmarks() const { return _numLandmarks; }
+    uint64_t getNumPoints() const { return _ancestors.size(); }
+
+private:
+    int64_t                 _level = 0;
+    int64_t                 _landmarkLevel = 0;
+    uint64_t                _numLandmarks = 0;
+    std::vector<uint64_t>   _ancestors = {};        /** Superpixel on landmarkLevel for each superpixel on level */
+    std::vector<bool>       _isLandmark = {};       /** Largest child of its ancestor */
+    std::vector<float>      _offsets = {};          /** Random jitter in the unit disk, scaled to the landmark spacing */
+};
@@ -0,0 +1,97 @@
+#include "LinearAlgebra.h"
+
+#include <cmath>
+
+// Gram-Schmidt on the columns of the row-major numRows x numCols matrix, columns without a new direction become zero
+void orthonormalizeColumns(std::vector<double>& matrix, size_t numRows, size_t numCols)
+{
+    auto dot = [&](size_t colA, size_t colB) -> double {
+        double sum = 0;
+        for (size_t row = 0; row < numRows; row++)
+            sum += matrix[row * numCols + colA] * matrix[row * numCols + colB];
+        return sum;
+        };
+
+    for (size_t col = 0; col < numCols; col++)
+    {
+        const double normBefore = std::sqrt(dot(col, col));
+
+        // orthogonalizing twice is enough in floating point
+        for (int pass = 0; pass < 2; pass++)
+        {
+            for (size_t prev = 0; prev < col; prev++)
+            {
+                const double projection = dot(col, prev);
+                for (size_t row = 0; row < numRows; row++)
+                    matrix[row * numCols + col] -= projection * matrix[row * numCols + prev];
+            }
+        }
+
+        const double norm = std::sqrt(dot(col, col));
+        const double scale = norm > 1e-10 * normBefore && norm > 0 ? 1.0 / norm : 0.0;
+        for (size_t row = 0; row < numRows; row++)
+            matrix[row * numCols + col] *= scale;
+    }
+}
+
+// Cyclic Jacobi rotations of the symmetric row-major n x n matrix, the eigenvectors are the columns of vectors
+void computeSymmetricEigen(std::vector<double> matrix, size_t n, std::vector<double>& values, std::vector<double>& vectors)
+{
+    vectors.assign(n * n, 0.0);
+    for (size_t i = 0; i < n; i++)
+        vectors[i * n + i] = 1.0;
+
+    for (int sweep = 0; sweep < 64; sweep++)
+    {
+        double offDiagonal = 0, diagonal = 0;
+        for (size_t p = 0; p < n; p++)
+        {
+            diagonal += matrix[p * n + p] * matrix[p * n + p];
+            for (size_t q = p + 1; q < n; q++)
+                offDiagonal += matrix[p * n + q] * matrix[p * n + q];
+        }
+
+        if (offDiagonal <= 1e-24 * diagonal)
+            break;
+
+        for (size_t p = 0; p < n; p++)
+        {
+            for (size_t q = p + 1; q < n; q++)
+            {
+                const double apq = matrix[p * n + q];
+                if (apq == 0.0)
+                    continue;
+
+                const double theta = (matrix[q * n + q] - matrix[p * n + p]) / (2.0 * apq);
+                const double t = (theta >= 0 ? 1.0 : -1.0) / (std::abs(theta) + std::sqrt(theta * theta + 1.0));
+                const double c = 1.0 / std::sqrt(t * t + 1.0);
+                const double s = t * c;
+
+                for (size_t k = 0; k < n; k++)
+                {
+                    const double akp = matrix[k * n + p], akq = matrix[k * n + q];
+                    matrix[k * n + p] = c * akp - s * akq;
+                    matrix[k * n + q] = s * akp + c * akq;
+                }
+
+                for (size_t k = 0; k < n; k++)
+                {
+                    const double apk = matrix[p * n + k], aqk = matrix[q * n + k];
+                    matrix[p * n + k] = c * apk - s * aqk;
+                    matrix[q * n + k] = s * apk + c * aqk;
+                }
+
+                for (size_t k = 0; k < n; k++)
+                {
+                    const double vkp = vectors[k * n + p], vkq = vectors[k * n + q];
+                    vectors[k * n + p] = c * vkp - s * vkq;
+                    vectors[k * n + q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+
+    values.resize(n);
+    for (size_t i = 0; i < n; i++)
+        values[i] = matrix[i * n + i];
+}
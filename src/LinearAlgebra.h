@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/// ////////////// ///
+/// LINEAR ALGEBRA ///
+/// ////////////// ///
+
+// Dense helpers for the small matrices of the iterative eigen solvers, all matrices are row-major
+
+// Gram-Schmidt on the columns of the numRows x numCols matrix, columns without a new direction become zero
+void orthonormalizeColumns(std::vector<double>& matrix, size_t numRows, size_t numCols);
+
+// Cyclic Jacobi rotations of the symmetric n x n matrix, the eigenvectors are the columns of vectors
+void computeSymmetricEigen(std::vector<double> matrix, size_t n, std::vector<double>& values, std::vector<double>& vectors);
@@ -0,0 +1,345 @@
+#include "LocalOptimization.h"
+
+#include "BarnesHutRepulsion.h"
+
+#include <sph/utils/Logger.hpp>
+
+#include <ankerl/unordered_dense.h>
+#include <hdi/data/map_mem_eff.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <utility>
+
+using namespace sph;
+
+namespace {
+    inline float tsneKernel(float dx, float dy) {
+        return 1.f / (1.f + dx * dx + dy * dy);
+    }
+}
+
+LocalOptimization::LocalOptimization(const SparseMatHDI& probDist, std::vector<float> embedding, const std::vector<uint64_t>& selection) :
+    _embedding(std::move(embedding)),
+    _numEmbPoints(probDist.size())
+{
+    assert(_embedding.size() == _numEmbPoints * 2);
+    assert(std::ranges::is_sorted(selection));
+
+    ankerl::unordered_dense::map<uint64_t, uint32_t> localIDs;
+
+    auto addLocal = [&localIDs](uint64_t id, std::vector<uint64_t>& ids) {
+        if (localIDs.contains(id))
+            return;
+        localIDs[id] = static_cast<uint32_t>(localIDs.size());
+        ids.push_back(id);
+        };
+
+    // Movable: the selection and its neighbours
+    for (const uint64_t id : selection)
+        addLocal(id, _movableIDs);
+
+    for (const uint64_t id : selection)
+        for (const auto& [neighbor, value] : probDist[id])
+            addLocal(neighbor, _movableIDs);
+
+    const size_t numMovable = _movableIDs.size();
+
+    // Anchors: fixed neighbours of movable points
+    for (size_t movableID = 0; movableID < numMovable; movableID++)
+        for (const auto& [neighbor, value] : probDist[_movableIDs[movableID]])
+            addLocal(neighbor, _anchorIDs);
+
+    // Symmetrize the transition values, rows of fixed points that are no anchors are not visited
+    std::vector<ankerl::unordered_dense::map<uint32_t, float>> edges(numMovable);
+
+    for (size_t movableID = 0; movableID < numMovable; movableID++)
+    {
+        for (const auto& [neighbor, value] : probDist[_movableIDs[movableID]])
+        {
+            const uint32_t neighborID = localIDs[neighbor];
+            edges[movableID][neighborID] += value;
+
+            if (neighborID < numMovable)
+                edges[neighborID][static_cast<uint32_t>(movableID)] += value;
+        }
+    }
+
+    for (size_t anchorID = 0; anchorID < _anchorIDs.size(); anchorID++)
+    {
+        for (const auto& [neighbor, value] : probDist[_anchorIDs[anchorID]])
+        {
+            const auto it = localIDs.find(neighbor);
+            if (it != localIDs.end() && it->second < numMovable)
+                edges[it->second][static_cast<uint32_t>(numMovable + anchorID)] += value;
+        }
+    }
+
+    // Joint probabilities are normalized by the sum of all symmetrized transition values, i.e. 2 * sum(P) like the full gradient descent.
+    // Rows do not necessarily sum to 1, e.g. for other normalization schemes or for refined sub-graphs
+    std::vector<double> rowSums(_numEmbPoints, 0);
+    SPH_PARALLEL
+    for (int64_t row = 0; row < static_cast<int64_t>(_numEmbPoints); row++)
+        for (const auto& [col, value] : probDist[row])
+            rowSums[row] += value;
+
+    double probDistSum = 0;
+    for (const double rowSum : rowSums)
+        probDistSum += rowSum;
+
+    const float normalization = probDistSum > 0 ? static_cast<float>(1. / (2. * probDistSum)) : 0.f;
+
+    _edgeOffsets.resize(numMovable + 1, 0);
+    for (size_t movableID = 0; movableID < numMovable; movableID++)
+    {
+        edges[movableID].erase(static_cast<uint32_t>(movableID));
+        _edgeOffsets[movableID + 1] = _edgeOffsets[movableID] + edges[movableID].size();
+    }
+
+    _edgeTargets.reserve(_edgeOffsets.back());
+    _edgeValues.reserve(_edgeOffsets.back());
+    for (const auto& row : edges)
+    {
+        for (const auto& [target, value] : row)
+        {
+            _edgeTargets.push_back(target);
+            _edgeValues.push_back(value * normalization);
+        }
+    }
+}
+
+LocalOptimization::FarField LocalOptimization::computeFarField(uint32_t numGridCells) const
+{
+    FarField farField;
+
+    std::vector<bool> isLocal(_numEmbPoints, false);
+    for (const uint64_t id : _movableIDs)
+        isLocal[id] = true;
+    for (const uint64_t id : _anchorIDs)
+        isLocal[id] = true;
+
+    float minX = std::numeric_limits<float>::max(), minY = std::numeric_limits<float>::max();
+    float maxX = std::numeric_limits<float>::lowest(), maxY = std::numeric_limits<float>::lowest();
+    for (uint64_t id = 0; id < _numEmbPoints; id++)
+    {
+        if (isLocal[id])
+            continue;
+        minX = std::min(minX, _embedding[2 * id]);
+        maxX = std::max(maxX, _embedding[2 * id]);
+        minY = std::min(minY, _embedding[2 * id + 1]);
+        maxY = std::max(maxY, _embedding[2 * id + 1]);
+    }
+
+    if (minX > maxX)
+        return farField;
+
+    const size_t numCells = static_cast<size_t>(numGridCells) * numGridCells;
+    const float cellScaleX = numGridCells / std::max(maxX - minX, 1e-6f);
+    const float cellScaleY = numGridCells / std::max(maxY - minY, 1e-6f);
+
+    std::vector<double> sums(numCells * 2, 0);
+    std::vector<uint32_t> counts(numCells, 0);
+
+    for (uint64_t id = 0; id < _numEmbPoints; id++)
+    {
+        if (isLocal[id])
+            continue;
+
+        const auto cellX = std::min(static_cast<uint32_t>((_embedding[2 * id] - minX) * cellScaleX), numGridCells - 1);
+        const auto cellY = std::min(static_cast<uint32_t>((_embedding[2 * id + 1] - minY) * cellScaleY), numGridCells - 1);
+        const size_t cell = static_cast<size_t>(cellY) * numGridCells + cellX;
+
+        sums[2 * cell] += _embedding[2 * id];
+        sums[2 * cell + 1] += _embedding[2 * id + 1];
+        counts[cell]++;
+    }
+
+    for (size_t cell = 0; cell < numCells; cell++)
+    {
+        if (counts[cell] == 0)
+            continue;
+
+        farField.centroids.push_back(static_cast<float>(sums[2 * cell] / counts[cell]));
+        farField.centroids.push_back(static_cast<float>(sums[2 * cell + 1] / counts[cell]));
+        farField.counts.push_back(counts[cell]);
+    }
+
+    return farField;
+}
+
+float LocalOptimization::estimateFixedNormalization(uint32_t numSamples) const
+{
+    const uint64_t numFixed = _numEmbPoints - _movableIDs.size();
+    if (numFixed < 2 || numSamples == 0)
+        return 0.f;
+
+    std::vector<bool> isMovable(_numEmbPoints, false);
+    for (const uint64_t id : _movableIDs)
+        isMovable[id] = true;
+
+    std::mt19937_64 rng(42);
+    std::uniform_int_distribution<uint64_t> drawPoint(0, _numEmbPoints - 1);
+
+    double kernelSum = 0;
+    uint32_t numPairs = 0;
+    for (uint32_t attempt = 0; attempt < 4 * numSamples && numPairs < numSamples; attempt++)
+    {
+        const uint64_t i = drawPoint(rng);
+        const uint64_t j = drawPoint(rng);
+
+        if (i == j || isMovable[i] || isMovable[j])
+            continue;
+
+        kernelSum += tsneKernel(_embedding[2 * i] - _embedding[2 * j], _embedding[2 * i + 1] - _embedding[2 * j + 1]);
+        numPairs++;
+    }
+
+    if (numPairs == 0)
+        return 0.f;
+
+    return static_cast<float>(kernelSum / numPairs * static_cast<double>(numFixed) * static_cast<double>(numFixed - 1));
+}
+
+void LocalOptimization::optimize(const Settings& settings)
+{
+    if (isEmpty())
+        return;
+
+    const size_t numMovable = _movableIDs.size();
+    const size_t numAnchors = _anchorIDs.size();
+
+    // Local positions: movable points first, then anchors
+    std::vector<float> positions((numMovable + numAnchors) * 2);
+    for (size_t localID = 0; localID < numMovable; localID++)
+    {
+        positions[2 * localID] = _embedding[2 * _movableIDs[localID]];
+        positions[2 * localID + 1] = _embedding[2 * _movableIDs[localID] + 1];
+    }
+    for (size_t anchorID = 0; anchorID < numAnchors; anchorID++)
+    {
+        positions[2 * (numMovable + anchorID)] = _embedding[2 * _anchorIDs[anchorID]];
+        positions[2 * (numMovable + anchorID) + 1] = _embedding[2 * _anchorIDs[anchorID] + 1];
+    }
+
+    const FarField farField = computeFarField(std::max(settings.numGridCells, 1u));
+    const float fixedNormalization = estimateFixedNormalization(settings.numNormalizationSamples);
+    const size_t numFarCells = farField.counts.size();
+
+    const float learningRate = settings.learningRate > 0 ? settings.learningRate : std::max(200.f, static_cast<float>(_numEmbPoints) / 12.f);
+
+    std::vector<float> attraction(numMovable * 2);
+    std::vector<float> repulsion(numMovable * 2);
+    std::vector<double> kernelSums(numMovable);
+    std::vector<float> updates(numMovable * 2, 0.f);
+    std::vector<float> gains(numMovable * 2, 1.f);
+
+    // exact repulsion between movable points and anchors is quadratic in their number
+    const bool approximate = numMovable + numAnchors > settings.maxExactPoints;
+    BarnesHutRepulsion localRepulsion, movableRepulsion;
+    std::vector<float> localForces, movablePositions(numMovable * 2), movableForces;
+
+    for (uint32_t iter = 0; iter < settings.numIterations; iter++)
+    {
+        const bool exaggerate = iter < settings.numExaggerationIterations;
+        const float exaggeration = exaggerate ? settings.exaggerationFactor : 1.f;
+        const float momentum = exaggerate ? 0.5f : 0.8f;
+
+        // pairs of movable points appear once in the normalization, pairs with anchors twice
+        double movableNormalization = 0;
+        if (approximate)
+        {
+            std::copy_n(positions.begin(), numMovable * 2, movablePositions.begin());
+            localRepulsion.compute(positions, localForces);
+            movableNormalization = movableRepulsion.compute(movablePositions, movableForces);
+        }
+
+        SPH_PARALLEL
+        for (int64_t i = 0; i < static_cast<int64_t>(numMovable); i++)
+        {
+            const float xi = positions[2 * i];
+            const float yi = positions[2 * i + 1];
+
+            float attrX = 0, attrY = 0;
+            for (size_t edge = _edgeOffsets[i]; edge < _edgeOffsets[i + 1]; edge++)
+            {
+                const uint32_t j = _edgeTargets[edge];
+                const float dx = xi - positions[2 * j];
+                const float dy = yi - positions[2 * j + 1];
+                const float w = _edgeValues[edge] * tsneKernel(dx, dy);
+                attrX += w * dx;
+                attrY += w * dy;
+            }
+
+            // movable points and anchors repel each other exactly or through the trees
+            float repX = 0, repY = 0;
+            double kernelSum = 0;
+            if (approximate)
+            {
+                repX = localForces[2 * i];
+                repY = localForces[2 * i + 1];
+                kernelSum = 2.0 * localRepulsion.getKernelSums()[i];   // pairs of movable points are subtracted once below
+            }
+            else
+            {
+                for (size_t j = 0; j < numMovable + numAnchors; j++)
+                {
+                    if (j == static_cast<size_t>(i))
+                        continue;
+
+                    const float dx = xi - positions[2 * j];
+                    const float dy = yi - positions[2 * j + 1];
+                    const float w = tsneKernel(dx, dy);
+                    repX += w * w * dx;
+                    repY += w * w * dy;
+                    kernelSum += (j < numMovable) ? w : 2.f * w;  // pairs with fixed points appear twice in the normalization
+                }
+            }
+
+            // all other fixed points repel through their cell centroid
+            for (size_t cell = 0; cell < numFarCells; cell++)
+            {
+                const float dx = xi - farField.centroids[2 * cell];
+                const float dy = yi - farField.centroids[2 * cell + 1];
+                const float w = tsneKernel(dx, dy);
+                const float count = static_cast<float>(farField.counts[cell]);
+                repX += count * w * w * dx;
+                repY += count * w * w * dy;
+                kernelSum += 2.f * count * w;
+            }
+
+            attraction[2 * i] = attrX;
+            attraction[2 * i + 1] = attrY;
+            repulsion[2 * i] = repX;
+            repulsion[2 * i + 1] = repY;
+            kernelSums[i] = kernelSum;
+        }
+
+        // pairs of anchors are fixed and part of the sampled estimate
+        double normalization = fixedNormalization - movableNormalization;
+        for (const double kernelSum : kernelSums)
+            normalization += kernelSum;
+        const float invNormalization = normalization > 0 ? static_cast<float>(1. / normalization) : 0.f;
+
+        SPH_PARALLEL
+        for (int64_t v = 0; v < static_cast<int64_t>(numMovable * 2); v++)
+        {
+            const float gradient = 4.f * (exaggeration * attraction[v] - repulsion[v] * invNormalization);
+
+            // adaptive gains as in the t-SNE gradient descent
+            gains[v] = (std::signbit(gradient) != std::signbit(updates[v])) ? gains[v] + 0.2f : std::max(gains[v] * 0.8f, 0.01f);
+            updates[v] = momentum * updates[v] - learningRate * gains[v] * gradient;
+            positions[v] += updates[v];
+        }
+    }
+
+    for (size_t localID = 0; localID < numMovable; localID++)
+    {
+        _embedding[2 * _movableIDs[localID]] = positions[2 * localID];
+        _embedding[2 * _movableIDs[localID] + 1] = positions[2 * localID + 1];
+    }
+
+    Log::info("LocalOptimization::optimize: re-optimized {0} points ({1} fixed anchors) in {2} iterations", numMovable, numAnchors, settings.numIterations);
+}
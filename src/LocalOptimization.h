@@ -0,0 +1,71 @@
+#pragma once
+
+#include <sph/utils/CommonDefinitions.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// ///////////////// ///
+/// LocalOptimization ///
+/// ///////////////// ///
+
+/**
+ * Re-optimizes the t-SNE positions of selected points and their neighbours in the transition matrix, all other points stay fixed.
+ * The neighbourhood is gathered on construction, such that optimize() does not access the transition matrix and can run in the background.
+ */
+class LocalOptimization
+{
+public:
+    struct Settings
+    {
+        uint32_t    numIterations = 250;
+        uint32_t    numExaggerationIterations = 50;     /** Early exaggeration of the movable points */
+        float       exaggerationFactor = 4.f;
+        float       learningRate = 0.f;                 /** Set automatically based on the number of embedding points if <= 0 */
+        uint32_t    numGridCells = 32;                  /** Cells per embedding dimension that approximate repulsion of the distant fixed points */
+        uint32_t    maxExactPoints = 4'096;             /** Above this number of movable points and anchors, they repel each other through Barnes-Hut trees */
+        uint32_t    numNormalizationSamples = 10'000;   /** Random pairs of fixed points that estimate their part of the t-SNE normalization */
+    };
+
+public:
+    /** Embedding is a 2D layout of all rows of probDist, selection are sorted and unique row IDs */
+    LocalOptimization(const sph::SparseMatHDI& probDist, std::vector<float> embedding, const std::vector<uint64_t>& selection);
+
+    void optimize(const Settings& settings);
+
+public: // Getter
+    /** Embedding with the optimized positions of the movable points */
+    const std::vector<float>& getEmbedding() const { return _embedding; }
+    std::vector<float>& getEmbedding() { return _embedding; }
+
+    /** Selected points and their transition matrix neighbours */
+    const std::vector<uint64_t>& getMovableIDs() const { return _movableIDs; }
+
+    bool isEmpty() const { return _movableIDs.empty(); }
+
+private:
+    /** Counts and centroids of the fixed points that are not anchors, on a regular grid */
+    struct FarField
+    {
+        std::vector<float>      centroids = {};
+        std::vector<uint32_t>   counts = {};
+    };
+
+    FarField computeFarField(uint32_t numGridCells) const;
+
+    /** Sum of the t-SNE kernel over all pairs of fixed points, estimated from random pairs */
+    float estimateFixedNormalization(uint32_t numSamples) const;
+
+private:
+    std::vector<float>      _embedding = {};            /** All positions, movable points are updated in place */
+    std::vector<uint64_t>   _movableIDs = {};           /** Local IDs [0, numMovable) */
+    std::vector<uint64_t>   _anchorIDs = {};            /** Fixed neighbours of the movable points, local IDs [numMovable, numMovable + numAnchors) */
+
+    // Symmetrized transition values of the movable points in CSR format, targets are local IDs
+    std::vector<size_t>     _edgeOffsets = {};
+    std::vector<uint32_t>   _edgeTargets = {};
+    std::vector<float>      _edgeValues = {};
+
+    uint64_t                _numEmbPoints = 0;
+};
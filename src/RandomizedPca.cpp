@@ -0,0 +1,201 @@
+#include "RandomizedPca.h"
+
+#include "LinearAlgebra.h"
+
+#include <sph/utils/CommonDefinitions.hpp>
+#include <sph/utils/Logger.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <random>
+
+using namespace sph;
+
+namespace {
+    constexpr size_t numChunks = 64;
+}
+
+std::vector<float> RandomizedPca::compute(const float* data, size_t numPoints, size_t numDims, const Settings& settings)
+{
+    return compute([data, numDims](uint64_t point, float* row) {
+        std::memcpy(row, data + point * numDims, numDims * sizeof(float));
+        }, numPoints, numDims, settings);
+}
+
+std::vector<float> RandomizedPca::compute(const RowReader& readRow, size_t numPoints, size_t numDims, const Settings& settings)
+{
+    const size_t numComponents = settings.numComponents;
+
+    if (numComponents == 0 || numDims < numComponents || numPoints <= numComponents)
+    {
+        Log::warn("RandomizedPca::compute: cannot compute {0} components of {1} points with {2} dimensions", numComponents, numPoints, numDims);
+        return {};
+    }
+
+    const size_t numVectors = std::min(numComponents + settings.numOversamples, numDims);
+
+    // evenly spaced rows keep the spatial coverage of the image
+    const size_t numSampledRows = settings.maxSampledRows > 0 ? std::min(std::max(settings.maxSampledRows, numVectors + 1), numPoints) : numPoints;
+    const auto getRowID = [numPoints, numSampledRows](size_t sample) -> uint64_t {
+        return static_cast<uint64_t>(sample) * numPoints / numSampledRows;
+        };
+
+    const size_t chunkSize = (numSampledRows + numChunks - 1) / numChunks;
+
+    // Mean of the sampled rows
+    std::vector<double> partialSums(numChunks * numDims, 0.0);
+
+    SPH_PARALLEL
+    for (int64_t chunk = 0; chunk < static_cast<int64_t>(numChunks); chunk++)
+    {
+        double* sums = partialSums.data() + chunk * numDims;
+        std::vector<float> row(numDims);
+        const size_t last = std::min((chunk + 1) * chunkSize, numSampledRows);
+
+        for (size_t sample = chunk * chunkSize; sample < last; sample++)
+        {
+            readRow(getRowID(sample), row.data());
+            for (size_t dim = 0; dim < numDims; dim++)
+                sums[dim] += row[dim];
+        }
+    }
+
+    std::vector<float> mean(numDims, 0.f);
+    for (size_t dim = 0; dim < numDims; dim++)
+    {
+        double sum = 0;
+        for (size_t chunk = 0; chunk < numChunks; chunk++)
+            sum += partialSums[chunk * numDims + dim];
+        mean[dim] = static_cast<float>(sum / numSampledRows);
+    }
+
+    // Covariance (up to scale) times the numDims x numVectors row-major basis, in one pass over the sampled rows
+    auto multiplyCovariance = [&](const std::vector<double>& basis) -> std::vector<double> {
+        std::vector<double> partialProducts(numChunks * numDims * numVectors, 0.0);
+
+        SPH_PARALLEL
+        for (int64_t chunk = 0; chunk < static_cast<int64_t>(numChunks); chunk++)
+        {
+            double* product = partialProducts.data() + chunk * numDims * numVectors;
+            std::vector<double> centered(numDims), coefficients(numVectors);
+            std::vector<float> row(numDims);
+            const size_t last = std::min((chunk + 1) * chunkSize, numSampledRows);
+
+            for (size_t sample = chunk * chunkSize; sample < last; sample++)
+            {
+                readRow(getRowID(sample), row.data());
+                std::fill(coefficients.begin(), coefficients.end(), 0.0);
+
+                for (size_t dim = 0; dim < numDims; dim++)
+                {
+                    centered[dim] = static_cast<double>(row[dim]) - mean[dim];
+                    for (size_t vec = 0; vec < numVectors; vec++)
+                        coefficients[vec] += centered[dim] * basis[dim * numVectors + vec];
+                }
+
+                for (size_t dim = 0; dim < numDims; dim++)
+                    for (size_t vec = 0; vec < numVectors; vec++)
+                        product[dim * numVectors + vec] += centered[dim] * coefficients[vec];
+            }
+        }
+
+        std::vector<double> product(numDims * numVectors, 0.0);
+        for (size_t chunk = 0; chunk < numChunks; chunk++)
+            for (size_t i = 0; i < product.size(); i++)
+                product[i] += partialProducts[chunk * product.size() + i];
+
+        return product;
+        };
+
+    // Subspace iteration from a random start
+    std::mt19937_64 generator(settings.seed);
+    std::normal_distribution<double> normal(0.0, 1.0);
+
+    std::vector<double> basis(numDims * numVectors);
+    for (double& value : basis)
+        value = normal(generator);
+    orthonormalizeColumns(basis, numDims, numVectors);
+
+    std::vector<double> product = multiplyCovariance(basis);
+    for (size_t iteration = 0; iteration < settings.numPowerIterations; iteration++)
+    {
+        basis = std::move(product);
+        orthonormalizeColumns(basis, numDims, numVectors);
+        product = multiplyCovariance(basis);
+    }
+
+    // Rayleigh-Ritz: eigen decomposition of the covariance in the subspace
+    std::vector<double> reduced(numVectors * numVectors, 0.0);
+    for (size_t a = 0; a < numVectors; a++)
+        for (size_t b = 0; b < numVectors; b++)
+            for (size_t dim = 0; dim < numDims; dim++)
+                reduced[a * numVectors + b] += basis[dim * numVectors + a] * product[dim * numVectors + b];
+
+    for (size_t a = 0; a < numVectors; a++)
+        for (size_t b = a + 1; b < numVectors; b++)
+            reduced[a * numVectors + b] = reduced[b * numVectors + a] = 0.5 * (reduced[a * numVectors + b] + reduced[b * numVectors + a]);
+
+    std::vector<double> eigenValues, eigenVectors;
+    computeSymmetricEigen(std::move(reduced), numVectors, eigenValues, eigenVectors);
+
+    std::vector<size_t> order(numVectors);
+    std::iota(order.begin(), order.end(), size_t{ 0 });
+    std::sort(order.begin(), order.end(), [&eigenValues](size_t a, size_t b) { return eigenValues[a] > eigenValues[b]; });
+
+    if (!(eigenValues[order[numComponents - 1]] > 1e-12 * eigenValues[order[0]]))
+    {
+        Log::warn("RandomizedPca::compute: data spans less than {0} dimensions", numComponents);
+        return {};
+    }
+
+    // Principal axes, numDims x numComponents, with the sign of the largest entry positive for deterministic layouts
+    std::vector<float> axes(numDims * numComponents);
+    for (size_t comp = 0; comp < numComponents; comp++)
+    {
+        double largest = 0;
+        for (size_t dim = 0; dim < numDims; dim++)
+        {
+            double value = 0;
+            for (size_t vec = 0; vec < numVectors; vec++)
+                value += basis[dim * numVectors + vec] * eigenVectors[vec * numVectors + order[comp]];
+
+            axes[dim * numComponents + comp] = static_cast<float>(value);
+            if (std::abs(value) > std::abs(largest))
+                largest = value;
+        }
+
+        if (largest < 0)
+            for (size_t dim = 0; dim < numDims; dim++)
+                axes[dim * numComponents + comp] *= -1.f;
+    }
+
+    // Project all rows
+    std::vector<float> projection(numPoints * numComponents, 0.f);
+    const size_t projectionChunkSize = (numPoints + numChunks - 1) / numChunks;
+
+    SPH_PARALLEL
+    for (int64_t chunk = 0; chunk < static_cast<int64_t>(numChunks); chunk++)
+    {
+        std::vector<float> row(numDims);
+        const size_t last = std::min((chunk + 1) * projectionChunkSize, numPoints);
+
+        for (size_t point = chunk * projectionChunkSize; point < last; point++)
+        {
+            readRow(point, row.data());
+            float* projected = projection.data() + point * numComponents;
+
+            for (size_t dim = 0; dim < numDims; dim++)
+            {
+                const float centered = row[dim] - mean[dim];
+                for (size_t comp = 0; comp < numComponents; comp++)
+                    projected[comp] += centered * axes[dim * numComponents + comp];
+            }
+        }
+    }
+
+    Log::info("RandomizedPca::compute: {0} components of {1} points with {2} dimensions, axes from {3} rows", numComponents, numPoints, numDims, numSampledRows);
+
+    return projection;
+}
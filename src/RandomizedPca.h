@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+/// ///////////// ///
+/// RandomizedPca ///
+/// ///////////// ///
+
+/**
+ * Truncated PCA by randomized subspace iteration (Halko et al. 2011), multithreaded over the data rows.
+ * The covariance is never formed: each iteration is one pass over the rows that multiplies them with a small block of vectors.
+ * Optionally, the principal axes are estimated on an evenly spaced subset of the rows, all rows are projected onto them.
+ */
+class RandomizedPca
+{
+public:
+    struct Settings
+    {
+        size_t      numComponents = 2;
+        size_t      numOversamples = 8;         /** Additional vectors of the subspace, improve the accuracy of the leading components */
+        size_t      numPowerIterations = 2;
+        size_t      maxSampledRows = 0;         /** Estimate the axes on at most this many rows, all rows if 0 */
+        uint64_t    seed = 42;
+    };
+
+    /** Writes the numDims values of a point to row, e.g. converted from the native element type of the input */
+    using RowReader = std::function<void(uint64_t point, float* row)>;
+
+public:
+    /**
+     * Projects the numPoints x numDims data, read row by row, onto its leading principal axes
+     * @return numPoints x numComponents row-major, empty if the data does not span numComponents dimensions
+     */
+    static std::vector<float> compute(const RowReader& readRow, size_t numPoints, size_t numDims, const Settings& settings);
+
+    /** Projects the numPoints x numDims row-major data onto its leading principal axes */
+    static std::vector<float> compute(const float* data, size_t numPoints, size_t numDims, const Settings& settings);
+
+    static std::vector<float> compute(const std::vector<float>& data, size_t numDims, const Settings& settings) {
+        return compute(data.data(), numDims > 0 ? data.size() / numDims : 0, numDims, settings);
+    }
+};
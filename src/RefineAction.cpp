@@ -1,53 +1,78 @@
 #include "RefineAction.h"
 
+#include "HierarchyRepulsion.h"
+#include "LocalOptimization.h"
+#include "RandomizedPca.h"
 #include "RefinedSelectionMapping.h"
+#include "SpectralEmbedding.h"
 #include "SettingsTsneAction.h"
 #include "SphPlugin.h"
+#include "SubGraphCache.h"
+#include "TsneComputationAction.h"
 #include "Utils.h"
 
 #include <ImageData/ImageData.h>
 #include <ImageData/Images.h>
 #include <PointData/InfoAction.h>
 
+#include <QCoreApplication>
+#include <QPointer>
+#include <QThreadPool>
+
 #include <sph/utils/Algorithms.hpp>
 #include <sph/utils/CommonDefinitions.hpp>
 #include <sph/utils/Data.hpp>
+#include <sph/utils/Embedding.hpp>
 #include <sph/utils/HDILibHelper.hpp>
+#include <sph/utils/Logger.hpp>
 #include <sph/utils/Math.hpp>
 
-#include <ankerl/unordered_dense.h>
 #include <hdi/data/map_mem_eff.h>
 
 #include <algorithm>
+#include <cassert>
+#include <initializer_list>
 #include <limits>
+#include <memory>
+#include <numeric>
+#include <random>
 
 using namespace sph;
 
-using hash = ankerl::unordered_dense::hash<int64_t>;
-using hashmap = ankerl::unordered_dense::map<int64_t, int64_t, hash>;
-
 RefineAction::RefineAction(QObject* parent) :
     GroupAction(parent, "RefineAction", true),
     _refineAction(this, "Refine"),
-    _exactRefinementAction(this, "Exact refinement", 0.f, 1.f, 1.f, 2)
+    _exactRefinementAction(this, "Exact refinement", 0.f, 1.f, 1.f, 2),
+    _autoRefineAction(this, "Auto refine (LOD)", false),
+    _pointBudgetAction(this, "LOD point budget", 1'000, 1'000'000, 20'000)
 {
     setText("Refine");
     setObjectName("Refine");
 
     addAction(&_refineAction);
     addAction(&_exactRefinementAction);
+    addAction(&_autoRefineAction);
+    addAction(&_pointBudgetAction);
 
     _refineAction.setToolTip("Refine selection: selection in data image (pixels)\nwill be converted to superpixels on level");
     _exactRefinementAction.setToolTip("Lower values than 1 will include points outside the selection to create better embeddings");
+    _autoRefineAction.setToolTip("Level of detail: the selected image region is refined automatically, to the finest level\nwhose superpixels fit the point budget. Replaces the previous automatic refinement.");
+    _pointBudgetAction.setToolTip("Maximum number of points of an automatic refinement");
 
     _exactRefinementAction.setSingleStep(0.01f);
 
+    _autoRefineTimer.setSingleShot(true);
+    _autoRefineTimer.setInterval(750);
+
     connect(&_refineAction, &mv::gui::TriggerAction::triggered, this, &RefineAction::refine);
+    connect(&_autoRefineTimer, &QTimer::timeout, this, &RefineAction::autoRefine);
 
     const auto updateReadOnly = [this]() -> void {
         auto enable = !isReadOnly();
 
         _refineAction.setEnabled(enable);
+        _autoRefineAction.setEnabled(enable);
+        _pointBudgetAction.setEnabled(enable);
         };
 
     connect(this, &GroupAction::readOnlyChanged, this, [this, updateReadOnly](const bool& readOnly) {
@@ -56,6 +81,19 @@ RefineAction::RefineAction(QObject* parent) :
 
 }
 
+void RefineAction::setSPHPlugin(SPHPlugin* sph)
+{
+    _sphPlugin = sph;
+
+    // the image selection acts as the viewport for automatic refinement, wait until it settles.
+    // Selections in refined embeddings are forwarded to the image, brushing in the refinement must not replace it
+    _inputData = _sphPlugin->getInputDataSet();
+    connect(&_inputData, &mv::Dataset<Points>::dataSelectionChanged, this, [this]() {
+        if (_autoRefineAction.isChecked() && !RefinedSelectionMapping::isForwardingRefinedSelection())
+            _autoRefineTimer.start();
+        });
+}
+
 void RefineAction::refine()
 {
     if (_sphPlugin == nullptr)
@@ -70,15 +108,67 @@ void RefineAction::refine()
         return;
     }
 
-    mv::Dataset<Points> inputDataset        = _sphPlugin->getInputDataSet();
-    const sph::utils::DataView inputData    = _sphPlugin->getInputData();
+    refineToLevel(_currentLevel - 1, false);
+}
+
+void RefineAction::autoRefine()
+{
+    if (_sphPlugin == nullptr || _currentLevel == 0 || !_autoRefineAction.isChecked())
+        return;
+
+    const auto& selectionIDs = _inputData->getSelectionIndices();
+
+    if (selectionIDs.empty())
+        return;
+
+    const auto pointBudget = static_cast<size_t>(_pointBudgetAction.getValue());
+
+    // finest level whose superpixels in the selected region fit the budget
+    int64_t refinedLevel = -1;
+    std::vector<uint64_t> superpixels, refinedSuperpixels;
+    superpixels.reserve(selectionIDs.size());
+
+    for (int64_t level = _currentLevel - 1; level >= 0; level--)
+    {
+        const sph::vui64& mappingDataToLevel = *_sphPlugin->getMappingDataToLevel(level);
+
+        superpixels.clear();
+        for (const auto selectionID : selectionIDs)
+            superpixels.push_back(mappingDataToLevel[selectionID]);
+
+        sph::utils::sortAndUnique(superpixels);
+
+        if (superpixels.size() > pointBudget)
+            break;
+
+        refinedLevel = level;
+        std::swap(refinedSuperpixels, superpixels);
+    }
+
+    if (refinedLevel < 0)
+    {
+        Log::info("RefineAction::autoRefine: selection exceeds the point budget of {0} on level {1}, doing nothing", pointBudget, _currentLevel - 1);
+        return;
+    }
+
+    const auto autoRefinement = std::ranges::find_if(_refinements, [](const auto& refinement) { return refinement->isAutoRefinement; });
+    if (autoRefinement != _refinements.end() && (*autoRefinement)->level == refinedLevel && (*autoRefinement)->selection == refinedSuperpixels)
+        return;
+
+    Log::info("RefineAction::autoRefine: refine selection to level {0}", refinedLevel);
+
+    refineToLevel(refinedLevel, true);
+}
+
+void RefineAction::refineToLevel(int64_t refinedLevel, bool isAutoRefinement)
+{
+    mv::Dataset<Points> inputDataset = _sphPlugin->getInputDataSet();
 
     if (inputDataset->getSelectionIndices().size() == 0) {
         qWarning() << "RefineAction::refine: selected data size is 0, doing nothing";
         return;
     }
 
-    const auto refinedLevel = _currentLevel - 1;
     const sph::vui64* mappingDataToRefinedLevel = _sphPlugin->getMappingDataToLevel(refinedLevel);
     const sph::vvui64* mappingRefinedLevelToData = _sphPlugin->getMappingLevelToData(refinedLevel);
 
@@ -89,11 +179,8 @@ void RefineAction::refine()
 
     const auto expandedSelectionInData = expandPixelToSuperpixelSelection(inputDataset, mappingDataToRefinedLevel, mappingRefinedLevelToData);
 
-    // get probDist for selection on refined level
-    const auto& probDistOnRefinedLevel = _sphPlugin->getComputeHierarchy()->getProbDistOnLevel(refinedLevel);
-
-    std::vector<uint64_t> newEmbIdsInRefinedLevelEmb;
-    const bool exactRefinement = sph::utils::isBasicallyEqual(_exactRefinementAction.getValue(), 1.f, 0.001);
+    qDebug() << "Selection in data: " << expandedSelectionInData.size();
+    qDebug() << "Parent embedding selection: " << _parentEmbedding->getSelectionIndices().size();
 
     std::vector<uint64_t> selectionSuperpixelsInRefinedLevel;
     selectionSuperpixelsInRefinedLevel.reserve(expandedSelectionInData.size());
@@ -105,54 +192,99 @@ void RefineAction::refine()
 
     sph::utils::sortAndUnique(selectionSuperpixelsInRefinedLevel);
 
-    if (exactRefinement)
-        sph::utils::extractSubGraph(probDistOnRefinedLevel, selectionSuperpixelsInRefinedLevel, _refinedTransitionMatrix, newEmbIdsInRefinedLevelEmb);
-    else
-        sph::utils::extractSubGraph(probDistOnRefinedLevel, selectionSuperpixelsInRefinedLevel, _refinedTransitionMatrix, newEmbIdsInRefinedLevelEmb, _exactRefinementAction.getValue()); // also extract connected vertices
+    const float exactness = _exactRefinementAction.getValue();
+    SubGraphCache* subGraphCache = _sphPlugin->getSubGraphCache();
 
-    const size_t numNewEmbPoints = newEmbIdsInRefinedLevelEmb.size();
+    const RefineRequest request = { refinedLevel, _currentLevel, _hierarchyVersion, isAutoRefinement, selectionSuperpixelsInRefinedLevel };
+
+    if (const auto subGraph = subGraphCache->find(refinedLevel, selectionSuperpixelsInRefinedLevel, exactness)) {
+        createRefinement(request, *subGraph);
+        return;
+    }
 
-    hashmap currentToRefinedIDs;
-    currentToRefinedIDs.reserve(numNewEmbPoints);
+    // extracting the sub graph of dense levels takes a while, do not block the UI
+    const auto& probDistOnRefinedLevel = _sphPlugin->getComputeHierarchy()->getProbDistOnLevel(refinedLevel);
+    _refineAction.setEnabled(false);
 
-    for (size_t idRefinedEmb = 0; idRefinedEmb < numNewEmbPoints; idRefinedEmb++)
-        currentToRefinedIDs[newEmbIdsInRefinedLevelEmb[idRefinedEmb]] = idRefinedEmb;
+    _sphPlugin->getBackgroundTasks()->start([guard = QPointer<RefineAction>(this), &probDistOnRefinedLevel, subGraphCache, exactness, request = std::move(request)]() mutable {
+        auto subGraph = SubGraphCache::extract(probDistOnRefinedLevel, request.selection, exactness);
+        subGraphCache->insert(request.refinedLevel, request.selection, exactness, subGraph);
+
+        QMetaObject::invokeMethod(qApp, [guard = std::move(guard), request = std::move(request), subGraph = std::move(subGraph)]() {
+            if (guard.isNull())
+                return;
+
+            guard->_refineAction.setEnabled(!guard->isReadOnly());
+            guard->createRefinement(request, *subGraph);
+            }, Qt::QueuedConnection);
+        });
+}
+
+void RefineAction::createRefinement(const RefineRequest& request, const SubGraph& subGraph)
+{
+    const int64_t refinedLevel = request.refinedLevel;
+
+    if (request.parentLevel != _currentLevel || request.hierarchyVersion != _hierarchyVersion)
+    {
+        Log::warn("RefineAction::createRefinement: level or hierarchy changed during sub graph extraction, doing nothing");
+        return;
+    }
+
+    // an automatic refinement replaces the previous one, the removal frees it
+    if (request.isAutoRefinement)
+    {
+        for (const auto& previous : _refinements)
+        {
+            if (!previous->isAutoRefinement)
+                continue;
+
+            previous->isAutoRefinement = false;
+            mv::data().removeDataset(previous->embedding);
+        }
+    }
+
+    mv::Dataset<Points> inputDataset        = _sphPlugin->getInputDataSet();
+
+    const sph::vui64* mappingDataToRefinedLevel = _sphPlugin->getMappingDataToLevel(refinedLevel);
+    const sph::vvui64* mappingRefinedLevelToData = _sphPlugin->getMappingLevelToData(refinedLevel);
+
+    // each refinement owns its transition matrix and embedding job, such that several refinements compute concurrently
+    Refinement& refinement = *_refinements.emplace_back(std::make_unique<Refinement>());
+    refinement.id = _nextRefinementID++;
+    refinement.level = refinedLevel;
+    refinement.parentLevel = request.parentLevel;
+    refinement.isAutoRefinement = request.isAutoRefinement;
+    refinement.selection = request.selection;
+    refinement.transitionMatrix = subGraph.transitionMatrix;
+    refinement.levelIDs = subGraph.levelIDs;
+
+    const std::vector<uint64_t>& newEmbIdsInRefinedLevelEmb = refinement.levelIDs;
+    const size_t numNewEmbPoints = newEmbIdsInRefinedLevelEmb.size();
 
-    qDebug() << "Selection in data: " << expandedSelectionInData.size();
-    qDebug() << "Parent embedding selection: " << _parentEmbedding->getSelectionIndices().size();
     qDebug() << "Refined embedding size: " << numNewEmbPoints;
 
     // add new embedding data set
-    auto& refinedEmbedding = _refinedEmbeddings.emplace_back(mv::data().createDataset<Points>("Points", QString("Refined (level %1)").arg(refinedLevel), _parentEmbedding));
+    auto& refinedEmbedding = refinement.embedding;
+    refinedEmbedding = mv::data().createDataset<Points>("Points", QString(request.isAutoRefinement ? "Auto refined (level %1)" : "Refined (level %1)").arg(refinedLevel), _parentEmbedding);
 
-    // helper used for meta data and potentially embedding init
-    std::vector<float> avgDataSuperpixels = computeAveragePerDimensionForSuperpixels(inputData, *mappingRefinedLevelToData);
+    // averages of the refined superpixels only, in refined embedding order, used for meta data and potentially embedding init
+    std::vector<float> avgDataRefinedSuperpixels = _sphPlugin->computeInputAverages(*mappingRefinedLevelToData, newEmbIdsInRefinedLevelEmb);
 
     // add selection maps between refined embedding and data and update meta data sets
     {
-        const size_t numImagePoints = static_cast<size_t>(inputDataset->getNumPoints());
-        sph::vvui64 mapLevelToData(numNewEmbPoints);
-        sph::vui64 mapDataToLevel(numImagePoints, std::numeric_limits<uint64_t>::max());
+        // the refinement only references the level mappings and stores which level superpixels it contains,
+        // all image points of the refined superpixels (including connected ones for non-exact refinements) map to the refinement
+        RefinedSelectionMapping* refineMappingAction = new RefinedSelectionMapping(this);
+        refinement.selectionMapping = refineMappingAction;
+        refineMappingAction->setMappings(mappingRefinedLevelToData, mappingDataToRefinedLevel, newEmbIdsInRefinedLevelEmb);
 
-        for (size_t idRefinedEmb = 0; idRefinedEmb < numNewEmbPoints; idRefinedEmb++)
-            mapLevelToData[idRefinedEmb] = (*mappingRefinedLevelToData)[newEmbIdsInRefinedLevelEmb[idRefinedEmb]];
+        // pixel level datasets only cover the bounding rectangle of the refined image region
+        const QSize imgSize         = _sphPlugin->getImageSize();
+        const QRect& imageRect      = refinement.imageRect = computeImageRect(*mappingRefinedLevelToData, newEmbIdsInRefinedLevelEmb, imgSize);
+        const size_t numRectPoints  = static_cast<size_t>(imageRect.width()) * imageRect.height();
+        refineMappingAction->setImageRect(imgSize, imageRect);
 
-        if (exactRefinement)
-        {
-            // no extra mapping required
-            for (const auto selectionIdData : expandedSelectionInData)
-                mapDataToLevel[selectionIdData] = currentToRefinedIDs[(*mappingDataToRefinedLevel)[selectionIdData]];
-        }
-        else
-        {
-            // add point outside selection to mapping as well
-            for (const auto selectionIdInRefinedLevel : newEmbIdsInRefinedLevelEmb)
-            {
-                const sph::vui64& selectionIDsInData = (*mappingRefinedLevelToData)[selectionIdInRefinedLevel];
-                for (const auto selectionIdData : selectionIDsInData)
-                    mapDataToLevel[selectionIdData] = currentToRefinedIDs[(*mappingDataToRefinedLevel)[selectionIdData]];
-            }
-        }
+        qDebug() << "Refined image region: " << imageRect;
 
         constexpr size_t numInitialDataDimensions = 2;
 
@@ -164,27 +296,29 @@ void RefineAction::refine()
 
         // populate data sets: image recolored by embedding layout 
         // -> reuse embedding position and recolor in image viewer with same color map as in Scatterplot
-        auto& imgColoredByEmb = _refinedRecolorData.emplace_back(mv::data().createDataset<Points>("Points", "Scatter colors", refinedEmbedding));
+        auto& imgColoredByEmb = refinement.recolorData;
+        imgColoredByEmb = mv::data().createDataset<Points>("Points", "Scatter colors", refinedEmbedding);
         
         {
-            std::vector<float> initialData(numInitialDataDimensions * numImagePoints, 0.f);
+            std::vector<float> initialData(numInitialDataDimensions * numRectPoints, 0.f);
             imgColoredByEmb->setData(std::move(initialData), numInitialDataDimensions);
             events().notifyDatasetDataChanged(imgColoredByEmb);
         }
 
-        auto& refinedRecolorImage = _refinedRecolorImages.emplace_back(mv::data().createDataset<Images>("Images", "Scatter colors", imgColoredByEmb));
+        auto& refinedRecolorImage = refinement.recolorImage;
+        refinedRecolorImage = mv::data().createDataset<Images>("Images", "Scatter colors", imgColoredByEmb);
 
         refinedRecolorImage->setType(ImageData::Type::Stack);
         refinedRecolorImage->setNumberOfImages(numInitialDataDimensions);
-        refinedRecolorImage->setImageSize(_sphPlugin->getImageSize());
+        refinedRecolorImage->setImageSize(imageRect.size());
         refinedRecolorImage->setNumberOfComponentsPerPixel(1);
 
-        std::vector<std::uint8_t> imageMask(numImagePoints, 255);
+        std::vector<std::uint8_t> imageMask(numRectPoints, 0);
 
         SPH_PARALLEL
-        for (size_t imageID = 0; imageID < numImagePoints; imageID++) {
-            if (mapDataToLevel[imageID] == std::numeric_limits<uint64_t>::max())
-                imageMask[imageID] = 0;
+        for (int64_t i = 0; i < static_cast<int64_t>(numNewEmbPoints); i++) {
+            for (const auto imageID : refineMappingAction->getDataIDs(i))
+                imageMask[imageToRectID(imageID, imgSize.width(), imageRect)] = 255;
         }
 
         refinedRecolorImage->setMaskData(imageMask);
@@ -192,7 +326,8 @@ void RefineAction::refine()
         events().notifyDatasetDataChanged(refinedRecolorImage);
 
         // populate data sets: resized embedding by represented data points
-        auto& refinedRepresentedSizeData = _refinedRepresentedSizes.emplace_back(mv::data().createDataset<Points>("Points", "Represented Data Size", refinedEmbedding));
+        auto& refinedRepresentedSizeData = refinement.representedSize;
+        refinedRepresentedSizeData = mv::data().createDataset<Points>("Points", "Represented Data Size", refinedEmbedding);
 
         {
             std::vector<float> representedDataPoints(numNewEmbPoints);
@@ -200,8 +335,9 @@ void RefineAction::refine()
             SPH_PARALLEL
             for (int64_t i = 0; i < static_cast<int64_t>(numNewEmbPoints); i++)
             {
-                assert(mapLevelToData[i].size() > 0);
-                const float representedDataSize = std::log(static_cast<float>(mapLevelToData[i].size() + 1));
+                const auto numDataIDs = refineMappingAction->getDataIDs(i).size();
+                assert(numDataIDs > 0);
+                const float representedDataSize = std::log(static_cast<float>(numDataIDs + 1));
                 representedDataPoints[i] = std::clamp(representedDataSize, 0.f, 10.f);
             }
 
@@ -210,17 +346,18 @@ void RefineAction::refine()
         }
 
         // populate data set: non-zero redined transition matrix entries
-        auto& refinedTransitionEntries = _refinedTransitionEntriess.emplace_back(mv::data().createDataset<Points>("Points", "Transition Neighbors", refinedEmbedding));
+        auto& refinedTransitionEntries = refinement.transitionEntries;
+        refinedTransitionEntries = mv::data().createDataset<Points>("Points", "Transition Neighbors", refinedEmbedding);
 
         {
             std::vector<float> transitionEntries(numNewEmbPoints);
 
-            assert(_refinedTransitionMatrix.size() == numNewEmbPoints);
+            assert(refinement.transitionMatrix.size() == numNewEmbPoints);
 
             SPH_PARALLEL
             for (int64_t i = 0; i < static_cast<int64_t>(numNewEmbPoints); i++)
             {
-                const float nonzeroEntires = std::log(static_cast<float>(_refinedTransitionMatrix[i].size() + 1));
+                const float nonzeroEntires = std::log(static_cast<float>(refinement.transitionMatrix[i].size() + 1));
                 transitionEntries[i] = std::clamp(nonzeroEntires, 0.f, 10.f);
             }
 
@@ -229,26 +366,28 @@ void RefineAction::refine()
         }
 
         // populate data sets: average images
-        auto& avgComponentDataSuper = _avgComponentDatasSuper.emplace_back(mv::data().createDataset<Points>("Points", "Average Data (Superpixel)", refinedEmbedding));
-        auto& avgComponentDataPixel = _avgComponentDatasPixel.emplace_back(mv::data().createDataset<Points>("Points", "Average Data (Pixel)", refinedEmbedding));
-        auto& avgComponentDataPixelImg = _avgComponentDatasPixelImg.emplace_back(mv::data().createDataset<Images>("Images", "Average Data (Image)", avgComponentDataPixel));
+        auto& avgComponentDataSuper = refinement.avgComponentDataSuper;
+        auto& avgComponentDataPixel = refinement.avgComponentDataPixel;
+        auto& avgComponentDataPixelImg = refinement.avgComponentDataPixelImg;
+        avgComponentDataSuper = mv::data().createDataset<Points>("Points", "Average Data (Superpixel)", refinedEmbedding);
+        avgComponentDataPixel = mv::data().createDataset<Points>("Points", "Average Data (Pixel)", refinedEmbedding);
+        avgComponentDataPixelImg = mv::data().createDataset<Images>("Images", "Average Data (Image)", avgComponentDataPixel);
 
         {
-            // Map (scatter) from superpixels to pixels
-            std::vector<float> avgDataPixels = mapSuperpixelAverageToPixels(avgDataSuperpixels, inputData.getNumPoints(), *mappingRefinedLevelToData);
+            const AveragePrecision precision = _sphPlugin->getSettingsAction().getAdvancedSettingsAction().getAveragePrecision();
 
-            std::vector<float> initialAvgData(inputData.getNumPoints() * inputData.getNumDimensions(), 0);
-            avgComponentDataSuper->setData(avgDataSuperpixels, inputData.getNumDimensions());
+            setAverageData(avgComponentDataSuper, avgDataRefinedSuperpixels, _sphPlugin->getNumEnabledDimensions(), precision);
             avgComponentDataSuper->setDimensionNames(inputDataset->getDimensionNames());
             events().notifyDatasetDataChanged(avgComponentDataSuper);
 
-            avgComponentDataPixel->setData(std::move(avgDataPixels), inputData.getNumDimensions());
+            // Map (scatter) from superpixels to pixels
+            setPixelAverageData(avgComponentDataPixel, avgDataRefinedSuperpixels, imgSize, imageRect, *mappingRefinedLevelToData, newEmbIdsInRefinedLevelEmb, precision);
             avgComponentDataPixel->setDimensionNames(inputDataset->getDimensionNames());
             events().notifyDatasetDataChanged(avgComponentDataPixel);
 
             avgComponentDataPixelImg->setType(ImageData::Type::Stack);
-            avgComponentDataPixelImg->setNumberOfImages(inputData.getNumDimensions());
-            avgComponentDataPixelImg->setImageSize(_sphPlugin->getImageSize());
+            avgComponentDataPixelImg->setNumberOfImages(_sphPlugin->getNumEnabledDimensions());
+            avgComponentDataPixelImg->setImageSize(imageRect.size());
             avgComponentDataPixelImg->setNumberOfComponentsPerPixel(1);
 
             avgComponentDataPixelImg->setMaskData(imageMask);
@@ -257,30 +396,32 @@ void RefineAction::refine()
         }
 
         // Add selection mappings
-        RefinedSelectionMapping* refineMappingAction = _refinedRefinedSelectionMappings.emplace_back(new RefinedSelectionMapping(this));
-
         refineMappingAction->setInputData(_sphPlugin->getInputDataSet());
         refineMappingAction->setEmbeddingData(refinedEmbedding);
         refineMappingAction->setImgColoredByEmb(imgColoredByEmb);
         refineMappingAction->setAvgComponentDataPixel(avgComponentDataPixel);
 
-        refineMappingAction->setMappingLevelToData(std::move(mapLevelToData));
-        refineMappingAction->setMappingDataToLevel(std::move(mapDataToLevel));
-
         refinedEmbedding->addAction(*refineMappingAction);
     }
 
+    // controls for the computation of this refinement
+    refinement.computationAction = new TsneComputationAction(this);
+    refinement.computationAction->getPixelEmbeddingAction().setVisible(false);
+    refinedEmbedding->addAction(*refinement.computationAction);
+
     // add refine action and TsneSettingsAction if refined level > data level
     if(refinedLevel > 0)
     {
-        RefineAction* refineAction = _refinedScaleActions.emplace_back(new RefineAction(this));
-        TsneSettingsAction* tsneSettingsAction = _refinedTsneSettingsActions.emplace_back(new TsneSettingsAction(this, "Refine t-SNE"));
+        RefineAction* refineAction = refinement.refineAction = new RefineAction(this);
+        TsneSettingsAction* tsneSettingsAction = refinement.tsneSettingsAction = new TsneSettingsAction(this, "Refine t-SNE");
 
         refineAction->setSPHPlugin(_sphPlugin);
         refineAction->setTsneSettingsAction(tsneSettingsAction);
         refineAction->setParentEmbedding(refinedEmbedding);
         refineAction->setCurrentLevel(refinedLevel);
+        refineAction->setParentSelectionMapping(refinement.selectionMapping);
 
+        tsneSettingsAction->addParentLayoutInitOption();
         tsneSettingsAction->setExpanded(true);
         tsneSettingsAction->adjustToLowNumberOfPoints(numNewEmbPoints);
         tsneSettingsAction->getTsneComputeAction().setEnabled(false);
@@ -290,68 +431,510 @@ void RefineAction::refine()
         refinedEmbedding->_infoAction->collapse();
     }
 
-    // compute t-sne
+    // compute t-sne, each refinement keeps its own copy of the settings
 
-    auto& tSNEParams = _refineTsneSettingsAction->getTsneParameters();
+    auto& tSNEParams = refinement.tsneParams;
+    tSNEParams = _refineTsneSettingsAction->getTsneParameters();
     tSNEParams.symmetricProbDist = true;
 
     if (numNewEmbPoints < 1000) {
         tSNEParams.gradientDescentType = GradientDescentType::CPU;
+        refinement.tsneEngine = TsneEngine::BARNES_HUT;
         qDebug() << "Refined embedding: adjust gradient descent to CPU for small number of points";
     }
+    else if (_refineTsneSettingsAction->getTsneEngine() != TsneEngine::LIBRARY) {
+        tSNEParams.gradientDescentType = GradientDescentType::CPU;
+        refinement.tsneEngine = _refineTsneSettingsAction->getTsneEngine();
+    }
     else {
         tSNEParams.gradientDescentType = GradientDescentType::GPUcompute;
+        refinement.tsneEngine = TsneEngine::LIBRARY;
+    }
+
+    // the parent layout is already well separated, a short exaggeration phase suffices
+    if (_refineTsneSettingsAction->getInitAction().getCurrentText() == "Parent layout") {
+        tSNEParams.gradDescentParams._remove_exaggeration_iter /= 4;
+        tSNEParams.gradDescentParams._mom_switching_iter /= 4;
+        tSNEParams.gradDescentParams._exponential_decay_iter /= 4;
     }
 
-    if (_refineTsneSettingsAction->getInitAction().getCurrentText() == "PCA") {
-        const auto numDims = inputData.getNumDimensions();
-        std::vector<float> avgDataRefinedSuperpixels(selectionSuperpixelsInRefinedLevel.size() * numDims);
+    createComputeEmbedding(refinement);
+    initRefinedEmbedding(refinement, avgDataRefinedSuperpixels);
+    connectRefinement(refinement);
 
-        SPH_PARALLEL
-        for (size_t i = 0; i < selectionSuperpixelsInRefinedLevel.size(); i++) {
-            auto copy_from_start = avgDataSuperpixels.begin() + selectionSuperpixelsInRefinedLevel[i] * numDims;
-            auto copy_from_end = copy_from_start + numDims;
-
-            std::ranges::copy(
-                copy_from_start,
-                copy_from_end,
-                avgDataRefinedSuperpixels.begin() + i * numDims);
+    useRefinement(refinement);
+    refinement.computeEmbedding->setNumIterations(0);
+    refinement.computeEmbedding->startComputation(refinement.transitionMatrix, tSNEParams);
+
+    Log::info("RefineAction::refine: refinement on level {0} with {1} points uses {2} MB of compute memory", refinedLevel, numNewEmbPoints, refinement.reclaimableMemory() >> 20);
+
+    _sphPlugin->getSettingsAction().getRefineAction().enforceMemoryBudget();
+}
+
+void RefineAction::initRefinedEmbedding(Refinement& refinement, const std::vector<float>& avgDataRefinedSuperpixels)
+{
+    const size_t numNewEmbPoints = refinement.levelIDs.size();
+    auto& computeEmbedding = *refinement.computeEmbedding;
+
+    if (_refineTsneSettingsAction->getInitAction().getCurrentText() == "Parent layout") {
+        std::vector<float> parentLayout = computeParentLayoutInit(refinement);
+
+        if (!parentLayout.empty()) {
+            computeEmbedding.initEmbedding(refinement.level, numNewEmbPoints, std::move(parentLayout));
+            qDebug() << "Refined embedding initialized with parent layout";
         }
+        else {
+            computeEmbedding.initEmbedding(refinement.level, numNewEmbPoints);
+        }
+    }
+    else if (_refineTsneSettingsAction->getInitAction().getCurrentText() == "PCA" && !avgDataRefinedSuperpixels.empty()) {
+        const auto numDims = avgDataRefinedSuperpixels.size() / numNewEmbPoints;
 
-        size_t numPC = 2;
-        std::vector<float> pca;
-        bool success = false;
+        RandomizedPca::Settings pcaSettings;
+        pcaSettings.maxSampledRows = _refineTsneSettingsAction->getPcaSampleSizeAction().getValue();
 
-        std::tie(pca, success) = sph::utils::pca(avgDataRefinedSuperpixels, numDims, numPC);
+        std::vector<float> pca = RandomizedPca::compute(avgDataRefinedSuperpixels, numDims, pcaSettings);
         
-        if (success) {
-            _computeEmbedding.initEmbedding(refinedLevel, numNewEmbPoints, std::move(pca));
+        if (!pca.empty()) {
+            computeEmbedding.initEmbedding(refinement.level, numNewEmbPoints, std::move(pca));
             qDebug() << "Refined embedding initialized with PCA";
         }
         else {
-            _computeEmbedding.initEmbedding(refinedLevel, numNewEmbPoints);
+            computeEmbedding.initEmbedding(refinement.level, numNewEmbPoints);
+        }
+    }
+    else if (_refineTsneSettingsAction->getInitAction().getCurrentText() == "Spectral") {
+        std::vector<float> spectral = SpectralEmbedding::compute(refinement.transitionMatrix, {});
+
+        if (!spectral.empty()) {
+            sph::utils::scaleEmbeddingToOne(spectral);
+            computeEmbedding.initEmbedding(refinement.level, numNewEmbPoints, std::move(spectral));
+            qDebug() << "Refined embedding initialized with spectral embedding";
+        }
+        else {
+            computeEmbedding.initEmbedding(refinement.level, numNewEmbPoints);
         }
     }
     else {
-        if (_refineTsneSettingsAction->getInitAction().getCurrentText() != "RANDOM") {
+        if (_refineTsneSettingsAction->getInitAction().getCurrentText() != "Random") {
             qDebug() << "Not implemented: " << _refineTsneSettingsAction->getInitAction().getCurrentText();
         }
-        _computeEmbedding.initEmbedding(refinedLevel, numNewEmbPoints);
+        computeEmbedding.initEmbedding(refinement.level, numNewEmbPoints);
     }
+}
 
-    disconnect(&_computeEmbedding, nullptr, this, nullptr);
+std::vector<float> RefineAction::computeParentLayoutInit(const Refinement& refinement) const
+{
+    const size_t numNewEmbPoints        = refinement.levelIDs.size();
+    const uint64_t numParentPoints      = _parentEmbedding->getNumPoints();
+    const sph::vvui64& mappingLevelToData   = *_sphPlugin->getMappingLevelToData(refinement.level);
+    const sph::vui64& mappingDataToParent   = *_sphPlugin->getMappingDataToLevel(refinement.parentLevel);
+
+    std::vector<float> parentPositions(static_cast<size_t>(numParentPoints) * 2);
+    std::vector<uint32_t> embDims{ 0, 1 };
+    _parentEmbedding->populateDataForDimensions(parentPositions, embDims);
+
+    std::vector<float> layout(numNewEmbPoints * 2, 0.f);
+    std::vector<uint8_t> hasParent(numNewEmbPoints, 0);
+
+    SPH_PARALLEL
+    for (int64_t i = 0; i < static_cast<int64_t>(numNewEmbPoints); i++) {
+        // a superpixel is contained in one superpixel of the coarser level, any of its pixels identifies it
+        const uint64_t dataID   = mappingLevelToData[refinement.levelIDs[i]].front();
+        const uint64_t parentID = (_parentSelectionMapping != nullptr) ? _parentSelectionMapping->getRefinedID(dataID) : mappingDataToParent[dataID];
+
+        if (parentID >= numParentPoints)
+            continue;
+
+        layout[2 * i]       = parentPositions[2 * parentID];
+        layout[2 * i + 1]   = parentPositions[2 * parentID + 1];
+        hasParent[i]        = 1;
+    }
 
-    // Update embedding points when the TSNE analysis produces new data
-    connect(&_computeEmbedding, &ComputeEmbeddingWrapper::embeddingUpdate, this, [this](const sph::vf32& emb) {
+    const auto numWithParent = std::count(hasParent.begin(), hasParent.end(), 1);
+    if (numWithParent == 0) {
+        Log::warn("RefineAction::computeParentLayoutInit: refined points are not part of the parent embedding");
+        return {};
+    }
+
+    // connected points outside the parent embedding (non-exact refinement) start at the centroid of their placed neighbors
+    SPH_PARALLEL
+    for (int64_t i = 0; i < static_cast<int64_t>(numNewEmbPoints); i++) {
+        if (hasParent[i])
+            continue;
 
-        auto& refineEmbedding = _refinedEmbeddings.back();
+        float x = 0.f, y = 0.f, weights = 0.f;
+        for (const auto& [neighbor, prob] : refinement.transitionMatrix[i]) {
+            if (!hasParent[neighbor])
+                continue;
+
+            x += prob * layout[2 * neighbor];
+            y += prob * layout[2 * neighbor + 1];
+            weights += prob;
+        }
+
+        if (weights > 0.f) {
+            layout[2 * i]       = x / weights;
+            layout[2 * i + 1]   = y / weights;
+        }
+    }
+
+    sph::utils::scaleEmbeddingToOne(layout);
+
+    // refined points of the same parent start at the same position, separate them slightly
+    std::mt19937 gen(static_cast<uint32_t>(refinement.levelIDs.front()));
+    std::normal_distribution<float> jitter(0.f, 0.01f);
+
+    for (auto& coordinate : layout)
+        coordinate += jitter(gen);
+
+    qDebug() << "Parent layout init: " << numWithParent << " of " << numNewEmbPoints << " points placed at their parent";
+
+    return layout;
+}
+
+void RefineAction::createComputeEmbedding(Refinement& refinement)
+{
+    refinement.computeEmbedding = std::make_unique<ComputeEmbeddingWrapper>("Refine Embedding");
+    refinement.computeEmbedding->setEmbeddingService(_sphPlugin->getEmbeddingService());
+
+    // the hierarchy engine covers the refined superpixels with their ancestors
+    const auto& hierarchy = _sphPlugin->getComputeHierarchy()->getHierarchy();
+    if (refinement.tsneEngine == TsneEngine::HIERARCHY && HierarchyRepulsion::canUse(hierarchy, refinement.level))
+        refinement.computeEmbedding->setTsneEngine(refinement.tsneEngine, std::make_shared<HierarchyRepulsion>(hierarchy, refinement.level, refinement.levelIDs));
+    else if (refinement.tsneEngine == TsneEngine::HIERARCHY)
+        refinement.computeEmbedding->setTsneEngine(TsneEngine::BARNES_HUT);
+    else
+        refinement.computeEmbedding->setTsneEngine(refinement.tsneEngine);
+
+    ComputeEmbeddingWrapper* computeEmbedding = refinement.computeEmbedding.get();
+    TsneComputationAction* computationAction = refinement.computationAction;
+
+    // Update embedding points when the TSNE analysis produces new data
+    connect(computeEmbedding, &ComputeEmbeddingWrapper::embeddingUpdate, this, [this, &refinement](const sph::vf32& emb) {
+        auto& refineEmbedding = refinement.embedding;
         refineEmbedding->setData(emb.data(), emb.size() / 2, 2);
         mv::events().notifyDatasetDataChanged(refineEmbedding);
 
-        auto refinedRefinedSelectionMapping = _refinedRefinedSelectionMappings.back();
-        extractEmbPositions(refineEmbedding, refinedRefinedSelectionMapping->getMappingLevelToData(), _sphPlugin->getImageSize(), refinedRefinedSelectionMapping->getImgColoredByEmb());
+        const auto* selectionMapping = refinement.selectionMapping;
+        extractEmbPositions(refineEmbedding, selectionMapping->getLevelMappingLevelToData(), selectionMapping->getLevelIDs(), _sphPlugin->getImageSize(), refinement.imageRect, refinement.recolorData);
         });
 
-    _computeEmbedding.setNumIterations(0);
-    _computeEmbedding.startComputation(_refinedTransitionMatrix, tSNEParams);
+    connect(computeEmbedding, &ComputeEmbeddingWrapper::workerStarted, computationAction, &TsneComputationAction::setStarted);
+    connect(computeEmbedding, &ComputeEmbeddingWrapper::workerEnded, computationAction, &TsneComputationAction::setFinished);
+}
+
+void RefineAction::connectRefinement(Refinement& refinement)
+{
+    TsneComputationAction* computationAction = refinement.computationAction;
+
+    // The compute wrapper is re-created when an evicted refinement is computed again, always access it through the refinement
+    connect(&computationAction->getStopComputationAction(), &TriggerAction::triggered, this, [&refinement](bool checked) {
+        if (refinement.computeEmbedding)
+            refinement.computeEmbedding->stopComputation();
+        });
+
+    connect(&computationAction->getContinueComputationAction(), &TriggerAction::triggered, this, [this, &refinement](bool checked) {
+        const auto numIterations = static_cast<uint32_t>(_refineTsneSettingsAction->getNumNewIterationsAction().getValue());
+
+        if (refinement.evicted)
+        {
+            if (!restoreRefinement(refinement))
+                return;
+
+            // continue from the current layout
+            std::vector<float> positions(refinement.levelIDs.size() * 2);
+            std::vector<uint32_t> embDims{ 0, 1 };
+            refinement.embedding->populateDataForDimensions(positions, embDims);
+            refinement.computeEmbedding->initEmbedding(refinement.level, refinement.levelIDs.size(), std::move(positions));
+
+            auto tSNEParams = refinement.tsneParams;
+            tSNEParams.numIterations = numIterations;
+            tSNEParams.gradDescentParams._remove_exaggeration_iter = 0;
+            tSNEParams.gradDescentParams._exponential_decay_iter = 0;
+            tSNEParams.gradDescentParams._mom_switching_iter = 0;
+
+            useRefinement(refinement);
+            refinement.computeEmbedding->setNumIterations(0);
+            refinement.computeEmbedding->startComputation(refinement.transitionMatrix, tSNEParams);
+            _sphPlugin->getSettingsAction().getRefineAction().enforceMemoryBudget();
+            return;
+        }
+
+        useRefinement(refinement);
+        refinement.computeEmbedding->continueComputation(numIterations);
+        });
+
+    connect(&computationAction->getRestartComputationAction(), &TriggerAction::triggered, this, [this, &refinement](bool checked) {
+        if (refinement.evicted)
+        {
+            if (!restoreRefinement(refinement))
+                return;
+        }
+        else
+            refinement.computeEmbedding->stopComputation();
+
+        // re-use the averages that were published for this refinement, they are in refined embedding order
+        std::vector<float> avgDataRefinedSuperpixels;
+        if (_refineTsneSettingsAction->getInitAction().getCurrentText() == "PCA") {
+            const auto& avgDataset = refinement.avgComponentDataSuper;
+            avgDataRefinedSuperpixels.resize(static_cast<size_t>(avgDataset->getNumPoints()) * avgDataset->getNumDimensions());
+            std::vector<uint32_t> dimensionIDs(avgDataset->getNumDimensions());
+            std::iota(dimensionIDs.begin(), dimensionIDs.end(), 0);
+            avgDataset->populateDataForDimensions<std::vector<float>, std::vector<uint32_t>>(avgDataRefinedSuperpixels, dimensionIDs);
+        }
+
+        initRefinedEmbedding(refinement, avgDataRefinedSuperpixels);
+
+        useRefinement(refinement);
+        refinement.computeEmbedding->setNumIterations(0);
+        refinement.computeEmbedding->startComputation(refinement.transitionMatrix, refinement.tsneParams);
+        _sphPlugin->getSettingsAction().getRefineAction().enforceMemoryBudget();
+        });
+
+    connect(&computationAction->getReoptimizeSelectionAction(), &TriggerAction::triggered, this, [this, &refinement](bool checked) {
+        reoptimizeSelection(refinement);
+        });
+
+    // The refinement the user interacts with is computed with priority and evicted last
+    connect(&refinement.embedding, &mv::Dataset<Points>::dataSelectionChanged, this, [this, &refinement]() {
+        useRefinement(refinement);
+        });
+
+    // Free everything once the user removes the refined embedding
+    connect(&refinement.embedding, &mv::Dataset<Points>::dataAboutToBeRemoved, this, [this, refinementID = refinement.id]() {
+        // the refinement owns the emitting dataset reference, remove it after the signal is handled
+        QMetaObject::invokeMethod(this, [this, refinementID]() { removeRefinement(refinementID); }, Qt::QueuedConnection);
+        });
+}
+
+void RefineAction::reoptimizeSelection(Refinement& refinement)
+{
+    const auto& selectionIndices = refinement.embedding->getSelection<Points>()->indices;
+
+    if (selectionIndices.empty())
+    {
+        Log::info("RefineAction::reoptimizeSelection: select points of the refined embedding first");
+        return;
+    }
+
+    // an evicted refinement is not restored, its transition matrix is only needed to gather the neighborhood
+    std::shared_ptr<const SubGraph> evictedSubGraph = nullptr;
+    if (refinement.evicted)
+    {
+        evictedSubGraph = recomputeSubGraph(refinement);
+        if (!evictedSubGraph)
+            return;
+    }
+    else
+        refinement.computeEmbedding->stopComputation();
+
+    std::vector<uint64_t> selection(selectionIndices.begin(), selectionIndices.end());
+    sph::utils::sortAndUnique(selection);
+
+    std::vector<float> positions(refinement.levelIDs.size() * 2);
+    std::vector<uint32_t> embDims{ 0, 1 };
+    refinement.embedding->populateDataForDimensions(positions, embDims);
+
+    const sph::SparseMatHDI& transitionMatrix = evictedSubGraph ? evictedSubGraph->transitionMatrix : refinement.transitionMatrix;
+    auto localOptimization = std::make_shared<LocalOptimization>(transitionMatrix, std::move(positions), selection);
+
+    // the continue iterations are zero by default, keep the default number of local iterations then
+    LocalOptimization::Settings settings;
+    if (const auto numIterations = _refineTsneSettingsAction->getNumNewIterationsAction().getValue(); numIterations > 0)
+        settings.numIterations = static_cast<uint32_t>(numIterations);
+
+    useRefinement(refinement);
+    refinement.computationAction->getReoptimizeSelectionAction().setEnabled(false);
+
+    _sphPlugin->getBackgroundTasks()->start([guard = QPointer<RefineAction>(this), refinementID = refinement.id, localOptimization, settings]() {
+        localOptimization->optimize(settings);
+
+        QMetaObject::invokeMethod(qApp, [guard, refinementID, localOptimization]() {
+            if (guard.isNull())
+                return;
+
+            // the refinement might have been removed in the meantime
+            Refinement* refinementPtr = guard->findRefinement(refinementID);
+            if (refinementPtr == nullptr)
+                return;
+
+            refinementPtr->computationAction->getReoptimizeSelectionAction().setEnabled(true);
+
+            // an evicted refinement continues from its dataset layout
+            if (refinementPtr->evicted)
+            {
+                const auto& emb = localOptimization->getEmbedding();
+                refinementPtr->embedding->setData(emb.data(), emb.size() / 2, 2);
+                mv::events().notifyDatasetDataChanged(refinementPtr->embedding);
+
+                const auto* selectionMapping = refinementPtr->selectionMapping;
+                extractEmbPositions(refinementPtr->embedding, selectionMapping->getLevelMappingLevelToData(), selectionMapping->getLevelIDs(), guard->_sphPlugin->getImageSize(), refinementPtr->imageRect, refinementPtr->recolorData);
+                return;
+            }
+
+            refinementPtr->computeEmbedding->replaceEmbedding(std::move(localOptimization->getEmbedding()));
+            }, Qt::QueuedConnection);
+        });
+}
+
+void RefineAction::useRefinement(Refinement& refinement)
+{
+    refinement.lastUsed = std::chrono::steady_clock::now();
+
+    if (refinement.computeEmbedding)
+        refinement.computeEmbedding->requestPriority();
+}
+
+std::shared_ptr<const SubGraph> RefineAction::recomputeSubGraph(const Refinement& refinement)
+{
+    // the level IDs are sorted and unique, extracting their sub graph yields the same embedding order
+    constexpr float exact = 1.f;
+    SubGraphCache* subGraphCache = _sphPlugin->getSubGraphCache();
+    auto subGraph = subGraphCache->find(refinement.level, refinement.levelIDs, exact);
+
+    if (!subGraph)
+    {
+        subGraph = SubGraphCache::extract(_sphPlugin->getComputeHierarchy()->getProbDistOnLevel(refinement.level), refinement.levelIDs, exact);
+        subGraphCache->insert(refinement.level, refinement.levelIDs, exact, subGraph);
+    }
+
+    if (subGraph->levelIDs != refinement.levelIDs)
+    {
+        Log::error("RefineAction::recomputeSubGraph: recomputed transition matrix does not match the refined embedding");
+        return nullptr;
+    }
+
+    return subGraph;
+}
+
+bool RefineAction::restoreRefinement(Refinement& refinement)
+{
+    assert(refinement.evicted);
+
+    const auto subGraph = recomputeSubGraph(refinement);
+    if (!subGraph)
+        return false;
+
+    refinement.transitionMatrix = subGraph->transitionMatrix;
+
+    refinement.evicted = false;
+    createComputeEmbedding(refinement);
+
+    Log::info("RefineAction::restoreRefinement: recomputed refinement on level {0} with {1} points", refinement.level, refinement.levelIDs.size());
+
+    return true;
+}
+
+void RefineAction::evictRefinement(Refinement& refinement)
+{
+    Log::info("RefineAction::evictRefinement: free {0} MB of refinement on level {1} with {2} points", refinement.reclaimableMemory() >> 20, refinement.level, refinement.levelIDs.size());
+
+    // the worker references the transition matrix, destroy it first
+    refinement.computeEmbedding.reset();
+    refinement.transitionMatrix = {};
+    refinement.evicted = true;
+
+    refinement.computationAction->setFinished();
+}
+
+RefineAction::Refinement* RefineAction::findRefinement(uint64_t refinementID)
+{
+    const auto it = std::ranges::find_if(_refinements, [refinementID](const auto& refinement) { return refinement->id == refinementID; });
+    return it == _refinements.end() ? nullptr : it->get();
+}
+
+void RefineAction::removeRefinement(uint64_t refinementID)
+{
+    const auto it = std::ranges::find_if(_refinements, [refinementID](const auto& refinement) { return refinement->id == refinementID; });
+
+    if (it == _refinements.end())
+        return;
+
+    const Refinement* refinement = it->get();
+
+    Log::info("RefineAction::removeRefinement: refinement on level {0} with {1} points was removed", refinement->level, refinement->levelIDs.size());
+
+    // actions were attached to the removed dataset
+    for (QObject* action : std::initializer_list<QObject*>{ refinement->selectionMapping, refinement->computationAction, refinement->refineAction, refinement->tsneSettingsAction })
+        if (action != nullptr)
+            action->deleteLater();
+
+    _refinements.erase(it);
+}
+
+void RefineAction::removeAllRefinements()
+{
+    _autoRefineTimer.stop();
+    _hierarchyVersion++;
+
+    for (auto& refinement : _refinements)
+    {
+        // nested refinements reference the same hierarchy
+        if (refinement->refineAction != nullptr)
+            refinement->refineAction->removeAllRefinements();
+
+        // the worker references the transition matrix, destroy it first
+        refinement->computeEmbedding.reset();
+
+        // removed here, not once the dataset removal is handled
+        disconnect(&refinement->embedding, nullptr, this, nullptr);
+
+        if (refinement->selectionMapping != nullptr)
+            refinement->selectionMapping->disconnectMappings();
+
+        for (QObject* action : std::initializer_list<QObject*>{ refinement->selectionMapping, refinement->computationAction, refinement->refineAction, refinement->tsneSettingsAction })
+            if (action != nullptr)
+                action->deleteLater();
+
+        mv::data().removeDataset(refinement->embedding);
+    }
+
+    if (!_refinements.empty())
+        Log::info("RefineAction::removeAllRefinements: removed {0} refinements of level {1}", _refinements.size(), _currentLevel);
+
+    _refinements.clear();
+}
+
+void RefineAction::collectRefinements(std::vector<Refinement*>& refinements)
+{
+    for (auto& refinement : _refinements)
+    {
+        refinements.push_back(refinement.get());
+
+        if (refinement->refineAction != nullptr)
+            refinement->refineAction->collectRefinements(refinements);
+    }
+}
+
+void RefineAction::enforceMemoryBudget()
+{
+    if (_sphPlugin == nullptr)
+        return;
+
+    const size_t memoryBudget = static_cast<size_t>(_sphPlugin->getSettingsAction().getAdvancedSettingsAction().getRefineComputeMemoryAction().getValue()) << 20;
+
+    std::vector<Refinement*> refinements;
+    collectRefinements(refinements);
+
+    size_t memoryUsed = 0;
+    for (const auto* refinement : refinements)
+        memoryUsed += refinement->reclaimableMemory();
+
+    if (memoryUsed <= memoryBudget)
+        return;
+
+    std::ranges::sort(refinements, {}, &Refinement::lastUsed);
+
+    // least recently used first, the most recently used refinement is always kept
+    for (size_t i = 0; i + 1 < refinements.size() && memoryUsed > memoryBudget; i++)
+    {
+        Refinement* refinement = refinements[i];
+
+        if (refinement->evicted)
+            continue;
+
+        memoryUsed -= refinement->reclaimableMemory();
+        evictRefinement(*refinement);
+    }
 }
@@ -6,12 +6,24 @@
 
 #include <actions/DecimalAction.h>
 #include <actions/GroupAction.h>
+#include <actions/IntegralAction.h>
+#include <actions/ToggleAction.h>
 #include <actions/TriggerAction.h>
 
 #include <Dataset.h>
 #include <PointData/PointData.h>
 
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <QRect>
+#include <QTimer>
+
 class SPHPlugin;
+struct SubGraph;
+class TsneComputationAction;
 class TsneSettingsAction;
 class RefinedSelectionMapping;
 class Images;
@@ -32,47 +44,146 @@ public: // Getter
 
 public: // Setter
     void setCurrentLevel(int64_t l) { _currentLevel = l; }
-    void setSPHPlugin(SPHPlugin* sph) { _sphPlugin = sph; }
+    void setSPHPlugin(SPHPlugin* sph);
     void setParentEmbedding(mv::Dataset<Points> data) { _parentEmbedding = data; }
     void setTsneSettingsAction(TsneSettingsAction* tset) { _refineTsneSettingsAction = tset; }
+    void setParentSelectionMapping(const RefinedSelectionMapping* mapping) { _parentSelectionMapping = mapping; }
+
+public:
+    /** Evicts the least recently used refinements of this refinement tree until their compute memory fits the budget set in the advanced settings, datasets are not counted */
+    void enforceMemoryBudget();
+
+    /** Removes all refinements of this refinement tree and their datasets, they reference the level mappings of the hierarchy */
+    void removeAllRefinements();
 
 public: // Action getters
 
     mv::gui::TriggerAction& getRefineAction() { return _refineAction; };
     mv::gui::DecimalAction& getExactRefinementAction() { return _exactRefinementAction; };
+    mv::gui::ToggleAction& getAutoRefineAction() { return _autoRefineAction; };
+    mv::gui::IntegralAction& getPointBudgetAction() { return _pointBudgetAction; };
 
 private slots:
     void refine();
-    
+
+    /** Refines the selected image region to the finest level that fits the point budget */
+    void autoRefine();
+
 private:
-    using Datasets = std::vector<mv::Dataset<Points>>;
-    using ImageDatasets = std::vector<mv::Dataset<Images>>;
-    using RefinedScaleActions = std::vector<RefineAction*>;
-    using TsneSettingsActions = std::vector<TsneSettingsAction*>;
-    using RefinedSelectionMappings = std::vector<RefinedSelectionMapping*>;
+    struct RefineRequest
+    {
+        int64_t                 refinedLevel = 0;       /** Level of the new refinement */
+        int64_t                 parentLevel = 0;        /** Level of the parent embedding when refine was requested */
+        uint64_t                hierarchyVersion = 0;   /** Refinements of an outdated hierarchy are discarded */
+        bool                    isAutoRefinement = false;
+        std::vector<uint64_t>   selection = {};         /** Selected superpixels on refinedLevel */
+    };
+
+    /** Extracts the sub graph of the selection on refinedLevel (in the background if not cached) and creates the refinement */
+    void refineToLevel(int64_t refinedLevel, bool isAutoRefinement);
+
+    /** Creates the refined embedding of the sub graph, its datasets and starts its computation */
+    void createRefinement(const RefineRequest& request, const SubGraph& subGraph);
+
+    /** All data of one refined embedding, each refinement computes its embedding independently */
+    struct Refinement
+    {
+        uint64_t                                    id = 0;                         /** Unique within its refine action, pending background results are matched by it */
+        int64_t                                     level = 0;                      /** Hierarchy level of the refined embedding */
+        int64_t                                     parentLevel = 0;                /** Hierarchy level of the parent embedding */
+        bool                                        isAutoRefinement = false;       /** Created by the level of detail mode, replaced by the next one */
+        std::vector<uint64_t>                       selection = {};                 /** Selected superpixels on level that were refined */
+        std::vector<uint64_t>                       levelIDs = {};                  /** Superpixel IDs on level, in refined embedding order */
+        sph::SparseMatHDI                           transitionMatrix = {};          /** Transition matrix between levelIDs */
+        sph::TsneEmbeddingParameters                tsneParams = {};                /** t-SNE settings at refine time */
+        TsneEngine                                  tsneEngine = TsneEngine::LIBRARY;   /** t-SNE gradient descent engine at refine time */
+        QRect                                       imageRect = {};                 /** Bounding rectangle of the refined image region, pixel level datasets only cover it */
+        std::unique_ptr<ComputeEmbeddingWrapper>    computeEmbedding = nullptr;     /** Job handle in the embedding service */
+
+        mv::Dataset<Points>                         embedding = {};                 /** Refine embedding dataset */
+        mv::Dataset<Points>                         recolorData = {};               /** Refine embedding recolor data based on scatter layout */
+        mv::Dataset<Images>                         recolorImage = {};              /** Refine embedding recolor image based on scatter layout */
+        mv::Dataset<Points>                         representedSize = {};           /** Refine embedding represented data size */
+        mv::Dataset<Points>                         transitionEntries = {};         /** Refine embedding non-zero transition entries */
+        mv::Dataset<Points>                         avgComponentDataSuper = {};     /** Average data of superpixels */
+        mv::Dataset<Points>                         avgComponentDataPixel = {};     /** Average data of superpixels mapped to pixels (data values) */
+        mv::Dataset<Images>                         avgComponentDataPixelImg = {};  /** Average data of superpixels mapped to pixels (image) */
+
+        RefinedSelectionMapping*                    selectionMapping = nullptr;     /** Selection maps between refine embedding and data */
+        TsneComputationAction*                      computationAction = nullptr;    /** Stop, continue and restart of this refinement */
+        RefineAction*                               refineAction = nullptr;         /** Refine the refinement, only if level > data level */
+        TsneSettingsAction*                         tsneSettingsAction = nullptr;   /** t-SNE settings for refining the refinement */
+
+        std::chrono::steady_clock::time_point       lastUsed = {};                  /** Last refine, computation or selection */
+        bool                                        evicted = false;                /** Transition matrix and embedding job are freed, datasets are kept */
+
+        /** Bytes of the transition matrix and the embedding job, which are freed on eviction. Datasets are owned by the core */
+        size_t reclaimableMemory() const {
+            if (evicted)
+                return 0;
+
+            size_t numEntries = 0;
+            for (const auto& row : transitionMatrix)
+                numEntries += row.size();
+
+            // embedding, gradient, gains and previous gradient of the gradient descent
+            const size_t numEmbeddingValues = computeEmbedding ? levelIDs.size() * 2 * 4 : 0;
+
+            return numEntries * (sizeof(uint32_t) + sizeof(float)) + numEmbeddingValues * sizeof(float);
+        }
+    };
+
+    /** Sets the init embedding of the refinement according to the refine t-SNE settings */
+    void initRefinedEmbedding(Refinement& refinement, const std::vector<float>& avgDataRefinedSuperpixels);
+
+    /** Positions of the parent superpixels in the parent embedding, scaled to one and jittered. Empty if not available */
+    std::vector<float> computeParentLayoutInit(const Refinement& refinement) const;
+
+    /** Creates the compute wrapper of the refinement and connects it with its datasets and computation action */
+    void createComputeEmbedding(Refinement& refinement);
+
+    /** Connects the computation actions and dataset signals of the refinement */
+    void connectRefinement(Refinement& refinement);
+
+    /** Re-optimizes the selected points of the refined embedding and their neighbors in the background, all other points stay fixed */
+    void reoptimizeSelection(Refinement& refinement);
+
+    /** Marks the refinement as used and prioritizes its computation */
+    void useRefinement(Refinement& refinement);
+
+    /** Sub graph of the refinement levelIDs from the cache or extracted again, nullptr if it does not match the refinement */
+    std::shared_ptr<const SubGraph> recomputeSubGraph(const Refinement& refinement);
+
+    /** Recomputes the transition matrix of an evicted refinement from its level IDs and creates a new compute wrapper */
+    bool restoreRefinement(Refinement& refinement);
+
+    static void evictRefinement(Refinement& refinement);
+
+    /** Frees a refinement whose refined embedding was removed from the core */
+    void removeRefinement(uint64_t refinementID);
+
+    /** nullptr if the refinement was removed in the meantime */
+    Refinement* findRefinement(uint64_t refinementID);
+
+    /** All refinements of this action and its nested refine actions */
+    void collectRefinements(std::vector<Refinement*>& refinements);
 
 private: // UI elements
     mv::gui::TriggerAction      _refineAction;                  /** Refine button */
     mv::gui::DecimalAction      _exactRefinementAction;         /** Refine button */
+    mv::gui::ToggleAction       _autoRefineAction;              /** Level of detail mode */
+    mv::gui::IntegralAction     _pointBudgetAction;             /** Maximum number of points of an automatic refinement */
 
 private:
     SPHPlugin*                  _sphPlugin = nullptr;
+    mv::Dataset<Points>         _inputData = {};                                /** Its selection is the region of interest for automatic refinement */
+    QTimer                      _autoRefineTimer = {};                          /** Refines automatically once the selection settles */
     int64_t                     _currentLevel = 0;
 
-    sph::SparseMatHDI           _refinedTransitionMatrix = {};
-    ComputeEmbeddingWrapper     _computeEmbedding = { "Refine Embedding" };
     TsneSettingsAction*         _refineTsneSettingsAction = nullptr;
     mv::Dataset<Points>         _parentEmbedding = {};                          /** Parent embedding dataset references */
-    Datasets                    _refinedEmbeddings = {};                        /** Refine embedding dataset references */
-    Datasets                    _refinedRecolorData = {};                       /** Refine embedding recolor data based on scatter layout */
-    ImageDatasets               _refinedRecolorImages = {};                     /** Refine embedding recolor images based on scatter layout */
-    Datasets                    _refinedRepresentedSizes = {};                  /** Refine embedding represented data size dataset references */
-    Datasets                    _refinedTransitionEntriess = {};                /** Refine embedding non-zero transition entries */
-    RefinedScaleActions         _refinedScaleActions = {};                      /** Refine embedding scale actions  */
-    TsneSettingsActions         _refinedTsneSettingsActions = {};               /** Refine embedding tsne settings actions */
-    RefinedSelectionMappings    _refinedRefinedSelectionMappings = {};          /** Refine embedding selection maps */
-
-    Datasets                    _avgComponentDatasSuper = { };                  /** Average data of superpixels */
-    Datasets                    _avgComponentDatasPixel = { };                  /** Average data of superpixels mapped to pixels (data values) */
-    ImageDatasets               _avgComponentDatasPixelImg = { };               /** Average data of superpixels mapped to pixels (image) */
+    const RefinedSelectionMapping* _parentSelectionMapping = nullptr;           /** Maps data to parent embedding if the parent is a refinement itself */
+    uint64_t                    _hierarchyVersion = 0;                          /** Incremented whenever all refinements are removed for a new hierarchy */
+    uint64_t                    _nextRefinementID = 0;
+    std::vector<std::unique_ptr<Refinement>> _refinements = {};                 /** All refinements of the parent embedding */
 };
@@ -2,11 +2,15 @@
 
 #include "Utils.h"
 
+#include <sph/utils/Algorithms.hpp>
 #include <sph/utils/Logger.hpp>
 
 #include <Dataset.h>
 #include <Set.h>
 
+#include <cassert>
+#include <iterator>
+
 using namespace sph;
 
 RefinedSelectionMapping::RefinedSelectionMapping(QObject* parent) :
@@ -40,6 +44,91 @@ void RefinedSelectionMapping::setAvgComponentDataPixel(const mv::Dataset<Points>
     connect(&_avgComponentDataPixel, &mv::Dataset<mv::DatasetImpl>::dataSelectionChanged, this, &RefinedSelectionMapping::onSelectionInPixelAverages);
 }
 
+void RefinedSelectionMapping::setMappings(const sph::vvui64* levelMappingLevelToData, const sph::vui64* levelMappingDataToLevel, const std::vector<uint64_t>& levelIDs)
+{
+    _levelMappingLevelToData = levelMappingLevelToData;
+    _levelMappingDataToLevel = levelMappingDataToLevel;
+    _levelIDs = levelIDs;
+
+    _levelToRefinedIDs.clear();
+    _levelToRefinedIDs.reserve(_levelIDs.size());
+
+    for (uint64_t refinedID = 0; refinedID < _levelIDs.size(); refinedID++)
+        _levelToRefinedIDs[_levelIDs[refinedID]] = refinedID;
+}
+
+void RefinedSelectionMapping::disconnectMappings()
+{
+    for (mv::Dataset<Points>* dataset : { &_inputData, &_levelEmbedding, &_dataColoredByLevelEmb, &_avgComponentDataPixel })
+        disconnect(dataset, nullptr, this, nullptr);
+
+    _levelMappingLevelToData = nullptr;
+    _levelMappingDataToLevel = nullptr;
+}
+
+void RefinedSelectionMapping::mapSelectionDataToRefined(const mv::Dataset<Points>& selectionInputData, mv::Dataset<Points> selectionOutputData, bool inputCoversImageRect) const
+{
+    // if there is nothing to be mapped, don't do anything
+    if (_levelIDs.empty())
+        return;
+
+    assert(inputCoversImageRect || _levelMappingDataToLevel->size() == selectionInputData->getNumPoints());
+
+    const auto& pixelSelectionIDs = selectionInputData->getSelection<Points>()->indices;
+
+    std::vector<uint32_t> selectionIndices;
+    selectionIndices.reserve(pixelSelectionIDs.size());
+
+    for (const auto selectionIndex : pixelSelectionIDs)
+    {
+        const uint64_t dataID = inputCoversImageRect ? rectToImageID(selectionIndex, _imageSize.width(), _imageRect) : selectionIndex;
+        const uint64_t refinedID = getRefinedID(dataID);
+        if (refinedID == std::numeric_limits<uint64_t>::max())    // not part of refinement
+            continue;
+
+        selectionIndices.push_back(static_cast<uint32_t>(refinedID));
+    }
+
+    utils::sortAndUnique(selectionIndices);
+
+    selectionOutputData->getSelection<Points>()->indices = std::move(selectionIndices);
+
+    // the selection change is handled synchronously, listeners can tell it apart from user selections in the input
+    _forwardingDepth++;
+    mv::events().notifyDatasetDataSelectionChanged(selectionOutputData);
+    _forwardingDepth--;
+}
+
+void RefinedSelectionMapping::mapSelectionRefinedToData(const mv::Dataset<Points>& selectionInputData, mv::Dataset<Points> selectionOutputData) const
+{
+    // if there is nothing to be mapped, don't do anything
+    if (_levelIDs.empty())
+        return;
+
+    assert(_levelIDs.size() == selectionInputData->getNumPoints());
+
+    const auto& refinedSelectionIDs = selectionInputData->getSelection<Points>()->indices;
+
+    std::vector<uint32_t> selectionIndices;
+    selectionIndices.reserve(refinedSelectionIDs.size()); // this is very conservative
+
+    for (const auto selectionIndex : refinedSelectionIDs)
+    {
+        const auto& dataIDs = getDataIDs(selectionIndex);
+
+        std::transform(dataIDs.begin(),
+            dataIDs.end(),
+            std::back_inserter(selectionIndices),
+            [](const auto& val) { return static_cast<uint32_t>(val); }
+        );
+    }
+
+    utils::sortAndUnique(selectionIndices);
+
+    selectionOutputData->getSelection<Points>()->indices = std::move(selectionIndices);
+    mv::events().notifyDatasetDataSelectionChanged(selectionOutputData);
+}
+
 void RefinedSelectionMapping::onSelectionInInputData()
 {
     const bool allIsSync = areLocksInSync();
@@ -57,13 +146,13 @@ void RefinedSelectionMapping::onSelectionInInputData()
     markAsHandled(SelectionDatasets::INPUT);
 
     if (isNotYetHandled(SelectionDatasets::EMBEDDING))
-        selectionMapping(_inputData, &_mappingDataToLevel, _levelEmbedding);
+        mapSelectionDataToRefined(_inputData, _levelEmbedding);
 
     if (isNotYetHandled(SelectionDatasets::RECOLOR_IMAGE))
-        copySelection(_inputData, _dataColoredByLevelEmb);
+        copySelectionToRect(_inputData, _imageSize, _imageRect, _dataColoredByLevelEmb);
 
     if (isNotYetHandled(SelectionDatasets::AVERAGES))
-        copySelection(_inputData, _avgComponentDataPixel);
+        copySelectionToRect(_inputData, _imageSize, _imageRect, _avgComponentDataPixel);
 
 }
 
@@ -84,13 +173,13 @@ void RefinedSelectionMapping::onSelectionInLevelEmbedding()
     markAsHandled(SelectionDatasets::EMBEDDING);
 
     if (isNotYetHandled(SelectionDatasets::INPUT))
-        selectionMapping(_levelEmbedding, &_mappingLevelToData, _inputData);
+        mapSelectionRefinedToData(_levelEmbedding, _inputData);
 
     if (isNotYetHandled(SelectionDatasets::RECOLOR_IMAGE))
-        copySelection(_inputData, _dataColoredByLevelEmb);
+        copySelectionToRect(_inputData, _imageSize, _imageRect, _dataColoredByLevelEmb);
 
     if (isNotYetHandled(SelectionDatasets::AVERAGES))
-        copySelection(_inputData, _avgComponentDataPixel);
+        copySelectionToRect(_inputData, _imageSize, _imageRect, _avgComponentDataPixel);
 }
 
 void RefinedSelectionMapping::onSelectionInColoredByEmb()
@@ -110,13 +199,13 @@ void RefinedSelectionMapping::onSelectionInColoredByEmb()
     markAsHandled(SelectionDatasets::RECOLOR_IMAGE);
 
     if (isNotYetHandled(SelectionDatasets::EMBEDDING))
-        selectionMapping(_dataColoredByLevelEmb, &_mappingDataToLevel, _levelEmbedding);
+        mapSelectionDataToRefined(_dataColoredByLevelEmb, _levelEmbedding, true);
 
     if (isNotYetHandled(SelectionDatasets::INPUT))
-        selectionMapping(_levelEmbedding, &_mappingLevelToData, _inputData);
+        mapSelectionRefinedToData(_levelEmbedding, _inputData);
 
     if (isNotYetHandled(SelectionDatasets::AVERAGES))
-        copySelection(_inputData, _avgComponentDataPixel);
+        copySelectionToRect(_inputData, _imageSize, _imageRect, _avgComponentDataPixel);
 
 }
 
@@ -137,12 +226,12 @@ void RefinedSelectionMapping::onSelectionInPixelAverages()
     markAsHandled(SelectionDatasets::AVERAGES);
 
     if (isNotYetHandled(SelectionDatasets::EMBEDDING))
-        selectionMapping(_avgComponentDataPixel, &_mappingDataToLevel, _levelEmbedding);
+        mapSelectionDataToRefined(_avgComponentDataPixel, _levelEmbedding, true);
 
     if (isNotYetHandled(SelectionDatasets::INPUT))
-        selectionMapping(_levelEmbedding, &_mappingLevelToData, _inputData);
+        mapSelectionRefinedToData(_levelEmbedding, _inputData);
 
     if (isNotYetHandled(SelectionDatasets::RECOLOR_IMAGE))
-        copySelection(_inputData, _dataColoredByLevelEmb);
+        copySelectionToRect(_inputData, _imageSize, _imageRect, _dataColoredByLevelEmb);
 
 }
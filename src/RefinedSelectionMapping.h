@@ -7,10 +7,15 @@
 
 #include <sph/utils/CommonDefinitions.hpp>
 
+#include <ankerl/unordered_dense.h>
+
 #include <algorithm>
 #include <array>
 #include <cstdint>
+#include <limits>
+#include <vector>
 
+#include <QRect>
 #include <QSize>
 
 /// ///////////////////////// ///
@@ -39,20 +44,47 @@ public: // Setter
     void setImgColoredByEmb(const mv::Dataset<Points>& col);
     void setAvgComponentDataPixel(const mv::Dataset<Points>& avgs);
     
-    void setMappingLevelToData(sph::vvui64&& map) { 
-        _mappingLevelToData = std::move(map); 
-    }
-    void setMappingDataToLevel(sph::vui64&& map) { 
-        _mappingDataToLevel = std::move(map); 
+    /** The refinement references the mappings of its hierarchy level, they must outlive this object */
+    void setMappings(const sph::vvui64* levelMappingLevelToData, const sph::vui64* levelMappingDataToLevel, const std::vector<uint64_t>& levelIDs);
+
+    /** Stops mapping selections, before the hierarchy that the mappings reference is rewritten */
+    void disconnectMappings();
+
+    /** Recolor and pixel average datasets only cover imageRect of the input image */
+    void setImageRect(const QSize& imageSize, const QRect& imageRect) {
+        _imageSize = imageSize;
+        _imageRect = imageRect;
     }
 
 public: // Getter
-    const sph::vvui64& getMappingLevelToData() const { 
-        return _mappingLevelToData; 
+    /** True while a selection in a refined embedding is forwarded to the input data */
+    static bool isForwardingRefinedSelection() {
+        return _forwardingDepth > 0;
+    }
+
+    const QRect& getImageRect() const {
+        return _imageRect;
+    }
+
+    /** Superpixel IDs on the hierarchy level, in refined embedding order */
+    const std::vector<uint64_t>& getLevelIDs() const {
+        return _levelIDs;
     }
 
-    const sph::vui64& getMappingDataToLevel() const { 
-        return _mappingDataToLevel; 
+    /** Mapping of the whole hierarchy level, index with getLevelIDs() */
+    const sph::vvui64& getLevelMappingLevelToData() const {
+        return *_levelMappingLevelToData;
+    }
+
+    /** Image IDs represented by a refined embedding point */
+    const sph::vui64& getDataIDs(uint64_t refinedID) const {
+        return (*_levelMappingLevelToData)[_levelIDs[refinedID]];
+    }
+
+    /** Refined embedding point that represents an image ID, std::numeric_limits<uint64_t>::max() if it is not part of the refinement */
+    uint64_t getRefinedID(uint64_t dataID) const {
+        const auto it = _levelToRefinedIDs.find((*_levelMappingDataToLevel)[dataID]);
+        return it == _levelToRefinedIDs.end() ? std::numeric_limits<uint64_t>::max() : it->second;
     }
 
     mv::Dataset<Points>& getImgColoredByEmb() { 
@@ -69,6 +101,10 @@ private:
     void onSelectionInColoredByEmb();
     void onSelectionInPixelAverages();
 
+    // selection mappings through the level mappings
+    void mapSelectionDataToRefined(const mv::Dataset<Points>& selectionInputData, mv::Dataset<Points> selectionOutputData, bool inputCoversImageRect = false) const;
+    void mapSelectionRefinedToData(const mv::Dataset<Points>& selectionInputData, mv::Dataset<Points> selectionOutputData) const;
+
 private: // locking
 
     inline void markAsHandled(const SelectionDatasets& dataLock) {
@@ -89,8 +125,16 @@ private:
     mv::Dataset<Points>     _dataColoredByLevelEmb = { };
     mv::Dataset<Points>     _avgComponentDataPixel = { };
 
-    sph::vvui64             _mappingLevelToData = {};               /** Maps embedding indices to bottom indices (in image). The embedding indices refer to their position in the dataset vector */
-    sph::vui64              _mappingDataToLevel = {};               /** Maps bottom indices (in image) to embedding indices. The embedding indices refer to their position in the dataset vector */
+    using hashmap = ankerl::unordered_dense::map<uint64_t, uint64_t>;
+
+    const sph::vvui64*      _levelMappingLevelToData = nullptr;     /** Maps level indices to bottom indices (in image) of the whole hierarchy level */
+    const sph::vui64*       _levelMappingDataToLevel = nullptr;     /** Maps bottom indices (in image) to level indices of the whole hierarchy level */
+    std::vector<uint64_t>   _levelIDs = {};                         /** Maps refined embedding indices to level indices. The embedding indices refer to their position in the dataset vector */
+    hashmap                 _levelToRefinedIDs = {};                /** Maps level indices to refined embedding indices, only contains the refined superpixels */
+    QSize                   _imageSize = {};                        /** Size of the input image */
+    QRect                   _imageRect = {};                        /** Image region covered by _dataColoredByLevelEmb and _avgComponentDataPixel */
 
     std::array<uint64_t, 5> _selectionCounters = { 0, 0, 0, 0, 0 };      /** Prevents endless selection loop */
+
+    static inline int       _forwardingDepth = 0;                   /** Nesting of selections forwarded from refined embeddings to the input data */
 };
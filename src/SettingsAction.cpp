@@ -14,6 +14,7 @@ SettingsAction::SettingsAction(SPHPlugin* parent) :
     setText("Spatial Hierarchy");
 
     _refineTsneSettingsAction.getTsneComputeAction().setEnabled(false);
+    _refineTsneSettingsAction.addParentLayoutInitOption();
 
     addAction(&_hierarchySettingsAction);
     addAction(&_tsneSettingsAction);
@@ -31,6 +32,7 @@ SettingsAction::SettingsAction(SPHPlugin* parent) :
         _tsneSettingsAction.getExaggerationFactorAction().setEnabled(doTSNE);
         _tsneSettingsAction.getExaggerationToggleAction().setEnabled(doTSNE);
         _tsneSettingsAction.getGradientDescentTypeAction().setEnabled(doTSNE);
+        _tsneSettingsAction.getTsneComputeAction().getReoptimizeSelectionAction().setEnabled(doTSNE);
 
         if(doTSNE)
             _tsneSettingsAction.getNumDefaultUpdateIterationsAction().setValue(1000);
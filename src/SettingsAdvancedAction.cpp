@@ -1,5 +1,7 @@
 #include "SettingsAdvancedAction.h"
 
+#include "EmbeddingService.h"
+
 #include <sph/NearestNeighbors.hpp>
 
 using namespace sph;
@@ -23,7 +25,13 @@ AdvancedSettingsAction::AdvancedSettingsAction(QObject* parent) :
     _mergeWithAllAboveAction(this, "Merge with multiple", false),
     _maxDistAction(this, "Minimum Sim", 0.f, 1.f, 0.f, 3),
     _randomWalkReductionAction(this, "RW reduciton"),
-    _normSchemeAction(this, "Norm scheme")
+    _normSchemeAction(this, "Norm scheme"),
+    _numEmbeddingThreadsAction(this, "Embedding threads"),
+    _refineComputeMemoryAction(this, "Refine compute memory (MB)"),
+    _landmarkEmbeddingAction(this, "Landmark embedding", false),
+    _maxLandmarksAction(this, "Max. landmarks"),
+    _landmarkPolishIterAction(this, "Landmark polish iter."),
+    _averagePrecisionAction(this, "Average precision")
 {
     setText("Advanced");
     setObjectName("Advanced");
@@ -45,6 +53,12 @@ AdvancedSettingsAction::AdvancedSettingsAction(QObject* parent) :
     addAction(&_mergeWithAllAboveAction);
     addAction(&_percentileOrValeAction);
     addAction(&_maxDistAction);
+    addAction(&_numEmbeddingThreadsAction);
+    addAction(&_refineComputeMemoryAction);
+    addAction(&_landmarkEmbeddingAction);
+    addAction(&_maxLandmarksAction);
+    addAction(&_landmarkPolishIterAction);
+    addAction(&_averagePrecisionAction);
 
     _knnIndexTypeAction.setToolTip("knn index:\n>10'000: IVFFlat\n>100'000: HNSW\n >1'000'000 IVFFlat_HNSW\n>50'000'000: HNSW_IVFPQ\nsmall data: BruteForce");
     _randomWalkReductionAction.setToolTip("Random walk reduction setting");
@@ -63,11 +77,18 @@ AdvancedSettingsAction::AdvancedSettingsAction(QObject* parent) :
     _percentileOrValeAction.setToolTip("Interpret min sim as percentile or value");
     _mergeWithAllAboveAction.setToolTip("Merge with all spatial neighbors whose sim is above threshold.\nOtherwise merge the most similar neighbor");
     _maxDistAction.setToolTip("Maximum distance value for merging");
+    _numEmbeddingThreadsAction.setToolTip("Number of worker threads (each with one OpenGL context) shared by all embeddings and refinements.\nChanges apply to embeddings that are started afterwards.");
+    _landmarkEmbeddingAction.setToolTip("Levels with more points than Max. landmarks are embedded in two steps:\nthe finest coarser level with fewer points is embedded and all points are placed by their ancestors on that level,\nafterwards a short t-SNE polishes the layout.");
+    _maxLandmarksAction.setToolTip("Levels with more points are embedded via landmarks");
+    _landmarkPolishIterAction.setToolTip("t-SNE iterations (without exaggeration) after placing all points by the landmarks");
+    _averagePrecisionAction.setToolTip("Element type of the superpixel average datasets.\nbfloat16 halves their memory and keeps about three significant digits, applies to averages that are computed afterwards.");
+    _refineComputeMemoryAction.setToolTip("Memory for transition matrices and embedding jobs of all refinements.\nAbove it, the least recently used refinements are evicted and recomputed when continued or restarted.\nThe datasets of refinements are not counted, they are kept until the refined embedding is removed.");
 
     _normDataAction.initialize(QStringList({ "NONE", "STANDARD", "ROBUST" }), "NONE");
     _knnIndexTypeAction.initialize(QStringList({ "BruteForce", "Flat", "IVFFlat", "HNSW", "HNSWSQ", "IVFFlat_HNSW", "HNSW_IVFPQ", "Auto" }), "Auto");
     _randomWalkReductionAction.initialize(QStringList({ "NONE", "PROPORTIONAL", "PROPORTIONAL_HALF", "PROPORTIONAL_DOUBLE", "CONSTANT", "CONSTANT_LOW", "CONSTANT_HIGH" }), "PROPORTIONAL");
     _normSchemeAction.initialize(QStringList({ "t-SNE", "UMAP" }), "t-SNE");
+    _averagePrecisionAction.initialize(QStringList({ "float32", "bfloat16" }), "float32");
 
     _pruneTransitionValueAction.initialize(0.f, 1.0f, 0.f, 4);
     _pruneTransitionValueAction.setSingleStep(0.0001f);
@@ -82,6 +103,13 @@ AdvancedSettingsAction::AdvancedSettingsAction(QObject* parent) :
     _minReductionAction.initialize(0.f, 1.0f, 0.98f, 4);
     _minReductionAction.setSingleStep(0.0001f);
 
+    _numEmbeddingThreadsAction.initialize(1, 64, static_cast<int32_t>(EmbeddingService::defaultPoolSize()));
+
+    _refineComputeMemoryAction.initialize(64, 65536, 2048);
+
+    _maxLandmarksAction.initialize(1'000, 10'000'000, 250'000);
+    _landmarkPolishIterAction.initialize(1, 10000, 250);
+
     _maxDistAction.setSingleStep(0.01f);
     _maxDistAction.setEnabled(true);
 
@@ -104,6 +132,11 @@ AdvancedSettingsAction::AdvancedSettingsAction(QObject* parent) :
         _alwaysMergeAction.setEnabled(enabled);
         _connectedKnnAction.setEnabled(enabled);
         _symmetricKnnAction.setEnabled(enabled);
+        _numEmbeddingThreadsAction.setEnabled(enabled);
+        _landmarkEmbeddingAction.setEnabled(enabled);
+        _maxLandmarksAction.setEnabled(enabled);
+        _landmarkPolishIterAction.setEnabled(enabled);
+        _averagePrecisionAction.setEnabled(enabled);
 
         };
 
@@ -156,3 +189,8 @@ float AdvancedSettingsAction::getMaxDistanceSetting() const
 
     return minSim;
 }
+
+AveragePrecision AdvancedSettingsAction::getAveragePrecision() const
+{
+    return _averagePrecisionAction.getCurrentIndex() == 1 ? AveragePrecision::BFLOAT16 : AveragePrecision::FLOAT32;
+}
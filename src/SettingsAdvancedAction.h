@@ -6,6 +6,8 @@
 #include <actions/OptionAction.h>
 #include <actions/ToggleAction.h>
 
+#include "Utils.h"
+
 #include <sph/utils/Settings.hpp>
 
 #include <cstdint>
@@ -24,6 +26,7 @@ public:
 
     sph::utils::KnnIndex getDataIndexSetting() const;
     float getMaxDistanceSetting() const;
+    AveragePrecision getAveragePrecision() const;
 
 public: // Setter
     void setNumDataPoints(int64_t numberDataPoints) { _numDataPoints = numberDataPoints; }
@@ -47,6 +50,12 @@ public: // Action getters
     DecimalAction& getMaxDistanceSlider() { return _maxDistAction; }
     OptionAction& getRandomWalkReductionAction() { return _randomWalkReductionAction; }
     OptionAction& getNormSchemeAction() { return _normSchemeAction; }
+    IntegralAction& getNumEmbeddingThreadsAction() { return _numEmbeddingThreadsAction; }
+    IntegralAction& getRefineComputeMemoryAction() { return _refineComputeMemoryAction; }
+    ToggleAction& getLandmarkEmbeddingAction() { return _landmarkEmbeddingAction; }
+    IntegralAction& getMaxLandmarksAction() { return _maxLandmarksAction; }
+    IntegralAction& getLandmarkPolishIterAction() { return _landmarkPolishIterAction; }
+    OptionAction& getAveragePrecisionAction() { return _averagePrecisionAction; }
 
 protected:
     OptionAction            _normDataAction;                /** Whether to normalize the data  */
@@ -66,6 +75,12 @@ protected:
     DecimalAction           _maxDistAction;                 /** Minimal similarity */
     OptionAction            _randomWalkReductionAction;     /** RandomWalk Reduction */
     OptionAction            _normSchemeAction;              /** Whether to norm data for t-SNE or UMAP */
+    IntegralAction          _numEmbeddingThreadsAction;     /** Number of worker threads (and GL contexts) shared by all embeddings */
+    IntegralAction          _refineComputeMemoryAction;     /** Compute memory (MB) of all refinements before the least recently used ones are evicted */
+    ToggleAction            _landmarkEmbeddingAction;       /** Embed large levels via the embedding of a coarser level */
+    IntegralAction          _maxLandmarksAction;            /** Levels with more points are embedded via landmarks */
+    IntegralAction          _landmarkPolishIterAction;      /** t-SNE iterations after placing all points by the landmarks */
+    OptionAction            _averagePrecisionAction;        /** Element type of the average datasets */
     
 private:
     int64_t                 _numDataPoints;
@@ -1,5 +1,7 @@
 #include "SettingsTsneAction.h"
 
+#include "ComputeEmbeddingWrapper.h"
+
 using namespace sph;
 using namespace mv::gui;
 
@@ -19,6 +21,7 @@ TsneSettingsAction::TsneSettingsAction(QObject* parent, std::string title) :
     _iterationsPublishExtendAction(this, "Set Ref. extends at"),
     _publishExtendsOnceAction(this, "Set Ref. extends once", true),
     _initAction(this, "Init embedding with..."),
+    _pcaSampleSizeAction(this, "PCA sample size"),
     _numComputedIterationsAction(this, "Computed iterations"),
     _gradientDescentTypeAction(this, "GD implementation"),
     _ignoreAdjustToLowNumberOfPointsAction(this, "Keep GD impl.", false),
@@ -33,6 +36,7 @@ TsneSettingsAction::TsneSettingsAction(QObject* parent, std::string title) :
     addAction(&_iterationsPublishExtendAction);
     addAction(&_publishExtendsOnceAction);
     addAction(&_initAction);
+    addAction(&_pcaSampleSizeAction);
     addAction(&_numNewIterationsAction);
     addAction(&_numDefaultUpdateIterationsAction);
     addAction(&_numComputedIterationsAction);
@@ -47,6 +51,7 @@ TsneSettingsAction::TsneSettingsAction(QObject* parent, std::string title) :
     _numNewIterationsAction.setDefaultWidgetFlags(IntegralAction::SpinBox);
     _numDefaultUpdateIterationsAction.setDefaultWidgetFlags(IntegralAction::SpinBox);
     _iterationsPublishExtendAction.setDefaultWidgetFlags(IntegralAction::SpinBox);
+    _pcaSampleSizeAction.setDefaultWidgetFlags(IntegralAction::SpinBox);
 
     _numDefaultUpdateIterationsAction.initialize(0, 10000, 1000u);
     _numNewIterationsAction.initialize(0, 10000, 0);
@@ -54,7 +59,8 @@ TsneSettingsAction::TsneSettingsAction(QObject* parent, std::string title) :
     _exaggerationIterAction.initialize(0, 10000, 250);
     _exponentialDecayAction.initialize(0, 10000, 70);
     _exaggerationFactorAction.initialize(0, 100, 4, 2);
-    _gradientDescentTypeAction.initialize({ "GPU (Compute)", "GPU (Raster)", "CPU" });
+    _pcaSampleSizeAction.initialize(0, 10'000'000, 50'000);
+    _gradientDescentTypeAction.initialize({ "GPU (Compute)", "GPU (Raster)", "CPU", "CPU (FFT)", "CPU (Barnes-Hut, parallel)", "CPU (Hierarchy)" });
     _initAction.initialize({ "Random", "PCA", "Spectral" }, "Random");
 
     _numComputedIterationsAction.initialize(0, 100000, 0);
@@ -66,8 +72,9 @@ TsneSettingsAction::TsneSettingsAction(QObject* parent, std::string title) :
 
     _iterationsPublishExtendAction.setToolTip("Should be larger or equal to number of exaggeration iterations");
     _publishExtendsOnceAction.setToolTip("Only set the reference extends once, when computing the top level embedding first");
-    _gradientDescentTypeAction.setToolTip("Gradient Descent Implementation: GPU (Compute, A-tSNE),  GPU (Raster, A-tSNE), CPU (Barnes-Hut)");
-    _ignoreAdjustToLowNumberOfPointsAction.setToolTip("For low number of points CPU GD is automaticallty set.\nThis options prevents that adjustment.");
+    _gradientDescentTypeAction.setToolTip("Gradient Descent Implementation: GPU (Compute, A-tSNE),  GPU (Raster, A-tSNE), CPU (Barnes-Hut),\nCPU (FFT, multithreaded interpolation as in FIt-SNE, for large levels without GPU),\nCPU (Barnes-Hut, parallel: multithreaded on a flat quadtree),\nCPU (Hierarchy: the coarser superpixels of the hierarchy approximate the repulsion of far away points)");
+    _pcaSampleSizeAction.setToolTip("The PCA init estimates the principal axes on this many evenly spaced points and projects all points onto them.\n0 uses all points.");
+    _ignoreAdjustToLowNumberOfPointsAction.setToolTip("For low number of points the parallel Barnes-Hut CPU GD is automaticallty set.\nThis options prevents that adjustment.");
 
     const auto updateNumIterations = [this]() -> void {
         _tsneParameters.numIterations = _numDefaultUpdateIterationsAction.getValue();
@@ -94,11 +101,16 @@ TsneSettingsAction::TsneSettingsAction(QObject* parent, std::string title) :
         };
 
     const auto updateGradientDescentTypeAction = [this]() -> void {
+        _tsneEngine = TsneEngine::LIBRARY;
+
         switch (_gradientDescentTypeAction.getCurrentIndex())
         {
         case 0: _tsneParameters.gradientDescentType = GradientDescentType::GPUcompute; break;
         case 1: _tsneParameters.gradientDescentType = GradientDescentType::GPUraster; break;
         case 2: _tsneParameters.gradientDescentType = GradientDescentType::CPU; break;
+        case 3: _tsneParameters.gradientDescentType = GradientDescentType::CPU; _tsneEngine = TsneEngine::FFT_INTERPOLATION; break;
+        case 4: _tsneParameters.gradientDescentType = GradientDescentType::CPU; _tsneEngine = TsneEngine::BARNES_HUT; break;
+        case 5: _tsneParameters.gradientDescentType = GradientDescentType::CPU; _tsneEngine = TsneEngine::HIERARCHY; break;
         }
 
         };
@@ -111,6 +123,7 @@ TsneSettingsAction::TsneSettingsAction(QObject* parent, std::string title) :
         _iterationsPublishExtendAction.setEnabled(enable);
         _publishExtendsOnceAction.setEnabled(enable);
         _initAction.setEnabled(enable);
+        _pcaSampleSizeAction.setEnabled(enable);
         _exaggerationIterAction.setEnabled(enable);
         _exaggerationFactorAction.setEnabled(enable);
         _exaggerationToggleAction.setEnabled(enable);
@@ -170,6 +183,15 @@ TsneSettingsAction::TsneSettingsAction(QObject* parent, std::string title) :
         updateReadOnly();
         });
 
+    // Without an OpenGL context only the CPU gradient descents are available
+    if (!OffscreenBufferQt::isAvailable())
+        _gradientDescentTypeAction.setCurrentIndex(3);
+
+}
+
+void TsneSettingsAction::addParentLayoutInitOption() {
+    _initAction.initialize({ "Random", "PCA", "Spectral", "Parent layout" }, "Parent layout");
+    _initAction.setToolTip("Parent layout: start at the positions of the parent superpixels in the parent embedding,\nwith a shorter exaggeration phase");
 }
 
 void TsneSettingsAction::adjustToLowNumberOfPoints(size_t numEmbPoints) {
@@ -179,11 +201,11 @@ void TsneSettingsAction::adjustToLowNumberOfPoints(size_t numEmbPoints) {
     }
 
     if (numEmbPoints < 500) {
-        _gradientDescentTypeAction.setCurrentIndex(2);
+        _gradientDescentTypeAction.setCurrentIndex(4);
         _numDefaultUpdateIterationsAction.setValue(500);
     }
     else {
-        _gradientDescentTypeAction.setCurrentIndex(0);
+        _gradientDescentTypeAction.setCurrentIndex(OffscreenBufferQt::isAvailable() ? 0 : 3);
 
         if (numEmbPoints < 100'000)
             _numDefaultUpdateIterationsAction.setValue(1000);
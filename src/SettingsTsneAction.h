@@ -2,6 +2,7 @@
 
 #include <sph/EmbedTsne.hpp>
 
+#include "CpuTsneComputation.h"
 #include "TsneComputationAction.h"
 
 #include <actions/DecimalAction.h>
@@ -24,8 +25,14 @@ public:
 
     sph::TsneEmbeddingParameters& getTsneParameters() { return _tsneParameters; }
 
+    /** The CPU option of the gradient descent type may be carried out by one of the plugin's CPU engines */
+    TsneEngine getTsneEngine() const { return _tsneEngine; }
+
     void adjustToLowNumberOfPoints(size_t numEmbPoints);
 
+    /** Refined embeddings can be initialized with the layout of their parent embedding, selects it as default */
+    void addParentLayoutInitOption();
+
 public: // Action getters
 
     mv::gui::IntegralAction& getExaggerationIterAction() { return _exaggerationIterAction; };
@@ -35,6 +42,7 @@ public: // Action getters
     mv::gui::IntegralAction& getIterationsPublishExtendAction() { return _iterationsPublishExtendAction; };
     mv::gui::ToggleAction& getPublishExtendsOnceAction() { return _publishExtendsOnceAction; };
     mv::gui::OptionAction& getInitAction() { return _initAction; };
+    mv::gui::IntegralAction& getPcaSampleSizeAction() { return _pcaSampleSizeAction; };
     mv::gui::IntegralAction& getNumNewIterationsAction() { return _numNewIterationsAction; };
     mv::gui::IntegralAction& getNumDefaultUpdateIterationsAction() { return _numDefaultUpdateIterationsAction; };
     mv::gui::IntegralAction& getNumComputedIterationsAction() { return _numComputedIterationsAction; };
@@ -44,6 +52,7 @@ public: // Action getters
 
 private:
     sph::TsneEmbeddingParameters    _tsneParameters;                        /** TSNE parameters */
+    TsneEngine                      _tsneEngine = TsneEngine::LIBRARY;      /** Gradient descent engine */
     mv::gui::IntegralAction         _exaggerationIterAction;                /** Exaggeration iteration action */
     mv::gui::IntegralAction         _exponentialDecayAction;                /** Exponential decay of exaggeration action */
     mv::gui::DecimalAction          _exaggerationFactorAction;              /** Exaggeration factor action */
@@ -51,6 +60,7 @@ private:
     mv::gui::IntegralAction         _iterationsPublishExtendAction;         /** Number of iterations at which to publish reference extends action */
     mv::gui::ToggleAction           _publishExtendsOnceAction;              /** Whether reference extends should only be set once, when the top level is computed */
     mv::gui::OptionAction           _initAction;                            /** Whether to initialize embedding with PCA, Spectral or Random */
+    mv::gui::IntegralAction         _pcaSampleSizeAction;                   /** Number of rows that the PCA axes are estimated on, all if 0 */
     mv::gui::IntegralAction         _numNewIterationsAction;                /** Number of new iterations action */
     mv::gui::IntegralAction         _numDefaultUpdateIterationsAction;      /** Number of default update iterations action */
     mv::gui::IntegralAction         _numComputedIterationsAction;           /** Number of computed iterations action */
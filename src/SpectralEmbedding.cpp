@@ -0,0 +1,334 @@
+#include "SpectralEmbedding.h"
+
+#include "LinearAlgebra.h"
+
+#include <sph/utils/Logger.hpp>
+
+#include <hdi/data/map_mem_eff.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <random>
+
+using namespace sph;
+
+namespace {
+    constexpr size_t numChunks = 64;
+
+    double dot(const std::vector<float>& a, const std::vector<float>& b)
+    {
+        const size_t size = a.size();
+        const size_t chunkSize = (size + numChunks - 1) / numChunks;
+        std::vector<double> partialSums(numChunks, 0.0);
+
+        SPH_PARALLEL
+        for (int64_t chunk = 0; chunk < static_cast<int64_t>(numChunks); chunk++)
+        {
+            double sum = 0;
+            const size_t last = std::min((chunk + 1) * chunkSize, size);
+            for (size_t i = chunk * chunkSize; i < last; i++)
+                sum += static_cast<double>(a[i]) * b[i];
+            partialSums[chunk] = sum;
+        }
+
+        return std::accumulate(partialSums.begin(), partialSums.end(), 0.0);
+    }
+
+    // y += factor * x
+    void addScaled(std::vector<float>& y, const std::vector<float>& x, double factor)
+    {
+        const auto f = static_cast<float>(factor);
+
+        SPH_PARALLEL
+        for (int64_t i = 0; i < static_cast<int64_t>(y.size()); i++)
+            y[i] += f * x[i];
+    }
+
+    void scale(std::vector<float>& x, double factor)
+    {
+        const auto f = static_cast<float>(factor);
+
+        SPH_PARALLEL
+        for (int64_t i = 0; i < static_cast<int64_t>(x.size()); i++)
+            x[i] *= f;
+    }
+
+    // Normalized adjacency D^-1/2 W D^-1/2 in CSR layout
+    struct NormalizedAdjacency
+    {
+        std::vector<uint64_t>   rowOffsets = {};
+        std::vector<uint32_t>   columns = {};
+        std::vector<float>      values = {};
+        std::vector<float>      invSqrtDegrees = {};
+        std::vector<uint32_t>   connectedComponents = {};   /** Connected component of each point */
+        std::vector<double>     componentDegrees = {};      /** Sum of degrees per connected component */
+
+        NormalizedAdjacency(const SparseMatHDI& matrix)
+        {
+            const size_t numPoints = matrix.size();
+
+            // W = (P + P^T) / 2, entries of both directions are summed during the multiplication
+            rowOffsets.assign(numPoints + 1, 0);
+            for (size_t row = 0; row < numPoints; row++)
+            {
+                rowOffsets[row + 1] += matrix[row].size();
+                for (const auto& [col, value] : matrix[row])
+                    rowOffsets[col + 1]++;
+            }
+
+            for (size_t row = 0; row < numPoints; row++)
+                rowOffsets[row + 1] += rowOffsets[row];
+
+            columns.resize(rowOffsets.back());
+            values.resize(rowOffsets.back());
+
+            std::vector<uint64_t> fill(rowOffsets.begin(), rowOffsets.end() - 1);
+            for (size_t row = 0; row < numPoints; row++)
+            {
+                for (const auto& [col, value] : matrix[row])
+                {
+                    columns[fill[row]] = static_cast<uint32_t>(col);
+                    values[fill[row]++] = 0.5f * value;
+                    columns[fill[col]] = static_cast<uint32_t>(row);
+                    values[fill[col]++] = 0.5f * value;
+                }
+            }
+
+            invSqrtDegrees.resize(numPoints);
+
+            SPH_PARALLEL
+            for (int64_t row = 0; row < static_cast<int64_t>(numPoints); row++)
+            {
+                double degree = 0;
+                for (uint64_t entry = rowOffsets[row]; entry < rowOffsets[row + 1]; entry++)
+                    degree += values[entry];
+
+                // isolated points stay at the origin
+                invSqrtDegrees[row] = degree > 0 ? static_cast<float>(1.0 / std::sqrt(degree)) : 0.f;
+            }
+
+            SPH_PARALLEL
+            for (int64_t row = 0; row < static_cast<int64_t>(numPoints); row++)
+                for (uint64_t entry = rowOffsets[row]; entry < rowOffsets[row + 1]; entry++)
+                    values[entry] *= invSqrtDegrees[row] * invSqrtDegrees[columns[entry]];
+
+            // union-find with path halving
+            std::vector<uint32_t> parents(numPoints);
+            std::iota(parents.begin(), parents.end(), 0u);
+            auto findRoot = [&parents](uint32_t point) -> uint32_t {
+                while (parents[point] != point)
+                    point = parents[point] = parents[parents[point]];
+                return point;
+                };
+
+            for (size_t row = 0; row < numPoints; row++)
+                for (uint64_t entry = rowOffsets[row]; entry < rowOffsets[row + 1]; entry++)
+                    parents[findRoot(static_cast<uint32_t>(row))] = findRoot(columns[entry]);
+
+            std::vector<uint32_t> rootToComponent(numPoints, std::numeric_limits<uint32_t>::max());
+            connectedComponents.resize(numPoints);
+            for (size_t point = 0; point < numPoints; point++)
+            {
+                uint32_t& component = rootToComponent[findRoot(static_cast<uint32_t>(point))];
+                if (component == std::numeric_limits<uint32_t>::max())
+                {
+                    component = static_cast<uint32_t>(componentDegrees.size());
+                    componentDegrees.push_back(0.0);
+                }
+
+                connectedComponents[point] = component;
+                if (invSqrtDegrees[point] > 0)
+                    componentDegrees[component] += 1.0 / (static_cast<double>(invSqrtDegrees[point]) * invSqrtDegrees[point]);
+            }
+        }
+
+        size_t numConnectedComponents() const { return componentDegrees.size(); }
+
+        // Each connected component has an eigenvector D^1/2 * 1 on its points with eigenvalue 1, they carry no layout
+        void removeTrivialEigenvectors(std::vector<float>& x) const
+        {
+            std::vector<double> projections(componentDegrees.size(), 0.0);
+            for (size_t point = 0; point < x.size(); point++)
+                if (invSqrtDegrees[point] > 0)
+                    projections[connectedComponents[point]] += x[point] / invSqrtDegrees[point];
+
+            for (size_t component = 0; component < projections.size(); component++)
+                projections[component] = componentDegrees[component] > 0 ? projections[component] / componentDegrees[component] : 0.0;
+
+            SPH_PARALLEL
+            for (int64_t point = 0; point < static_cast<int64_t>(x.size()); point++)
+                x[point] = invSqrtDegrees[point] > 0 ? static_cast<float>(x[point] - projections[connectedComponents[point]] / invSqrtDegrees[point]) : 0.f;
+        }
+
+        void multiply(const std::vector<float>& x, std::vector<float>& y) const
+        {
+            y.resize(x.size());
+
+            SPH_PARALLEL
+            for (int64_t row = 0; row < static_cast<int64_t>(x.size()); row++)
+            {
+                double sum = 0;
+                for (uint64_t entry = rowOffsets[row]; entry < rowOffsets[row + 1]; entry++)
+                    sum += static_cast<double>(values[entry]) * x[columns[entry]];
+                y[row] = static_cast<float>(sum);
+            }
+        }
+    };
+}
+
+std::vector<float> SpectralEmbedding::compute(const SparseMatHDI& matrix, const Settings& settings)
+{
+    const size_t numPoints = matrix.size();
+    const size_t numComponents = settings.numComponents;
+    const size_t maxSteps = std::min(settings.numLanczosSteps, numPoints > 1 ? numPoints - 1 : 0);
+
+    if (numComponents == 0 || maxSteps < numComponents + 1)
+    {
+        Log::warn("SpectralEmbedding::compute: cannot compute {0} components of {1} points", numComponents, numPoints);
+        return {};
+    }
+
+    const NormalizedAdjacency adjacency(matrix);
+
+    if (adjacency.rowOffsets.back() == 0)
+    {
+        Log::warn("SpectralEmbedding::compute: the matrix has no connections");
+        return {};
+    }
+
+    // disconnected components are not placed relative to each other
+    if (adjacency.numConnectedComponents() > 1)
+        Log::info("SpectralEmbedding::compute: the matrix has {0} connected components", adjacency.numConnectedComponents());
+
+    // Thick restarted Lanczos: the basis holds the kept Ritz vectors followed by the Krylov vectors of the current cycle
+    const size_t numKept = std::min(numComponents + settings.numKeptVectors, maxSteps - 1);
+
+    std::vector<std::vector<float>> basis;
+    basis.reserve(maxSteps);
+
+    std::vector<float> vector(numPoints);
+    std::mt19937_64 generator(settings.seed);
+    std::normal_distribution<float> normal(0.f, 1.f);
+    for (float& value : vector)
+        value = normal(generator);
+
+    adjacency.removeTrivialEigenvectors(vector);
+    scale(vector, 1.0 / std::sqrt(dot(vector, vector)));
+    basis.push_back(std::move(vector));
+
+    // Projection of the normalized adjacency onto the basis
+    std::vector<double> projected(maxSteps * maxSteps, 0.0);
+    std::vector<double> eigenValues, eigenVectors;
+    std::vector<size_t> order;
+    std::vector<float> product, residual;
+    double residualNorm = 0;
+    size_t numSteps = 0;
+    size_t restart = 0;
+
+    for (;; restart++)
+    {
+        for (size_t step = basis.size() - 1; step < maxSteps; step++)
+        {
+            adjacency.multiply(basis[step], product);
+
+            // full re-orthogonalization, twice is enough in floating point
+            std::vector<double> coefficients(step + 1, 0.0);
+            for (int pass = 0; pass < 2; pass++)
+            {
+                adjacency.removeTrivialEigenvectors(product);
+                for (size_t i = 0; i <= step; i++)
+                {
+                    const double coefficient = dot(product, basis[i]);
+                    addScaled(product, basis[i], -coefficient);
+                    coefficients[i] += coefficient;
+                }
+            }
+
+            for (size_t i = 0; i <= step; i++)
+                projected[i * maxSteps + step] = projected[step * maxSteps + i] = coefficients[i];
+
+            residualNorm = std::sqrt(dot(product, product));
+            numSteps = step + 1;
+
+            // the basis spans an invariant subspace
+            if (residualNorm < 1e-7)
+                break;
+
+            scale(product, 1.0 / residualNorm);
+
+            if (numSteps == maxSteps)
+                break;
+
+            projected[(step + 1) * maxSteps + step] = projected[step * maxSteps + step + 1] = residualNorm;
+            basis.push_back(std::move(product));
+            product = {};
+        }
+
+        residual = std::move(product);
+        product = {};
+
+        std::vector<double> reduced(numSteps * numSteps);
+        for (size_t i = 0; i < numSteps; i++)
+            for (size_t j = 0; j < numSteps; j++)
+                reduced[i * numSteps + j] = projected[i * maxSteps + j];
+
+        computeSymmetricEigen(std::move(reduced), numSteps, eigenValues, eigenVectors);
+
+        order.resize(numSteps);
+        std::iota(order.begin(), order.end(), size_t{ 0 });
+        std::sort(order.begin(), order.end(), [&eigenValues](size_t a, size_t b) { return eigenValues[a] > eigenValues[b]; });
+
+        if (numSteps < numComponents)
+        {
+            Log::warn("SpectralEmbedding::compute: the Krylov subspace has only {0} dimensions", numSteps);
+            return {};
+        }
+
+        // residual of a Ritz pair is the residual norm times the last entry of its eigenvector
+        bool converged = numSteps < maxSteps || residualNorm < 1e-7;
+        for (size_t comp = 0; comp < numComponents && !converged; comp++)
+            converged = std::abs(residualNorm * eigenVectors[(numSteps - 1) * numSteps + order[comp]]) >= settings.tolerance ? false : comp + 1 == numComponents;
+
+        if (converged || restart == settings.maxRestarts)
+            break;
+
+        // keep the leading Ritz vectors, continue with the residual
+        std::vector<std::vector<float>> ritzVectors(numKept, std::vector<float>(numPoints, 0.f));
+        std::fill(projected.begin(), projected.end(), 0.0);
+
+        for (size_t kept = 0; kept < numKept; kept++)
+        {
+            for (size_t step = 0; step < numSteps; step++)
+                addScaled(ritzVectors[kept], basis[step], eigenVectors[step * numSteps + order[kept]]);
+
+            projected[kept * maxSteps + kept] = eigenValues[order[kept]];
+            projected[kept * maxSteps + numKept] = projected[numKept * maxSteps + kept] = residualNorm * eigenVectors[(numSteps - 1) * numSteps + order[kept]];
+        }
+
+        basis = std::move(ritzVectors);
+        basis.push_back(std::move(residual));
+    }
+
+    // Ritz vectors, scaled by D^-1/2 as in the random walk Laplacian
+    std::vector<float> embedding(numPoints * numComponents, 0.f);
+    for (size_t comp = 0; comp < numComponents; comp++)
+    {
+        std::vector<float> ritzVector(numPoints, 0.f);
+        for (size_t step = 0; step < numSteps; step++)
+            addScaled(ritzVector, basis[step], eigenVectors[step * numSteps + order[comp]]);
+
+        // the sign of the largest entry is positive for deterministic layouts
+        const auto largest = std::max_element(ritzVector.begin(), ritzVector.end(), [](float a, float b) { return std::abs(a) < std::abs(b); });
+        const float sign = *largest < 0 ? -1.f : 1.f;
+
+        SPH_PARALLEL
+        for (int64_t point = 0; point < static_cast<int64_t>(numPoints); point++)
+            embedding[point * numComponents + comp] = sign * ritzVector[point] * adjacency.invSqrtDegrees[point];
+    }
+
+    Log::info("SpectralEmbedding::compute: {0} points, {1} restarts, leading eigenvalue {2}", numPoints, restart, eigenValues[order[0]]);
+
+    return embedding;
+}
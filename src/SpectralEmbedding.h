@@ -0,0 +1,34 @@
+#pragma once
+
+#include <sph/utils/CommonDefinitions.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// ///////////////// ///
+/// SpectralEmbedding ///
+/// ///////////////// ///
+
+/**
+ * Laplacian eigenmap of a sparse similarity matrix, e.g. the transition matrix of a hierarchy level or a refinement.
+ * The leading non-trivial eigenvectors of the normalized adjacency D^-1/2 W D^-1/2 with W = (P + P^T) / 2 are found by
+ * thick restarted Lanczos iterations with full re-orthogonalization. The matrix is only multiplied with vectors, in parallel over its rows.
+ */
+class SpectralEmbedding
+{
+public:
+    struct Settings
+    {
+        size_t      numComponents = 2;
+        size_t      numLanczosSteps = 48;       /** Size of the Krylov subspace, the basis holds this many vectors of all points */
+        size_t      numKeptVectors = 8;         /** Ritz vectors in addition to the components that are kept on restarts */
+        size_t      maxRestarts = 30;
+        double      tolerance = 1e-4;           /** Residual norm of the eigenvectors */
+        uint64_t    seed = 42;
+    };
+
+public:
+    /** Row-major numPoints x numComponents, empty if the matrix has too few points or connections */
+    static std::vector<float> compute(const sph::SparseMatHDI& matrix, const Settings& settings);
+};
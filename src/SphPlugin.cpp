@@ -1,5 +1,11 @@
 #include "SphPlugin.h"
 
+#include "EmbeddingCheckpoint.h"
+#include "HierarchyRepulsion.h"
+#include "LandmarkEmbedding.h"
+#include "LocalOptimization.h"
+#include "RandomizedPca.h"
+#include "SpectralEmbedding.h"
 #include "Utils.h"
 
 #include <ImageData/Images.h>
@@ -9,6 +15,7 @@
 
 #include <actions/PluginTriggerAction.h>
 
+#include <sph/utils/Algorithms.hpp>
 #include <sph/utils/CommonDefinitions.hpp>
 #include <sph/utils/Embedding.hpp>
 #include <sph/utils/EvalIO.hpp>
@@ -24,12 +31,16 @@
 #include <cmath>
 #include <cstdint>
 #include <limits>
+#include <memory>
 #include <new>
 #include <numeric>
 #include <random>
 #include <type_traits>
 #include <vector>
 
+#include <QCoreApplication>
+#include <QPointer>
+
 Q_PLUGIN_METADATA(IID "manivault.studio.SPHPlugin")
 
 std::chrono::steady_clock::time_point __tsneStartTime;
@@ -80,6 +91,11 @@ void SPHPlugin::init()
     _settingsAction.getHierarchySettingsAction().setNumDataPoints(_data.numPoints);
     _settingsAction.getAdvancedSettingsAction().setNumDataPoints(_data.numPoints);
 
+    // All embeddings share the worker threads of the embedding service
+    _embeddingService.setPoolSize(_settingsAction.getAdvancedSettingsAction().getNumEmbeddingThreadsAction().getValue());
+    _computeEmbedding.setEmbeddingService(&_embeddingService);
+    _computeLandmarkEmbedding.setEmbeddingService(&_embeddingService);
+
     _settingsAction.getRefineAction().setSPHPlugin(this);
     _settingsAction.getRefineAction().setTsneSettingsAction(&_settingsAction.getRefineTsneSettingsAction());
     _settingsAction.getRefineAction().setParentEmbedding(outputDataset);
@@ -94,99 +110,34 @@ void SPHPlugin::init()
         events().notifyDatasetDataChanged(outputDataset);
     }
 
-    // Create image hierarchy dataset
-    {
-        _superpixelComponents = mv::data().createDataset<Points>("Points", "Superpixel Hierarchy", outputDataset);
-
-        std::vector<float> tempData(static_cast<size_t>(_data.numPoints), 0);
-        _superpixelComponents->setData(std::move(tempData), 1);
-        events().notifyDatasetDataChanged(_superpixelComponents);
-
-        _superpixelImage = mv::data().createDataset<Images>("Images", "Superpixel images", _superpixelComponents);
-
-        _superpixelImage->setType(ImageData::Type::Stack);
-        _superpixelImage->setNumberOfImages(1);
-        _superpixelImage->setImageSize(_imgSize);
-        _superpixelImage->setNumberOfComponentsPerPixel(1);
-
-        events().notifyDatasetDataChanged(_superpixelImage);
-    }
-
-    // Get copy of input data
-    {
-        std::vector<uint32_t> enabledDimensionsIDs = getEnabledDimensions();
-        _data.numDimensions = enabledDimensionsIDs.size();
-
-        // store data from of landmarks
-        _data.dataVec.resize(_data.numDimensions * _data.numPoints);
-        _inputData->populateDataForDimensions<std::vector<float>, std::vector<uint32_t>>(_data.dataVec, enabledDimensionsIDs);
-    }
-
-    // Init scatter color data
-    {
-        _dataColoredByEmb = mv::data().createDataset<Points>("Points", "Scatter colors", outputDataset);
-        _dataColoredByEmb->setData(initialData.data(), _data.numPoints, numInitialDataDimensions);
-        events().notifyDatasetDataChanged(_dataColoredByEmb);
-
-        _imgColoredByEmb = mv::data().createDataset<Images>("Images", "Scatter colors", _dataColoredByEmb);
-
-        _imgColoredByEmb->setType(ImageData::Type::Stack);
-        _imgColoredByEmb->setNumberOfImages(numInitialDataDimensions);
-        _imgColoredByEmb->setImageSize(_imgSize);
-        _imgColoredByEmb->setNumberOfComponentsPerPixel(1);
-
-        events().notifyDatasetDataChanged(_imgColoredByEmb);
-    }
-
-    // Init avg pixel data and image
-    {
-        std::vector<float> initialAvgData(_data.numPoints * _data.numDimensions, 0);
-        _avgComponentDataPixel = mv::data().createDataset<Points>("Points", "Average Data (Pixel)", outputDataset);
-        _avgComponentDataPixel->setData(std::move(initialAvgData), _data.numDimensions);
-        _avgComponentDataPixel->setDimensionNames(_inputData->getDimensionNames());
-        events().notifyDatasetDataChanged(_avgComponentDataPixel);
+    // The dimension selection at init applies to all computations, the input data is read in place in its element type
+    _enabledDimensions = getEnabledDimensions();
+    updateInputValues(InputAccess::NATIVE);
 
-        _avgComponentDataPixelImg = mv::data().createDataset<Images>("Images", "Average Data (Image)", _avgComponentDataPixel);
+    // Superpixel, scatter color, average and meta datasets are created when their first result is published,
+    // such that no zero buffers of the input size are allocated for results that may never be computed
 
-        _avgComponentDataPixelImg->setType(ImageData::Type::Stack);
-        _avgComponentDataPixelImg->setNumberOfImages(_data.numDimensions);
-        _avgComponentDataPixelImg->setImageSize(_imgSize);
-        _avgComponentDataPixelImg->setNumberOfComponentsPerPixel(1);
-
-        events().notifyDatasetDataChanged(_avgComponentDataPixelImg);
-    }
-
-    // Init embedding point meta data
-    {
-        std::vector<float> initialPointData(_data.numPoints, 0);
-        _representSizeDataset = mv::data().createDataset<Points>("Points", "Represented Data Size", outputDataset);
-        _representSizeDataset->setData(initialPointData.data(), _data.numPoints, 1);
-        events().notifyDatasetDataChanged(_representSizeDataset);
-
-        _notMergedNotesDataset = mv::data().createDataset<Points>("Points", "Not Merged Nodes", outputDataset);
-        _notMergedNotesDataset->setData(initialPointData.data(), _data.numPoints, 1);
-        events().notifyDatasetDataChanged(_notMergedNotesDataset);
-
-        _randomWalkPointSim = mv::data().createDataset<Points>("Points", "Random Walk ProbDist", outputDataset);
-        _randomWalkPointSim->setData(initialPointData.data(), _data.numPoints, 1);
-        events().notifyDatasetDataChanged(_randomWalkPointSim);
-        
-        initialPointData.resize(_data.numPoints * _data.numDimensions, 0);
-        _avgComponentDataSuper = mv::data().createDataset<Points>("Points", "Average Data (Superpixel)", outputDataset);
-        _avgComponentDataSuper->setData(initialPointData.data(), _data.numPoints, _data.numDimensions);
-        _avgComponentDataSuper->setDimensionNames(_inputData->getDimensionNames());
-        events().notifyDatasetDataChanged(_avgComponentDataSuper);
-    }
-
-    // Connect selection mappings
+    // Connect selection mappings, the dataset references forward the signals of datasets assigned later
     connect(&_inputData,                &Dataset<Points>::dataSelectionChanged,         this, &SPHPlugin::onSelectionInInputData);
     connect(&_output[0],                &Dataset<DatasetImpl>::dataSelectionChanged,    this, &SPHPlugin::onSelectionInEmbedding);
     connect(&_dataColoredByEmb,         &Dataset<Points>::dataSelectionChanged,         this, &SPHPlugin::onSelectionInImgColoredByEmb);
     connect(&_superpixelComponents,     &Dataset<Points>::dataSelectionChanged,         this, &SPHPlugin::onSelectionInSuperPixelComponents);
     connect(&_avgComponentDataPixel,    &Dataset<Points>::dataSelectionChanged,         this, &SPHPlugin::onSelectionInPixelAverages);
 
-    connect(&_inputData, &Dataset<Points>::dataChanged, this, []() { 
+    connect(&_settingsAction.getAdvancedSettingsAction().getNumEmbeddingThreadsAction(), &IntegralAction::valueChanged, this, [this](const int32_t& value) {
+        _embeddingService.setPoolSize(static_cast<size_t>(value));
+        });
+
+    connect(&_settingsAction.getAdvancedSettingsAction().getRefineComputeMemoryAction(), &IntegralAction::valueChanged, this, [this](const int32_t& value) {
+        _settingsAction.getRefineAction().enforceMemoryBudget();
+        });
+
+    connect(&_inputData, &Dataset<Points>::dataChanged, this, [this]() { 
         Log::warn("Input data changed. This well NOT be reflected in the computation or output of this plugin. If you want that to happen, implement it.");
+
+        // values that are read in place might have been reallocated
+        if (!ownsInputData())
+            updateInputValues(InputAccess::NATIVE);
         });
 
     /// Connect UI elements ///
@@ -238,11 +189,10 @@ void SPHPlugin::init()
             }
         }
 
-        _superpixelComponents->setData(std::move(componentIDs), numLevels);
+        getOrCreateDerivedDataset(_superpixelComponents, "Superpixel Hierarchy")->setData(std::move(componentIDs), numLevels);
         events().notifyDatasetDataChanged(_superpixelComponents);
 
-        _superpixelImage->setNumberOfImages(static_cast<uint32_t>(numLevels));
-        events().notifyDatasetDataChanged(_superpixelImage);
+        updateDerivedImage(_superpixelImage, "Superpixel images", _superpixelComponents, static_cast<uint32_t>(numLevels));
 
         });
 
@@ -265,6 +215,12 @@ void SPHPlugin::init()
         _isInit = true;
         });
 
+    // the library reads float values, a float copy of other element types is released once it is done
+    connect(&_computeHierarchy, &ComputeHierarchyWrapper::finished, this, [this]() {
+        if (!_isInputScaled)
+            updateInputValues(InputAccess::NATIVE);
+        });
+
     // update embedding
     connect(&_computeEmbedding, &ComputeEmbeddingWrapper::embeddingUpdate, this, &SPHPlugin::setEmbeddingInManiVault);
 
@@ -281,19 +237,67 @@ void SPHPlugin::init()
         _settingsAction.getTsneSettingsAction().getTsneComputeAction().setFinished();
         });
 
+    // Landmark embedding of large levels: show the scattered layout while the landmarks are computed
+    connect(&_computeLandmarkEmbedding, &ComputeEmbeddingWrapper::embeddingUpdate, this, [this](const std::vector<float>& emb) {
+        if (_landmarkEmbedding && emb.size() == _landmarkEmbedding->getNumLandmarks() * 2)
+            setEmbeddingInManiVault(_landmarkEmbedding->scatter(emb));
+        });
+
+    connect(&_computeLandmarkEmbedding, &ComputeEmbeddingWrapper::finished, this, &SPHPlugin::placeByLandmarks);
+
+    connect(&_computeLandmarkEmbedding, &ComputeEmbeddingWrapper::workerStarted, this, [this]() {
+        _isBusy = false;
+        _settingsAction.getTsneSettingsAction().getTsneComputeAction().setStarted();
+        });
+
+    connect(&_computeLandmarkEmbedding, &ComputeEmbeddingWrapper::workerEnded, this, [this]() {
+        _settingsAction.getTsneSettingsAction().getTsneComputeAction().setFinished();
+        });
+
     connect(&_settingsAction.getTsneSettingsAction().getTsneComputeAction().getStopComputationAction(), &TriggerAction::triggered, this, [this](bool checked) {
+        _computeLandmarkEmbedding.stopComputation();
         _computeEmbedding.stopComputation();
         });
 
     connect(&_settingsAction.getTsneSettingsAction().getTsneComputeAction().getContinueComputationAction(), &TriggerAction::triggered, this, [this](bool checked) {
+        // the landmarks are not placed yet
+        if (_landmarkEmbedding) {
+            _computeLandmarkEmbedding.continueComputation(_settingsAction.getTsneSettingsAction().getNumNewIterationsAction().getValue());
+            return;
+        }
+
         _computeEmbedding.continueComputation(_settingsAction.getTsneSettingsAction().getNumNewIterationsAction().getValue());
         });
 
     connect(&_settingsAction.getTsneSettingsAction().getTsneComputeAction().getRestartComputationAction(), &TriggerAction::triggered, this, [this](bool checked) {
+        _computeLandmarkEmbedding.stopComputation();
         _computeEmbedding.stopComputation();
+
+        // the hierarchy is being recomputed
+        if (_currentTransitionMatrix == nullptr)
+            return;
+
+        if (getNormalizationScheme() == utils::NormalizationScheme::TSNE)
+            _landmarkEmbedding = createLandmarkEmbedding();
+
+        if (_landmarkEmbedding) {
+            computeLandmarkEmbedding(_settingsAction.getTsneSettingsAction().getTsneParameters());
+            return;
+        }
+
         updateInitEmbedding();
+        setTsneEngine(_computeEmbedding, _currentLevel);
+        updateCheckpoint(_settingsAction.getTsneSettingsAction().getTsneParameters(), /* loadState = */ false);
         _computeEmbedding.restartComputation(_settingsAction.getTsneSettingsAction().getTsneParameters());
         });
+
+    connect(&_settingsAction.getTsneSettingsAction().getTsneComputeAction().getReoptimizeSelectionAction(), &TriggerAction::triggered, this, [this](bool checked) {
+        reoptimizeSelection();
+        });
+
+    connect(&_settingsAction.getTsneSettingsAction().getTsneComputeAction().getPixelEmbeddingAction(), &TriggerAction::triggered, this, [this](bool checked) {
+        computePixelEmbedding();
+        });
 }
 
 void SPHPlugin::onSelectionInInputData()
@@ -343,6 +347,9 @@ void SPHPlugin::onSelectionInEmbedding()
 
     Log::trace("onSelectionInEmbedding");
 
+    // The embedding the user interacts with is computed with priority
+    _computeEmbedding.requestPriority();
+
     if (allIsSync)
         markAsHandled(SelectionDatasets::GLOBAL);
 
@@ -490,7 +497,7 @@ void SPHPlugin::updateRandomWalkPointSimDataset()
         }
     }
 
-    _randomWalkPointSim->setData(std::move(randomWalkPointSims), 1);
+    getOrCreateDerivedDataset(_randomWalkPointSim, "Random Walk ProbDist")->setData(std::move(randomWalkPointSims), 1);
     events().notifyDatasetDataChanged(_randomWalkPointSim);
 }
 
@@ -500,16 +507,134 @@ void SPHPlugin::updateAverageDatasets() {
         return;
     }
 
-    std::vector<float> avgDataSuperpixels = computeAveragePerDimensionForSuperpixels(_data, *_mappingLevelToData);
+    _avgDataSuperpixels = computeInputAverages(*_mappingLevelToData);
+
+    const AveragePrecision precision = _settingsAction.getAdvancedSettingsAction().getAveragePrecision();
+
+    const bool createdAverages = !_avgComponentDataSuper.isValid();
+
+    setAverageData(getOrCreateDerivedDataset(_avgComponentDataSuper, "Average Data (Superpixel)"), _avgDataSuperpixels, _data.getNumDimensions(), precision);
 
     // Map (scatter) from superpixels to pixels
-    std::vector<float> avgDataPixels = mapSuperpixelAverageToPixels(avgDataSuperpixels, _data.getNumPoints(), *_mappingLevelToData);
+    setPixelAverageData(getOrCreateDerivedDataset(_avgComponentDataPixel, "Average Data (Pixel)"), _avgDataSuperpixels, _data.getNumPoints(), *_mappingLevelToData, precision);
 
-    _avgComponentDataSuper->setData(std::move(avgDataSuperpixels), _data.getNumDimensions());
-    events().notifyDatasetDataChanged(_avgComponentDataSuper);
+    if (createdAverages) {
+        // names of the enabled dimensions only, the averages cover those
+        const auto inputDimensionNames = _inputData->getDimensionNames();
+        std::vector<QString> dimensionNames;
+        for (const uint32_t dimension : _enabledDimensions)
+            dimensionNames.push_back(inputDimensionNames[dimension]);
 
-    _avgComponentDataPixel->setData(std::move(avgDataPixels), _data.getNumDimensions());
+        _avgComponentDataSuper->setDimensionNames(dimensionNames);
+        _avgComponentDataPixel->setDimensionNames(dimensionNames);
+    }
+
+    events().notifyDatasetDataChanged(_avgComponentDataSuper);
     events().notifyDatasetDataChanged(_avgComponentDataPixel);
+
+    updateDerivedImage(_avgComponentDataPixelImg, "Average Data (Image)", _avgComponentDataPixel, static_cast<uint32_t>(_data.getNumDimensions()));
+}
+
+void SPHPlugin::reoptimizeSelection()
+{
+    auto outputDataset = getOutputDataset<Points>();
+    const auto& selectionIndices = outputDataset->getSelection<Points>()->indices;
+
+    if (selectionIndices.empty() || _currentTransitionMatrix == nullptr || !_computeEmbedding.canContinue())
+    {
+        Log::info("SPHPlugin::reoptimizeSelection: select points of a computed embedding first");
+        return;
+    }
+
+    // the local optimization follows the t-SNE gradient
+    if (getNormalizationScheme() != utils::NormalizationScheme::TSNE)
+    {
+        Log::info("SPHPlugin::reoptimizeSelection: only available for t-SNE embeddings");
+        return;
+    }
+
+    std::vector<uint64_t> selection(selectionIndices.begin(), selectionIndices.end());
+    utils::sortAndUnique(selection);
+
+    _computeEmbedding.stopComputation();
+
+    // start from the layout the user sees
+    std::vector<float> positions(_numCurrentEmbPoints * 2);
+    std::vector<uint32_t> embDims{ 0, 1 };
+    outputDataset->populateDataForDimensions(positions, embDims);
+
+    // gathering the neighborhood scales with the selection, the optimization itself runs in the background
+    auto localOptimization = std::make_shared<LocalOptimization>(*_currentTransitionMatrix, std::move(positions), selection);
+
+    // the continue iterations are zero by default, keep the default number of local iterations then
+    LocalOptimization::Settings settings;
+    if (const auto numIterations = _settingsAction.getTsneSettingsAction().getNumNewIterationsAction().getValue(); numIterations > 0)
+        settings.numIterations = static_cast<uint32_t>(numIterations);
+
+    auto& reoptimizeAction = _settingsAction.getTsneSettingsAction().getTsneComputeAction().getReoptimizeSelectionAction();
+    reoptimizeAction.setEnabled(false);
+
+    _backgroundTasks.start([guard = QPointer<SPHPlugin>(this), localOptimization, settings]() {
+        localOptimization->optimize(settings);
+
+        QMetaObject::invokeMethod(qApp, [guard, localOptimization]() {
+            if (guard.isNull())
+                return;
+
+            guard->_settingsAction.getTsneSettingsAction().getTsneComputeAction().getReoptimizeSelectionAction().setEnabled(guard->getNormalizationScheme() == utils::NormalizationScheme::TSNE);
+
+            if (localOptimization->getEmbedding().size() != guard->_numCurrentEmbPoints * 2)
+            {
+                Log::warn("SPHPlugin::reoptimizeSelection: level changed during the optimization, doing nothing");
+                return;
+            }
+
+            guard->_computeEmbedding.replaceEmbedding(std::move(localOptimization->getEmbedding()));
+            }, Qt::QueuedConnection);
+        });
+}
+
+void SPHPlugin::computePixelEmbedding()
+{
+    if (_currentTransitionMatrix == nullptr || !_computeEmbedding.canContinue())
+    {
+        Log::info("SPHPlugin::computePixelEmbedding: compute an embedding first");
+        return;
+    }
+
+    std::vector<float> levelEmbedding(_numCurrentEmbPoints * 2);
+    std::vector<uint32_t> embDims{ 0, 1 };
+    getOutputDataset<Points>()->populateDataForDimensions(levelEmbedding, embDims);
+
+    auto& pixelEmbeddingAction = _settingsAction.getTsneSettingsAction().getTsneComputeAction().getPixelEmbeddingAction();
+    pixelEmbeddingAction.setEnabled(false);
+
+    // The data level transition matrix holds the data kNN neighbors of each pixel with their similarities
+    const auto* probDistData = &_computeHierarchy.getProbDistOnLevel(0);
+
+    _backgroundTasks.start([guard = QPointer<SPHPlugin>(this), &hierarchy = _computeHierarchy.getHierarchy(), probDistData, level = _currentLevel, levelEmbedding = std::move(levelEmbedding)]() mutable {
+        utils::ScopedTimer<std::chrono::milliseconds> placementTimer("Pixel embedding");
+
+        // pixels are the landmarks of the data level, they are placed without gradient descent
+        constexpr uint32_t numPlacementIterations = 3;
+        std::vector<float> pixelEmbedding = (level == 0) ? std::move(levelEmbedding) : LandmarkEmbedding(hierarchy, 0, level).interpolate(*probDistData, levelEmbedding, numPlacementIterations);
+
+        QMetaObject::invokeMethod(qApp, [guard = std::move(guard), level, pixelEmbedding = std::move(pixelEmbedding)]() mutable {
+            if (guard.isNull())
+                return;
+
+            guard->_settingsAction.getTsneSettingsAction().getTsneComputeAction().getPixelEmbeddingAction().setEnabled(true);
+
+            if (!guard->_pixelEmbedding.isValid())
+                guard->_pixelEmbedding = mv::data().createDataset<Points>("Points", "Pixel embedding", guard->getOutputDataset());
+
+            const auto numPixels = pixelEmbedding.size() / 2;
+            guard->_pixelEmbedding->setData(std::move(pixelEmbedding), 2);
+            events().notifyDatasetDataChanged(guard->_pixelEmbedding);
+
+            Log::info("SPHPlugin::computePixelEmbedding: placed {0} pixels in the embedding of level {1}", numPixels, level);
+            }, Qt::QueuedConnection);
+        });
 }
 
 void SPHPlugin::deselectAll()
@@ -576,6 +701,14 @@ void SPHPlugin::computeHierarchy()
 {
     Log::info("SPHPlugin::computeHierarchy");
 
+    // sub graphs, refinements and pending results of the previous hierarchy are outdated
+    _backgroundTasks.waitForDone();
+    _settingsAction.getRefineAction().removeAllRefinements();
+    _subGraphCache.clear();
+    _initEmbeddingCache.clear();
+    _landmarkEmbedding.reset();
+    _currentTransitionMatrix = nullptr;
+
     // Settings
     auto ihs            = getImageHierarchySettings();
     auto lss            = getLevelSimilaritiesSettings();
@@ -586,7 +719,7 @@ void SPHPlugin::computeHierarchy()
     auto fileName       = _inputData->getGuiName().toStdString();
     auto cacheActive    = _settingsAction.getHierarchySettingsAction().getCachingActiveAction().isChecked();
 
-    std::filesystem::path cacheSettingsPath = std::filesystem::path(filePath) / "sph-cache" / "settings.cache";
+    std::filesystem::path cacheSettingsPath = getCacheDirectory() / "settings.cache";
     utils::saveCurrentSettings(cacheSettingsPath, nns, ihs, rws, lss);
 
     // auto-set nn based on data size
@@ -601,14 +734,16 @@ void SPHPlugin::computeHierarchy()
 
     lss.ks = { static_cast<int64_t>(nns.numNearestNeighbors) };
 
-    // apply normalization
-    if (dataNorm != utils::Scaler::NONE) {
+    // the library reads float values, normalization writes to a fresh copy of the input data, a previous copy might be normalized already
+    _isInputScaled = dataNorm != utils::Scaler::NONE;
+    updateInputValues(_isInputScaled ? InputAccess::COPY : InputAccess::FLOAT);
+
+    if (_isInputScaled)
         utils::scale(_data, dataNorm);
-    }
 
     // Start computation in another thread
     _computeHierarchy.startComputation(
-        _data.getDataView(),
+        getInputData(),
         _imgSize.height(), _imgSize.width(), 
         ihs, lss, rws, nns, 
         filePath, fileName, 
@@ -628,68 +763,52 @@ void SPHPlugin::updateInitEmbedding()
         _computeEmbedding.initEmbedding(_currentLevel, _numCurrentEmbPoints);
         };
 
-    auto getAverateDataOnLevel = [this]() -> std::vector<float> {
-        assert(_avgComponentDataSuper->getNumPoints() == _numCurrentEmbPoints);
-        std::vector<float> avgs(_avgComponentDataSuper->getNumPoints() * _avgComponentDataSuper->getNumDimensions(), 0.f);
-        std::vector<uint32_t> enabledDimensionsIDs(_avgComponentDataSuper->getNumDimensions());
-        std::iota(enabledDimensionsIDs.begin(), enabledDimensionsIDs.end(), 0);
-        _avgComponentDataSuper->populateDataForDimensions<std::vector<float>, std::vector<uint32_t>>(avgs, enabledDimensionsIDs);
-        return avgs;
+    // on the data level the averages are the data itself
+    auto computePcaOnLevel = [this]() -> std::vector<float> {
+        RandomizedPca::Settings pcaSettings;
+        pcaSettings.maxSampledRows = _settingsAction.getTsneSettingsAction().getPcaSampleSizeAction().getValue();
+
+        if (_currentLevel == 0)
+            return computeInputPca(pcaSettings);
+
+        assert(_avgDataSuperpixels.size() == _numCurrentEmbPoints * _data.numDimensions);
+        return RandomizedPca::compute(_avgDataSuperpixels, _data.numDimensions, pcaSettings);
         };
 
+    if (initOption != "PCA" && initOption != "Spectral") { // initOption == "RANDOM"
+        initRandom();
+        return;
+    }
+
+    // PCA and spectral inits only depend on the hierarchy and the settings in the key
+    std::string initKey = initOption.toStdString();
     if (initOption == "PCA")
-    {
-        size_t numPC = 2;
-        std::vector<float> pca;
-        bool success = false;
+        initKey += " " + std::to_string(_settingsAction.getTsneSettingsAction().getPcaSampleSizeAction().getValue());
 
-        if (_currentLevel == 0) {
-            std::tie(pca, success) = utils::pca(_data.dataVec, _data.numDimensions, numPC);
-        }
-        else {
-            std::vector<float> avgSuperpixelData = getAverateDataOnLevel();
-            std::tie(pca, success) = utils::pca(avgSuperpixelData, _avgComponentDataSuper->getNumDimensions(), numPC);
-        }
+    const auto cacheKey = std::make_pair(_currentLevel, initKey);
 
-        if (success && numPC == 2) {
-            utils::scaleEmbeddingToOne(pca);
-            _computeEmbedding.initEmbedding(_currentLevel, _numCurrentEmbPoints, std::move(pca));
-        }
-        else {
-            initRandom();
-        }
-    }
-    else if (initOption == "Spectral")
+    if (auto cached = _initEmbeddingCache.find(cacheKey); cached != _initEmbeddingCache.end() && cached->second.size() == _numCurrentEmbPoints * 2)
     {
-        std::vector<float> spectral;
-        bool success = false;
+        Log::info("SPHPlugin::updateInitEmbedding: re-using cached init embedding");
+        _computeEmbedding.initEmbedding(_currentLevel, _numCurrentEmbPoints, sph::vf32(cached->second));
+        return;
+    }
 
-        if (_currentLevel == 0) {
-            std::tie(spectral, success) = utils::spectralEmbedding(_computeHierarchy.getImageHierarchyComp()->getDataKnnGraph());
-        }
-        else {
-            Log::warn("SPHPlugin::updateInitEmbedding: Option Spectral not implemented for abstraction level. Computing PCA...");
-            std::vector<float> avgSuperpixelData = getAverateDataOnLevel();
-            size_t numPC = 2;
-            std::tie(spectral, success) = utils::pca(avgSuperpixelData, _avgComponentDataSuper->getNumDimensions(), numPC);
-
-            if (numPC != 2)
-                success = false;
-        }
+    std::vector<float> initEmbedding;
 
-        if (success)
-        {
-            utils::scaleEmbeddingToOne(spectral);
-            _computeEmbedding.initEmbedding(_currentLevel, _numCurrentEmbPoints, std::move(spectral));
-        }
-        else {
-            initRandom();
-        }
-    }
-    else { // initOption == "RANDOM"
+    if (initOption == "PCA")
+        initEmbedding = computePcaOnLevel();
+    else
+        initEmbedding = SpectralEmbedding::compute(_computeHierarchy.getProbDistOnLevel(_currentLevel), {});
+
+    if (initEmbedding.empty()) {
         initRandom();
+        return;
     }
 
+    utils::scaleEmbeddingToOne(initEmbedding);
+    _initEmbeddingCache[cacheKey] = initEmbedding;
+    _computeEmbedding.initEmbedding(_currentLevel, _numCurrentEmbPoints, std::move(initEmbedding));
 }
 
 void SPHPlugin::computeEmbedding()
@@ -697,15 +816,21 @@ void SPHPlugin::computeEmbedding()
     Log::info("SPHPlugin::computeEmbedding: starting...");
 
     _computeEmbedding.stopComputation();
+    _computeEmbedding.requestPriority();
 
     __tsneStartTime = utils::now();
 
     const auto normScheme = getNormalizationScheme();
     _computeEmbedding.setNormScheme(normScheme);
 
-    updateInitEmbedding();
+    // Large levels are placed by the embedding of a coarser level, no need to initialize them
+    _computeLandmarkEmbedding.stopComputation();
+    _landmarkEmbedding = (normScheme == utils::NormalizationScheme::TSNE) ? createLandmarkEmbedding() : nullptr;
 
-    Log::info("SPHPlugin::computeEmbedding: Embedding extends (init): " + utils::computeExtends(_computeEmbedding.getInitEmbedding()).getMinMaxString());
+    if (!_landmarkEmbedding) {
+        updateInitEmbedding();
+        Log::info("SPHPlugin::computeEmbedding: Embedding extends (init): " + utils::computeExtends(_computeEmbedding.getInitEmbedding()).getMinMaxString());
+    }
 
     // update meta datasets
     {
@@ -721,7 +846,7 @@ void SPHPlugin::computeEmbedding()
             float representedDataSize = static_cast<float>(std::log((*_mappingLevelToData)[i].size() + 1));
             representedDataPoints[i] = std::clamp(representedDataSize, 0.f, 10.f);
         }
-        _representSizeDataset->setData(std::move(representedDataPoints), 1);
+        getOrCreateDerivedDataset(_representSizeDataset, "Represented Data Size")->setData(std::move(representedDataPoints), 1);
         events().notifyDatasetDataChanged(_representSizeDataset);
 
         // _notMergedNotesDataset
@@ -737,13 +862,13 @@ void SPHPlugin::computeEmbedding()
             {
                 notMergedNodes[notMergedNodesLevel[i]] = 1.f;
             }
-            _notMergedNotesDataset->setData(std::move(notMergedNodes), 1);
+            getOrCreateDerivedDataset(_notMergedNotesDataset, "Not Merged Nodes")->setData(std::move(notMergedNodes), 1);
             events().notifyDatasetDataChanged(_notMergedNotesDataset);
         }
         
         // _randomWalkPointSim, only update on selection, init with default 0
         std::vector<float> randomWalkPointSims(_mappingLevelToData->size(), 0.f);
-        _randomWalkPointSim->setData(std::move(randomWalkPointSims), 1);
+        getOrCreateDerivedDataset(_randomWalkPointSim, "Random Walk ProbDist")->setData(std::move(randomWalkPointSims), 1);
         events().notifyDatasetDataChanged(_randomWalkPointSim);
     }
 
@@ -759,7 +884,14 @@ void SPHPlugin::computeEmbedding()
 
         tSNEParams.symmetricProbDist = true;    // LevelSimilarities computes symmetric probability distributions
 
-        _computeEmbedding.startComputation(*_currentTransitionMatrix, tSNEParams);
+        setTsneEngine(_computeEmbedding, _currentLevel);
+
+        if (_landmarkEmbedding)
+            computeLandmarkEmbedding(tSNEParams);
+        else if (auto checkpointState = updateCheckpoint(tSNEParams, /* loadState = */ true))
+            _computeEmbedding.resumeComputation(*_currentTransitionMatrix, tSNEParams, std::move(*checkpointState));
+        else
+            _computeEmbedding.startComputation(*_currentTransitionMatrix, tSNEParams);
     }
     else {
         sph::UmapEmbeddingParameters umapParams;
@@ -771,9 +903,163 @@ void SPHPlugin::computeEmbedding()
 
 }
 
+void SPHPlugin::setTsneEngine(ComputeEmbeddingWrapper& computeEmbedding, int64_t level)
+{
+    const TsneEngine engine = _settingsAction.getTsneSettingsAction().getTsneEngine();
+
+    if (engine != TsneEngine::HIERARCHY)
+    {
+        computeEmbedding.setTsneEngine(engine);
+        return;
+    }
+
+    const auto& hierarchy = _computeHierarchy.getHierarchy();
+
+    if (!HierarchyRepulsion::canUse(hierarchy, level))
+    {
+        Log::info("SPHPlugin::setTsneEngine: there is no level above level {0}, using the Barnes-Hut CPU engine", level);
+        computeEmbedding.setTsneEngine(TsneEngine::BARNES_HUT);
+        return;
+    }
+
+    computeEmbedding.setTsneEngine(engine, std::make_shared<HierarchyRepulsion>(hierarchy, level));
+}
+
+std::optional<CpuTsneState> SPHPlugin::updateCheckpoint(const sph::TsneEmbeddingParameters& params, bool loadState)
+{
+    const TsneEngine engine = _settingsAction.getTsneSettingsAction().getTsneEngine();
+
+    // only the plugin's CPU engines expose their state
+    if (engine == TsneEngine::LIBRARY || !_settingsAction.getHierarchySettingsAction().getCachingActiveAction().isChecked())
+    {
+        _computeEmbedding.setCheckpoint({}, 0);
+        return std::nullopt;
+    }
+
+    const auto path = EmbeddingCheckpoint::getPath(getCacheDirectory(), _currentLevel);
+    const uint64_t key = EmbeddingCheckpoint::computeKey(_inputData->getGuiName().toStdString(), _currentLevel, *_currentTransitionMatrix, engine, params);
+
+    _computeEmbedding.setCheckpoint(path, key);
+
+    if (!loadState)
+        return std::nullopt;
+
+    return EmbeddingCheckpoint::load(path, key, _numCurrentEmbPoints);
+}
+
+std::filesystem::path SPHPlugin::getCacheDirectory()
+{
+    const auto filePath = QFileInfo(getInputDataset<Images>()->getImageFilePaths().first()).dir().absolutePath().toStdString();
+    return std::filesystem::path(filePath) / "sph-cache";
+}
+
+std::shared_ptr<const LandmarkEmbedding> SPHPlugin::createLandmarkEmbedding()
+{
+    auto& advancedSettings = _settingsAction.getAdvancedSettingsAction();
+
+    if (!advancedSettings.getLandmarkEmbeddingAction().isChecked())
+        return nullptr;
+
+    const auto& hierarchy = _computeHierarchy.getHierarchy();
+    const auto maxLandmarks = static_cast<uint64_t>(advancedSettings.getMaxLandmarksAction().getValue());
+    const int64_t landmarkLevel = LandmarkEmbedding::findLandmarkLevel(hierarchy, _currentLevel, maxLandmarks);
+
+    if (landmarkLevel < 0)
+        return nullptr;
+
+    return std::make_shared<const LandmarkEmbedding>(hierarchy, _currentLevel, landmarkLevel);
+}
+
+void SPHPlugin::computeLandmarkEmbedding(const sph::TsneEmbeddingParameters& params)
+{
+    assert(_landmarkEmbedding);
+
+    _landmarkPolishParams = params;
+
+    // the polish runs with other parameters than a regular embedding of the level
+    _computeEmbedding.setCheckpoint({}, 0);
+
+    const int64_t landmarkLevel = _landmarkEmbedding->getLandmarkLevel();
+    const uint64_t numLandmarks = _landmarkEmbedding->getNumLandmarks();
+
+    auto landmarkParams = params;
+    if (_settingsAction.getTsneSettingsAction().getExaggerationToggleAction().isChecked())
+        landmarkParams.gradDescentParams._exaggeration_factor = 4 + numLandmarks / 60000.0;
+
+    Log::info("SPHPlugin::computeLandmarkEmbedding: embedding {0} landmarks on level {1}", numLandmarks, landmarkLevel);
+
+    setTsneEngine(_computeLandmarkEmbedding, landmarkLevel);
+    _computeLandmarkEmbedding.initEmbedding(landmarkLevel, numLandmarks);
+    _computeLandmarkEmbedding.setNumIterations(0);
+    _computeLandmarkEmbedding.startComputation(_computeHierarchy.getProbDistOnLevel(landmarkLevel), landmarkParams);
+}
+
+void SPHPlugin::placeByLandmarks()
+{
+    if (!_landmarkEmbedding || _landmarkEmbedding->getLevel() != _currentLevel)
+        return;
+
+    // interpolation scales with the number of transition entries, do not block the UI
+    _backgroundTasks.start([guard = QPointer<SPHPlugin>(this), landmarkEmbedding = _landmarkEmbedding, landmarkLayout = _computeLandmarkEmbedding.getEmbedding(), probDist = _currentTransitionMatrix]() mutable {
+        auto embedding = landmarkEmbedding->interpolate(*probDist, landmarkLayout);
+
+        QMetaObject::invokeMethod(qApp, [guard = std::move(guard), landmarkEmbedding = std::move(landmarkEmbedding), embedding = std::move(embedding)]() mutable {
+            // the level changed or the embedding was restarted in the meantime
+            if (guard.isNull() || guard->_landmarkEmbedding != landmarkEmbedding)
+                return;
+
+            guard->_landmarkEmbedding.reset();
+
+            const auto level = landmarkEmbedding->getLevel();
+            const auto numPoints = landmarkEmbedding->getNumPoints();
+            guard->_computeEmbedding.initEmbedding(level, numPoints, std::move(embedding));
+
+            // polish without exaggeration and at the final momentum, the layout is already globally arranged
+            auto polishParams = guard->_landmarkPolishParams;
+            polishParams.numIterations = guard->_settingsAction.getAdvancedSettingsAction().getLandmarkPolishIterAction().getValue();
+            polishParams.gradDescentParams._remove_exaggeration_iter = 0;
+            polishParams.gradDescentParams._exponential_decay_iter = 0;
+            polishParams.gradDescentParams._mom_switching_iter = 0;
+
+            Log::info("SPHPlugin::placeByLandmarks: placed {0} points, polishing for {1} iterations", numPoints, polishParams.numIterations);
+
+            guard->_computeEmbedding.setNumIterations(0);
+            guard->_computeEmbedding.startComputation(*guard->_currentTransitionMatrix, polishParams);
+            }, Qt::QueuedConnection);
+        });
+}
+
 void SPHPlugin::updateColorImage()
 {
-    extractEmbPositions(getOutputDataset<Points>(), *_mappingLevelToData, _imgSize, _dataColoredByEmb);
+    extractEmbPositions(getOutputDataset<Points>(), *_mappingLevelToData, _imgSize, getOrCreateDerivedDataset(_dataColoredByEmb, "Scatter colors"));
+    updateDerivedImage(_imgColoredByEmb, "Scatter colors", _dataColoredByEmb, 2);
+}
+
+mv::Dataset<Points>& SPHPlugin::getOrCreateDerivedDataset(mv::Dataset<Points>& dataset, const QString& name)
+{
+    if (!dataset.isValid())
+        dataset = mv::data().createDataset<Points>("Points", name, getOutputDataset());
+
+    return dataset;
+}
+
+void SPHPlugin::updateDerivedImage(mv::Dataset<Images>& image, const QString& name, const mv::Dataset<Points>& points, uint32_t numImages)
+{
+    // the image layout has to be created after its points hold data
+    if (!image.isValid())
+    {
+        image = mv::data().createDataset<Images>("Images", name, points);
+
+        image->setType(ImageData::Type::Stack);
+        image->setImageSize(_imgSize);
+        image->setNumberOfComponentsPerPixel(1);
+    }
+
+    else if (image->getNumberOfImages() == numImages)
+        return;
+
+    image->setNumberOfImages(numImages);
+    events().notifyDatasetDataChanged(image);
 }
 
 NearestNeighborsSettings SPHPlugin::getDataKnnSettings()
@@ -901,6 +1187,136 @@ utils::RandomWalkSettings SPHPlugin::getRandomWalkSettings()
     return rwSettings;
 }
 
+void SPHPlugin::updateInputValues(InputAccess access)
+{
+    _inputValues = nullptr;
+
+    // the hierarchy is computed for the shape of the input at init
+    if (_inputData->getNumPoints() != _data.numPoints || _enabledDimensions.empty() || _enabledDimensions.back() >= _inputData->getNumDimensions())
+    {
+        Log::warn("SPHPlugin::updateInputValues: the input data does not match its shape at init or no dimension is enabled, the plugin continues with zeros");
+        _data.numDimensions = _enabledDimensions.size();
+        _data.dataVec.assign(_data.numDimensions * _data.numPoints, 0.f);
+        _inputValues = _data.dataVec.data();
+        return;
+    }
+
+    // subsets of a dataset are not contiguous in its buffer
+    const bool readInPlace = access != InputAccess::COPY && _inputData->isFull() && _data.numPoints > 0;
+
+    if (readInPlace && _enabledDimensions.size() == _inputData->getNumDimensions() && _inputData->getDataType() == PointData::ElementTypeSpecifier::float32)
+    {
+        _inputData->constVisitFromBeginToEnd([this](auto begin, auto end) {
+            if constexpr (std::is_same_v<std::remove_cvref_t<decltype(*begin)>, float>)
+                _inputValues = begin != end ? &*begin : nullptr;
+            });
+    }
+
+    const bool readNatively = readInPlace && _inputValues == nullptr && access == InputAccess::NATIVE;
+
+    if (_inputValues == nullptr && !readNatively)
+    {
+        copyInputData();
+        return;
+    }
+
+    // a previous copy is not needed anymore
+    _data.numDimensions = _enabledDimensions.size();
+    _data.dataVec = {};
+
+    if (readNatively)
+        Log::info("SPHPlugin::updateInputValues: reading the input data in place in its element type");
+    else
+        Log::info("SPHPlugin::updateInputValues: using the input data in place");
+}
+
+template<typename Visitor>
+void SPHPlugin::visitInputValues(Visitor&& visitor)
+{
+    // float values in the plugin's copy or in the ManiVault buffer hold the enabled dimensions contiguously
+    if (_inputValues != nullptr)
+    {
+        std::vector<uint32_t> dimensions(_data.numDimensions);
+        std::iota(dimensions.begin(), dimensions.end(), 0u);
+        visitor(_inputValues, dimensions.size(), dimensions);
+        return;
+    }
+
+    const auto numInputDimensions = static_cast<size_t>(_inputData->getNumDimensions());
+    _inputData->constVisitFromBeginToEnd([&](auto begin, auto end) {
+        if (begin != end)
+            visitor(&*begin, numInputDimensions, _enabledDimensions);
+        });
+}
+
+std::vector<float> SPHPlugin::computeInputAverages(const sph::vvui64& mappingLevelToData)
+{
+    std::vector<float> averages;
+    visitInputValues([&](const auto* values, size_t rowStride, const std::vector<uint32_t>& dimensions) {
+        averages = computeAveragePerDimensionForSuperpixels(values, rowStride, dimensions, mappingLevelToData);
+        });
+    return averages;
+}
+
+std::vector<float> SPHPlugin::computeInputAverages(const sph::vvui64& mappingLevelToData, const std::vector<uint64_t>& superpixelIDs)
+{
+    std::vector<float> averages;
+    visitInputValues([&](const auto* values, size_t rowStride, const std::vector<uint32_t>& dimensions) {
+        averages = computeAveragePerDimensionForSuperpixels(values, rowStride, dimensions, mappingLevelToData, superpixelIDs);
+        });
+    return averages;
+}
+
+std::vector<float> SPHPlugin::computeInputPca(const RandomizedPca::Settings& settings)
+{
+    std::vector<float> projection;
+    visitInputValues([&](const auto* values, size_t rowStride, const std::vector<uint32_t>& dimensions) {
+        const auto readRow = [values, rowStride, &dimensions](uint64_t point, float* row) {
+            const auto* inputRow = values + point * rowStride;
+            for (size_t dim = 0; dim < dimensions.size(); dim++)
+                row[dim] = static_cast<float>(inputRow[dimensions[dim]]);
+            };
+
+        projection = RandomizedPca::compute(readRow, _data.numPoints, dimensions.size(), settings);
+        });
+    return projection;
+}
+
+void SPHPlugin::copyInputData()
+{
+    const std::vector<uint32_t>& enabledDimensionsIDs = _enabledDimensions;
+    const auto numInputDimensions = static_cast<size_t>(_inputData->getNumDimensions());
+    const auto numDimensions = enabledDimensionsIDs.size();
+    const auto numPoints = static_cast<int64_t>(_data.numPoints);
+
+    _data.numDimensions = numDimensions;
+    _data.dataVec.resize(numDimensions * numPoints);
+
+    if (!_inputData->isFull() || numPoints == 0) {
+        _inputData->populateDataForDimensions<std::vector<float>, std::vector<uint32_t>>(_data.dataVec, enabledDimensionsIDs);
+    }
+    else {
+        // converts from the native element type, e.g. uint8 or uint16 sensor values, in one parallel pass over the points
+        _inputData->constVisitFromBeginToEnd([&](auto begin, auto end) {
+            const auto* values = &*begin;
+            float* converted = _data.dataVec.data();
+
+            SPH_PARALLEL
+            for (int64_t point = 0; point < numPoints; point++) {
+                const auto* inputRow = values + point * numInputDimensions;
+                float* row = converted + point * numDimensions;
+
+                for (size_t dim = 0; dim < numDimensions; dim++)
+                    row[dim] = static_cast<float>(inputRow[enabledDimensionsIDs[dim]]);
+            }
+            });
+    }
+
+    _inputValues = _data.dataVec.data();
+
+    Log::info("SPHPlugin::copyInputData: {0} of {1} dimensions of {2} points", numDimensions, numInputDimensions, numPoints);
+}
+
 std::vector<uint32_t> SPHPlugin::getEnabledDimensions()
 {
     Log::trace("InteractiveHsnePlugin:: enabledDimensions");
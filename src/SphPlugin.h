@@ -5,17 +5,28 @@
 
 #include "ComputeEmbeddingWrapper.h"
 #include "ComputeHierarchyWrapper.h"
+#include "EmbeddingService.h"
+#include "LandmarkEmbedding.h"
+#include "RandomizedPca.h"
 #include "SettingsAction.h"
+#include "SubGraphCache.h"
 
 #include <sph/utils/CommonDefinitions.hpp>
 #include <sph/utils/Data.hpp>
 
 #include <array>
 #include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <optional>
 #include <ranges>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include <QSize>
+#include <QThreadPool>
 
 using namespace mv::plugin;
 using namespace mv::gui;
@@ -58,9 +69,18 @@ public:
 
 public:
     mv::Dataset<Points> getInputDataSet() { return _inputData; }
-    sph::utils::DataView getInputData() { return _data.getDataView(); }
+    /** Read-only float view of the enabled input dimensions, only valid while the values are held as float (see InputAccess) */
+    sph::utils::DataView getInputData() const { return sph::utils::DataView{ _inputValues, _data.numPoints, _data.numDimensions }; }
+    /** Averages of the enabled input dimensions per superpixel, read in the element type of the input */
+    std::vector<float> computeInputAverages(const sph::vvui64& mappingLevelToData);
+    std::vector<float> computeInputAverages(const sph::vvui64& mappingLevelToData, const std::vector<uint64_t>& superpixelIDs);
+    size_t getNumEnabledDimensions() const { return _enabledDimensions.size(); }
     QSize getImageSize() const { return _imgSize; }
     ComputeHierarchyWrapper* getComputeHierarchy() { return &_computeHierarchy; }
+    EmbeddingService* getEmbeddingService() { return &_embeddingService; }
+    SettingsAction& getSettingsAction() { return _settingsAction; }
+    SubGraphCache* getSubGraphCache() { return &_subGraphCache; }
+    QThreadPool* getBackgroundTasks() { return &_backgroundTasks; }
     const sph::vui64* getMappingDataToLevel(uint64_t level) const { return &(_computeHierarchy.getHierarchy().mapFromPixelToLevel()[level]); }
     const sph::vvui64* getMappingLevelToData(uint64_t level) const { return &(_computeHierarchy.getHierarchy().mapFromLevelToPixel[level]); }
 
@@ -96,10 +116,43 @@ private:
 
     void computeEmbedding();
 
+    /** Sets the t-SNE engine of the settings for an embedding of level, the hierarchy engine falls back to Barnes-Hut on the top level */
+    void setTsneEngine(ComputeEmbeddingWrapper& computeEmbedding, int64_t level);
+
+    /**
+     * Sets the checkpoint of the current level for the CPU t-SNE engines if caching is active, disables checkpoints otherwise
+     * @return State of a matching checkpoint if loadState is set
+     */
+    std::optional<CpuTsneState> updateCheckpoint(const sph::TsneEmbeddingParameters& params, bool loadState);
+
+    /** Landmarks of the current level if landmark embedding is enabled and the level is large, nullptr otherwise */
+    std::shared_ptr<const LandmarkEmbedding> createLandmarkEmbedding();
+
+    /** Embeds the landmark level of _landmarkEmbedding, placeByLandmarks continues once it finished */
+    void computeLandmarkEmbedding(const sph::TsneEmbeddingParameters& params);
+
+    /** Places all points of the current level by the landmark embedding in the background and polishes their layout */
+    void placeByLandmarks();
+
+    /** Re-optimizes the selected embedding points and their neighbors in the background, all other points stay fixed */
+    void reoptimizeSelection();
+
+    /** Places all pixels in the current embedding in the background, by their superpixel and their neighbors on the data level */
+    void computePixelEmbedding();
+
     void deselectAll();
 
     void setEmbeddingInManiVault(const std::vector<float>& emb);
 
+private:
+    /** How the enabled input dimensions are held */
+    enum class InputAccess
+    {
+        NATIVE,     /** In place in the element type of the input if possible, e.g. uint8 or uint16 sensor values */
+        FLOAT,      /** As float values, in place for float input, e.g. for the library computations */
+        COPY,       /** As a float copy that can be scaled */
+    };
+
 private: // convenience
     sph::NearestNeighborsSettings getDataKnnSettings();
     sph::ImageHierarchySettings getImageHierarchySettings();
@@ -111,6 +164,30 @@ private: // convenience
 
     std::vector<uint32_t> getEnabledDimensions();
 
+    /** Reads the enabled dimensions of the input in place if the access allows it, copies them to _data otherwise */
+    void updateInputValues(InputAccess access);
+
+    /** Calls visitor(values, rowStride, dimensions) with the enabled dimensions in the float copy or in the native input buffer */
+    template<typename Visitor>
+    void visitInputValues(Visitor&& visitor);
+
+    /** PCA of the enabled input dimensions of all points, read in the element type of the input */
+    std::vector<float> computeInputPca(const RandomizedPca::Settings& settings);
+
+    /** Copies the enabled dimensions of the input to _data as float, needed by the library for other element types, for subsets of datasets and for normalization */
+    void copyInputData();
+
+    bool ownsInputData() const { return _inputValues != nullptr && _inputValues == _data.dataVec.data(); }
+
+    /** sph-cache next to the input images */
+    std::filesystem::path getCacheDirectory();
+
+    /** Derived datasets are created below the output when their first result is published, returns dataset */
+    mv::Dataset<Points>& getOrCreateDerivedDataset(mv::Dataset<Points>& dataset, const QString& name);
+
+    /** Creates the image layout of points on first use and sets its number of images */
+    void updateDerivedImage(mv::Dataset<Images>& image, const QString& name, const mv::Dataset<Points>& points, uint32_t numImages);
+
 private: // locking
     inline void markAsHandled(const SelectionDatasets& dataLock) {
         _selectionCounters[static_cast<size_t>(dataLock)]++;
@@ -126,9 +203,13 @@ private: // locking
 
 private:
 
+    EmbeddingService            _embeddingService       = {};               /** Worker thread pool for all embeddings, must outlive all ComputeEmbeddingWrapper */
     SettingsAction              _settingsAction         = {this};           /** General settings, contains other settings classes */
 
-    sph::utils::Data            _data                   = {};
+    sph::utils::Data            _data                   = {};               /** Data meta data, holds the values only if the input cannot be used in place */
+    const float*                _inputValues            = nullptr;          /** Enabled input dimensions as float, in the ManiVault buffer or in _data.dataVec, nullptr if read natively */
+    bool                        _isInputScaled          = false;            /** _data.dataVec holds scaled values that are kept after the hierarchy computation */
+    std::vector<uint32_t>       _enabledDimensions      = {};               /** Dimension selection at init, used for all computations */
 
     const sph::SparseMatHDI*    _currentTransitionMatrix = nullptr;
 
@@ -149,6 +230,9 @@ private:
 
     ComputeEmbeddingWrapper     _computeEmbedding       = { "t-SNE Analysis" };
     ComputeHierarchyWrapper     _computeHierarchy       = { "Image Hierarchy Wrapper" };
+    ComputeEmbeddingWrapper     _computeLandmarkEmbedding = { "Landmark Analysis" };    /** Embeds the coarser level that places a large current level */
+    std::shared_ptr<const LandmarkEmbedding> _landmarkEmbedding = nullptr;         /** Set while the current level is embedded via landmarks */
+    sph::TsneEmbeddingParameters _landmarkPolishParams  = {};               /** t-SNE settings of the current level for polishing the placed layout */
     size_t                      _numCurrentEmbPoints    = 0;
 
     sph::vf32                   _dataLevelEmbInit       = {};
@@ -159,11 +243,17 @@ private:
     mv::Dataset<Points>         _representSizeDataset   = { };              /** Dataset that stores how many data point are represented by a component on the current level */
     mv::Dataset<Points>         _notMergedNotesDataset  = { };              /** Dataset that stores how if a point was merged */
     mv::Dataset<Points>         _randomWalkPointSim     = { };              /** For a selected point, show the random walk similarities with this helper data set */
+    mv::Dataset<Points>         _pixelEmbedding         = { };              /** All pixels placed in the current embedding, created on request */
 
     mv::Dataset<Points>         _avgComponentDataSuper  = { };              /** Average data of superpixels */
+    sph::vf32                   _avgDataSuperpixels     = { };              /** Average data of superpixels on the current level, kept for the init embedding */
     mv::Dataset<Points>         _avgComponentDataPixel  = { };              /** Average data of superpixels mapped to pixels (data values) */
     mv::Dataset<Images>         _avgComponentDataPixelImg = { };            /** Average data of superpixels mapped to pixels (image) */
 
+    SubGraphCache               _subGraphCache          = { };              /** Extracted refinement sub graphs of the current hierarchy */
+    std::map<std::pair<int64_t, std::string>, sph::vf32> _initEmbeddingCache = { };  /** PCA and spectral init embeddings by level and init method, of the current hierarchy */
+    QThreadPool                 _backgroundTasks        = { };              /** Waits on destruction for tasks that reference the hierarchy, declared last */
+
 };
 
 /// ////////////// ///
@@ -0,0 +1,129 @@
+#include "SubGraphCache.h"
+
+#include <sph/utils/Logger.hpp>
+#include <sph/utils/Math.hpp>
+
+#include <ankerl/unordered_dense.h>
+#include <hdi/data/map_mem_eff.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+
+using namespace sph;
+
+SubGraphCache::SubGraphCache(size_t maxEntries) :
+    _maxEntries(std::max<size_t>(maxEntries, 1))
+{
+}
+
+bool SubGraphCache::isExact(float exactness)
+{
+    return utils::isBasicallyEqual(exactness, 1.f, 0.001);
+}
+
+std::shared_ptr<const SubGraph> SubGraphCache::extract(const SparseMatHDI& probDist, const std::vector<uint64_t>& selection, float exactness)
+{
+    assert(std::ranges::is_sorted(selection));
+
+    auto subGraph = std::make_shared<SubGraph>();
+    auto& levelIDs = subGraph->levelIDs;
+
+    if (isExact(exactness))
+        levelIDs = selection;
+    else
+    {
+        // connected vertices: the rows of the selection mark their neighbors with a transition value above the exactness in parallel,
+        // all marked vertices are compacted to sorted level IDs
+        std::vector<uint8_t> isIncluded(probDist.size(), 0);
+
+        SPH_PARALLEL
+        for (int64_t selectionID = 0; selectionID < static_cast<int64_t>(selection.size()); selectionID++)
+        {
+            std::atomic_ref<uint8_t>(isIncluded[selection[selectionID]]).store(1, std::memory_order_relaxed);
+
+            for (const auto& [levelID, value] : probDist[selection[selectionID]])
+                if (value > exactness)
+                    std::atomic_ref<uint8_t>(isIncluded[levelID]).store(1, std::memory_order_relaxed);
+        }
+
+        levelIDs.reserve(selection.size());
+        for (uint64_t levelID = 0; levelID < isIncluded.size(); levelID++)
+            if (isIncluded[levelID])
+                levelIDs.push_back(levelID);
+    }
+
+    const size_t numVertices = levelIDs.size();
+
+    ankerl::unordered_dense::map<uint64_t, uint32_t> levelToSubIDs;
+    levelToSubIDs.reserve(numVertices);
+
+    for (size_t subID = 0; subID < numVertices; subID++)
+        levelToSubIDs[levelIDs[subID]] = static_cast<uint32_t>(subID);
+
+    subGraph->transitionMatrix.resize(numVertices);
+
+    // rows are independent, the level IDs are sorted such that columns are inserted in ascending order
+    SPH_PARALLEL
+    for (int64_t subID = 0; subID < static_cast<int64_t>(numVertices); subID++)
+    {
+        auto& row = subGraph->transitionMatrix[subID];
+
+        for (const auto& [levelID, value] : probDist[levelIDs[subID]])
+        {
+            const auto it = levelToSubIDs.find(levelID);
+            if (it != levelToSubIDs.end())
+                row[it->second] = value;
+        }
+    }
+
+    return subGraph;
+}
+
+uint64_t SubGraphCache::hashSelection(const std::vector<uint64_t>& selection)
+{
+    const auto hasher = ankerl::unordered_dense::hash<uint64_t>{};
+
+    uint64_t hash = selection.size();
+    for (const auto id : selection)
+        hash ^= hasher(id) + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+
+    return hash;
+}
+
+std::shared_ptr<const SubGraph> SubGraphCache::find(uint64_t level, const std::vector<uint64_t>& selection, float exactness)
+{
+    const uint64_t selectionHash = hashSelection(selection);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    const auto it = std::ranges::find_if(_entries, [&](const Entry& entry) {
+        return entry.level == level && entry.selectionHash == selectionHash && utils::isBasicallyEqual(entry.exactness, exactness, 0.001f) && entry.selection == selection;
+        });
+
+    if (it == _entries.end())
+        return nullptr;
+
+    // move to front
+    _entries.splice(_entries.begin(), _entries, it);
+
+    Log::info("SubGraphCache::find: re-use sub graph with {0} vertices on level {1}", it->subGraph->levelIDs.size(), level);
+
+    return it->subGraph;
+}
+
+void SubGraphCache::insert(uint64_t level, const std::vector<uint64_t>& selection, float exactness, std::shared_ptr<const SubGraph> subGraph)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    _entries.push_front({ level, hashSelection(selection), exactness, selection, std::move(subGraph) });
+
+    while (_entries.size() > _maxEntries)
+        _entries.pop_back();
+}
+
+void SubGraphCache::clear()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _entries.clear();
+}
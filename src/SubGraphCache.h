@@ -0,0 +1,61 @@
+#pragma once
+
+#include <sph/utils/CommonDefinitions.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/// ///////////// ///
+/// SubGraphCache ///
+/// ///////////// ///
+
+/** Transition matrix between the vertices levelIDs of a hierarchy level */
+struct SubGraph
+{
+    sph::SparseMatHDI       transitionMatrix = {};  /** Rows and columns index levelIDs */
+    std::vector<uint64_t>   levelIDs = {};          /** Vertex IDs on the level, sorted */
+};
+
+/** Memoizes sub graphs extracted for refinements by (level, selection, exactness), such that repeating a refinement is immediate */
+class SubGraphCache
+{
+public:
+    SubGraphCache(size_t maxEntries = 8);
+
+    /**
+     * Extracts the rows of selection (sorted and unique) in parallel. Exactness 1 only keeps edges within the selection,
+     * lower values also add the vertices that a selected row connects to with a transition value above the exactness
+     */
+    static std::shared_ptr<const SubGraph> extract(const sph::SparseMatHDI& probDist, const std::vector<uint64_t>& selection, float exactness);
+
+    /** Returns nullptr if the sub graph is not cached */
+    std::shared_ptr<const SubGraph> find(uint64_t level, const std::vector<uint64_t>& selection, float exactness);
+
+    void insert(uint64_t level, const std::vector<uint64_t>& selection, float exactness, std::shared_ptr<const SubGraph> subGraph);
+
+    /** Call when the hierarchy changes */
+    void clear();
+
+    static bool isExact(float exactness);
+
+private:
+    struct Entry
+    {
+        uint64_t                        level = 0;
+        uint64_t                        selectionHash = 0;
+        float                           exactness = 1.f;
+        std::vector<uint64_t>           selection = {};     /** Guards against hash collisions */
+        std::shared_ptr<const SubGraph> subGraph = nullptr;
+    };
+
+    static uint64_t hashSelection(const std::vector<uint64_t>& selection);
+
+private:
+    std::list<Entry>    _entries = {};          /** Most recently used first */
+    size_t              _maxEntries = 8;
+    std::mutex          _mutex = {};
+};
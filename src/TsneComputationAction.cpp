@@ -6,17 +6,23 @@ TsneComputationAction::TsneComputationAction(QObject* parent) :
     HorizontalGroupAction(parent, "TsneComputationAction"),
     _continueComputationAction(this, "Continue"),
     _stopComputationAction(this, "Stop"),
-    _restartComputationAction(this, "Restart")
+    _restartComputationAction(this, "Restart"),
+    _reoptimizeSelectionAction(this, "Re-optimize selection"),
+    _pixelEmbeddingAction(this, "Pixel embedding")
 {
     setText("Computation");
 
     addAction(&_continueComputationAction);
     addAction(&_stopComputationAction);
     addAction(&_restartComputationAction);
+    addAction(&_reoptimizeSelectionAction);
+    addAction(&_pixelEmbeddingAction);
 
     _continueComputationAction.setToolTip("Continue with the t-SNE computation");
     _stopComputationAction.setToolTip("Stop the current t-SNE computation");
     _restartComputationAction.setToolTip("Restart with new gradient descent settings");
+    _reoptimizeSelectionAction.setToolTip("Re-optimize the selected points and their neighbors, all other points stay fixed");
+    _pixelEmbeddingAction.setToolTip("Place every pixel in the current embedding by its superpixel and its data neighbors, without gradient descent");
 
     _continueComputationAction.setEnabled(false);
 }
@@ -27,6 +33,7 @@ QMenu* TsneComputationAction::getContextMenu(QWidget* parent /*= nullptr*/)
 
     menu->addAction(&_continueComputationAction);
     menu->addAction(&_stopComputationAction);
+    menu->addAction(&_reoptimizeSelectionAction);
 
     return menu;
 }
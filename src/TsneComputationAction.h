@@ -43,9 +43,13 @@ public: // Action getters
     mv::gui::TriggerAction& getContinueComputationAction() { return _continueComputationAction; }
     mv::gui::TriggerAction& getStopComputationAction() { return _stopComputationAction; }
     mv::gui::TriggerAction& getRestartComputationAction() { return _restartComputationAction; }
+    mv::gui::TriggerAction& getReoptimizeSelectionAction() { return _reoptimizeSelectionAction; }
+    mv::gui::TriggerAction& getPixelEmbeddingAction() { return _pixelEmbeddingAction; }
 
 private:
     mv::gui::TriggerAction   _continueComputationAction;     /** Continue computation action */
     mv::gui::TriggerAction   _stopComputationAction;         /** Stop computation action */
     mv::gui::TriggerAction   _restartComputationAction;      /** Stop computation action */
+    mv::gui::TriggerAction   _reoptimizeSelectionAction;     /** Local re-optimization action */
+    mv::gui::TriggerAction   _pixelEmbeddingAction;          /** Projects all pixels into the embedding */
 };
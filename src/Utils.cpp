@@ -7,6 +7,7 @@
 #include <CoreInterface.h>
 #include <PointData/PointData.h>
 
+#include <algorithm>
 #include <cassert>
 #include <cstdint>
 #include <type_traits>
@@ -64,6 +65,10 @@ std::vector<uint32_t> mapSuperPixelToPixel(const mv::Dataset<Points>& selectionD
 
 void copySelection(const mv::Dataset<Points>& selectionInput, mv::Dataset<Points>& selectionOutput)
 {
+    // derived datasets only exist once their first result is published
+    if (!selectionOutput.isValid())
+        return;
+
     const auto& sel = selectionInput->getSelection<Points>()->indices;
     selectionOutput->getSelection<Points>()->indices.assign(sel.cbegin(), sel.cend());
     mv::events().notifyDatasetDataSelectionChanged(selectionOutput);
@@ -71,8 +76,8 @@ void copySelection(const mv::Dataset<Points>& selectionInput, mv::Dataset<Points
 
 void selectionMapping(const mv::Dataset<Points>& selectionInputData, const std::vector<uint64_t>* selectionMap, mv::Dataset<Points> selectionOutputData)
 {
-    // if there is nothing to be mapped, don't do anything
-    if (selectionMap->size() == 0)
+    // if there is nothing to be mapped or no dataset to map to, don't do anything
+    if (selectionMap->size() == 0 || !selectionOutputData.isValid())
         return;
 
     // Selection map is supposed to be of the same size as the selection input data
@@ -86,8 +91,8 @@ void selectionMapping(const mv::Dataset<Points>& selectionInputData, const std::
 
 void selectionMapping(const mv::Dataset<Points>& selectionInputData, const std::vector<std::vector<uint64_t>>* selectionMap, mv::Dataset<Points> selectionOutputData)
 {
-    // if there is nothing to be mapped, don't do anything
-    if (selectionMap->size() == 0)
+    // if there is nothing to be mapped or no dataset to map to, don't do anything
+    if (selectionMap->size() == 0 || !selectionOutputData.isValid())
         return;
 
     // Selection map is supposed to be of the same size as the selection input data
@@ -172,40 +177,124 @@ void extractEmbPositions(const mv::Dataset<Points>& embOnLevel, const sph::vvui6
     mv::events().notifyDatasetDataChanged(embPosOnLevel);
 }
 
-std::vector<float> computeAveragePerDimensionForSuperpixels(const sph::utils::DataView& data, const sph::vvui64& mappingLevelToData) {
+void extractEmbPositions(const mv::Dataset<Points>& embOnLevel, const sph::vvui64& mappingLevelToData, const std::vector<uint64_t>& levelIDs, const QSize& imgSize, const QRect& imageRect, mv::Dataset<Points>& embPosOnLevel)
+{
+    const size_t numImagePoints = static_cast<size_t>(imageRect.height()) * imageRect.width();
+    const int imgWidth = imgSize.width();
+    const uint32_t numEmbPoints = embOnLevel->getNumPoints();
+
+    assert(levelIDs.size() == numEmbPoints);
+    const size_t numColorChannels = 2;
+
+    std::vector<float> embData(static_cast<size_t>(numEmbPoints) * 2);
+    std::vector<uint32_t> embDims{ 0, 1 };
+    embOnLevel->populateDataForDimensions(embData, embDims);
+
+    auto embExtends = sph::utils::computeExtends(embData);
+    float xMin = embExtends.x_min();
+    float yMin = embExtends.y_min();
+
+    std::vector<float> embPos;
+    embPos.resize(static_cast<size_t>(numImagePoints) * numColorChannels, 0.f);
+
+    SPH_PARALLEL
+    for (std::size_t i = 0; i < embPos.size(); ++i)
+        embPos[i] = (i % 2 == 0) ? xMin : yMin;
+
+    SPH_PARALLEL
+    for (int64_t embID = 0; embID < static_cast<int64_t>(numEmbPoints); embID++)
+    {
+        // map the current color to all image points on which embID has the highest influence
+        for (const auto& imgID : mappingLevelToData[levelIDs[embID]])
+        {
+            const uint64_t rectID = imageToRectID(imgID, imgWidth, imageRect);
+            embPos[numColorChannels * rectID] = embData[numColorChannels * embID];
+            embPos[numColorChannels * rectID + 1u] = embData[numColorChannels * embID + 1u];
+        }
+    }
+
+    embPosOnLevel->setData(std::move(embPos), numColorChannels);
+    mv::events().notifyDatasetDataChanged(embPosOnLevel);
+}
+
+template<typename T>
+std::vector<float> computeAveragePerDimensionForSuperpixels(const T* values, size_t rowStride, const std::vector<uint32_t>& dimensions, const sph::vvui64& mappingLevelToData) {
     const size_t numSuperpixels = mappingLevelToData.size();
-    const auto numDimensions    = data.getNumDimensions();
+    const size_t numDimensions  = dimensions.size();
 
     std::vector<float> avgs(static_cast<size_t>(numSuperpixels) * numDimensions, 0.f);
 
     SPH_PARALLEL
-    for (uint64_t superpixelID = 0; superpixelID < numSuperpixels; superpixelID++) {
+    for (int64_t superpixelID = 0; superpixelID < static_cast<int64_t>(numSuperpixels); superpixelID++) {
         const auto& dataIDs = mappingLevelToData[superpixelID];
-        std::vector<float> superpixelAvgs(numDimensions, 0.f);
+        float* superpixelAvgs = avgs.data() + superpixelID * numDimensions;
 
         for (const auto dataID : dataIDs) {
-            const auto dataValues = data.getValuesAt(dataID);
+            const T* dataValues = values + dataID * rowStride;
+
+            for (size_t dim = 0; dim < numDimensions; dim++) {
+                superpixelAvgs[dim] += static_cast<float>(dataValues[dimensions[dim]]);
+            }
+        }
+
+        for (size_t dim = 0; dim < numDimensions; dim++) {
+            superpixelAvgs[dim] /= dataIDs.size();
+        }
+    }
+
+    return avgs;
+}
+
+template<typename T>
+std::vector<float> computeAveragePerDimensionForSuperpixels(const T* values, size_t rowStride, const std::vector<uint32_t>& dimensions, const sph::vvui64& mappingLevelToData, const std::vector<uint64_t>& superpixelIDs) {
+    const size_t numSuperpixels = superpixelIDs.size();
+    const size_t numDimensions  = dimensions.size();
+
+    std::vector<float> avgs(static_cast<size_t>(numSuperpixels) * numDimensions, 0.f);
+
+    SPH_PARALLEL
+    for (int64_t i = 0; i < static_cast<int64_t>(numSuperpixels); i++) {
+        const auto& dataIDs = mappingLevelToData[superpixelIDs[i]];
+        float* superpixelAvgs = avgs.data() + i * numDimensions;
 
-            assert(dataValues.size() == numDimensions);
+        for (const auto dataID : dataIDs) {
+            const T* dataValues = values + dataID * rowStride;
 
-            for (uint32_t dim = 0; dim < numDimensions; dim++) {
-                superpixelAvgs[dim] += dataValues[dim];
+            for (size_t dim = 0; dim < numDimensions; dim++) {
+                superpixelAvgs[dim] += static_cast<float>(dataValues[dimensions[dim]]);
             }
         }
 
-        for (uint32_t dim = 0; dim < numDimensions; dim++) {
-            avgs[superpixelID * numDimensions + dim] = superpixelAvgs[dim] / dataIDs.size();
+        for (size_t dim = 0; dim < numDimensions; dim++) {
+            superpixelAvgs[dim] /= dataIDs.size();
         }
     }
 
     return avgs;
 }
 
-std::vector<float> mapSuperpixelAverageToPixels(const std::vector<float>& averagesSuperpixels, int64_t numDataPoints, const sph::vvui64& mappingLevelToData) {
+// all element types of ManiVault points
+#define SPH_INSTANTIATE_AVERAGES(T) \
+    template std::vector<float> computeAveragePerDimensionForSuperpixels<T>(const T*, size_t, const std::vector<uint32_t>&, const sph::vvui64&); \
+    template std::vector<float> computeAveragePerDimensionForSuperpixels<T>(const T*, size_t, const std::vector<uint32_t>&, const sph::vvui64&, const std::vector<uint64_t>&);
+
+SPH_INSTANTIATE_AVERAGES(float)
+SPH_INSTANTIATE_AVERAGES(biovault::bfloat16_t)
+SPH_INSTANTIATE_AVERAGES(int32_t)
+SPH_INSTANTIATE_AVERAGES(uint32_t)
+SPH_INSTANTIATE_AVERAGES(int16_t)
+SPH_INSTANTIATE_AVERAGES(uint16_t)
+SPH_INSTANTIATE_AVERAGES(int8_t)
+SPH_INSTANTIATE_AVERAGES(uint8_t)
+
+#undef SPH_INSTANTIATE_AVERAGES
+
+template<typename T>
+std::vector<T> mapSuperpixelAverageToPixels(const std::vector<float>& averagesSuperpixels, int64_t numDataPoints, const sph::vvui64& mappingLevelToData) {
     const size_t numSuperpixels = mappingLevelToData.size();
     const int64_t numDimensions = averagesSuperpixels.size() / numSuperpixels;
 
-    std::vector<float> pixelAvgs(numDataPoints * numDimensions, 0.f);
+    std::vector<T> pixelAvgs(numDataPoints * numDimensions, static_cast<T>(0.f));
 
     SPH_PARALLEL
     for (uint64_t superpixelID = 0; superpixelID < numSuperpixels; superpixelID++) {
@@ -213,10 +302,111 @@ std::vector<float> mapSuperpixelAverageToPixels(const std::vector<float>& averag
 
         for (const auto dataID : dataIDs) {
             for (int64_t dim = 0; dim < numDimensions; dim++) {
-                pixelAvgs[dataID * numDimensions + dim] = averagesSuperpixels[superpixelID * numDimensions + dim];
+                pixelAvgs[dataID * numDimensions + dim] = static_cast<T>(averagesSuperpixels[superpixelID * numDimensions + dim]);
+            }
+        }
+    }
+
+    return pixelAvgs;
+}
+
+template<typename T>
+std::vector<T> mapSuperpixelAverageToPixels(const std::vector<float>& averagesSuperpixels, const QSize& imgSize, const QRect& imageRect, const sph::vvui64& mappingLevelToData, const std::vector<uint64_t>& superpixelIDs) {
+    const size_t numSuperpixels = superpixelIDs.size();
+    const int64_t numDimensions = averagesSuperpixels.size() / numSuperpixels;
+    const int64_t numRectPoints = static_cast<int64_t>(imageRect.height()) * imageRect.width();
+    const int imgWidth          = imgSize.width();
+
+    std::vector<T> pixelAvgs(numRectPoints * numDimensions, static_cast<T>(0.f));
+
+    SPH_PARALLEL
+    for (int64_t i = 0; i < static_cast<int64_t>(numSuperpixels); i++) {
+        const auto& dataIDs = mappingLevelToData[superpixelIDs[i]];
+
+        for (const auto dataID : dataIDs) {
+            const uint64_t rectID = imageToRectID(dataID, imgWidth, imageRect);
+            for (int64_t dim = 0; dim < numDimensions; dim++) {
+                pixelAvgs[rectID * numDimensions + dim] = static_cast<T>(averagesSuperpixels[i * numDimensions + dim]);
             }
         }
     }
 
     return pixelAvgs;
 }
+
+template std::vector<float> mapSuperpixelAverageToPixels<float>(const std::vector<float>&, int64_t, const sph::vvui64&);
+template std::vector<biovault::bfloat16_t> mapSuperpixelAverageToPixels<biovault::bfloat16_t>(const std::vector<float>&, int64_t, const sph::vvui64&);
+template std::vector<float> mapSuperpixelAverageToPixels<float>(const std::vector<float>&, const QSize&, const QRect&, const sph::vvui64&, const std::vector<uint64_t>&);
+template std::vector<biovault::bfloat16_t> mapSuperpixelAverageToPixels<biovault::bfloat16_t>(const std::vector<float>&, const QSize&, const QRect&, const sph::vvui64&, const std::vector<uint64_t>&);
+
+void setAverageData(mv::Dataset<Points>& dataset, const std::vector<float>& averages, size_t numDimensions, AveragePrecision precision) {
+    if (precision == AveragePrecision::FLOAT32) {
+        dataset->setData(averages, numDimensions);
+        return;
+    }
+
+    std::vector<biovault::bfloat16_t> compactAverages(averages.size());
+
+    SPH_PARALLEL
+    for (int64_t i = 0; i < static_cast<int64_t>(averages.size()); i++)
+        compactAverages[i] = static_cast<biovault::bfloat16_t>(averages[i]);
+
+    dataset->setData(std::move(compactAverages), numDimensions);
+}
+
+void setPixelAverageData(mv::Dataset<Points>& dataset, const std::vector<float>& averagesSuperpixels, int64_t numDataPoints, const sph::vvui64& mappingLevelToData, AveragePrecision precision) {
+    const size_t numDimensions = averagesSuperpixels.size() / mappingLevelToData.size();
+
+    if (precision == AveragePrecision::BFLOAT16)
+        dataset->setData(mapSuperpixelAverageToPixels<biovault::bfloat16_t>(averagesSuperpixels, numDataPoints, mappingLevelToData), numDimensions);
+    else
+        dataset->setData(mapSuperpixelAverageToPixels<float>(averagesSuperpixels, numDataPoints, mappingLevelToData), numDimensions);
+}
+
+void setPixelAverageData(mv::Dataset<Points>& dataset, const std::vector<float>& averagesSuperpixels, const QSize& imgSize, const QRect& imageRect, const sph::vvui64& mappingLevelToData, const std::vector<uint64_t>& superpixelIDs, AveragePrecision precision) {
+    const size_t numDimensions = averagesSuperpixels.size() / superpixelIDs.size();
+
+    if (precision == AveragePrecision::BFLOAT16)
+        dataset->setData(mapSuperpixelAverageToPixels<biovault::bfloat16_t>(averagesSuperpixels, imgSize, imageRect, mappingLevelToData, superpixelIDs), numDimensions);
+    else
+        dataset->setData(mapSuperpixelAverageToPixels<float>(averagesSuperpixels, imgSize, imageRect, mappingLevelToData, superpixelIDs), numDimensions);
+}
+
+QRect computeImageRect(const sph::vvui64& mappingLevelToData, const std::vector<uint64_t>& superpixelIDs, const QSize& imgSize) {
+    const int64_t imgWidth = imgSize.width();
+
+    int64_t xMin = imgWidth, yMin = imgSize.height(), xMax = -1, yMax = -1;
+
+    for (const auto superpixelID : superpixelIDs) {
+        for (const auto dataID : mappingLevelToData[superpixelID]) {
+            const int64_t x = static_cast<int64_t>(dataID) % imgWidth;
+            const int64_t y = static_cast<int64_t>(dataID) / imgWidth;
+            xMin = std::min(xMin, x);
+            xMax = std::max(xMax, x);
+            yMin = std::min(yMin, y);
+            yMax = std::max(yMax, y);
+        }
+    }
+
+    if (xMax < 0)
+        return {};
+
+    return QRect(QPoint(static_cast<int>(xMin), static_cast<int>(yMin)), QPoint(static_cast<int>(xMax), static_cast<int>(yMax)));
+}
+
+void copySelectionToRect(const mv::Dataset<Points>& selectionInput, const QSize& imgSize, const QRect& imageRect, mv::Dataset<Points>& selectionOutput)
+{
+    const auto& sel = selectionInput->getSelection<Points>()->indices;
+    const int imgWidth = imgSize.width();
+
+    std::vector<uint32_t> selectionIndices;
+    selectionIndices.reserve(sel.size());
+
+    for (const auto imageID : sel) {
+        if (imageRect.contains(static_cast<int>(imageID % imgWidth), static_cast<int>(imageID / imgWidth)))
+            selectionIndices.push_back(static_cast<uint32_t>(imageToRectID(imageID, imgWidth, imageRect)));
+    }
+
+    selectionOutput->getSelection<Points>()->indices = std::move(selectionIndices);
+    mv::events().notifyDatasetDataSelectionChanged(selectionOutput);
+}
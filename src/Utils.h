@@ -8,6 +8,7 @@
 #include <cstdint>
 #include <vector>
 
+#include <QRect>
 #include <QSize>
 
 /// ///////// ///
@@ -23,6 +24,9 @@ void selectionMapping(const mv::Dataset<Points>& selectionInputData, const std::
 
 void selectionMapping(const mv::Dataset<Points>& selectionInputData, const std::vector<std::vector<uint64_t>>* selectionMap, mv::Dataset<Points> selectionOutputData);
 
+// Copies a selection of image points to a dataset that only covers imageRect of the image, drops points outside
+void copySelectionToRect(const mv::Dataset<Points>& selectionInput, const QSize& imgSize, const QRect& imageRect, mv::Dataset<Points>& selectionOutput);
+
 // Returns a set of pixel that cover all superpixel which the input pixels are part of
 std::vector<uint32_t> expandPixelToSuperpixelSelection(const mv::Dataset<Points>& selectionInputData, const std::vector<uint64_t>* selectionMapDataToLevel, const std::vector<std::vector<uint64_t>>* selectionMaLevelToData);
 
@@ -32,14 +36,63 @@ std::vector<uint32_t> expandPixelToSuperpixelSelection(const mv::Dataset<Points>
 
 void extractEmbPositions(const mv::Dataset<Points>& embOnLevel, const sph::vvui64& mappingLevelToData, const QSize& imgSize, mv::Dataset<Points>& embPosOnLevel);
 
+// Embedding point embID represents the image points mappingLevelToData[levelIDs[embID]], embPosOnLevel only covers imageRect of the image
+void extractEmbPositions(const mv::Dataset<Points>& embOnLevel, const sph::vvui64& mappingLevelToData, const std::vector<uint64_t>& levelIDs, const QSize& imgSize, const QRect& imageRect, mv::Dataset<Points>& embPosOnLevel);
+
 /// /////////////// ///
 /// SUPERPIXEL DATA ///
 /// /////////////// ///
 
-std::vector<float> computeAveragePerDimensionForSuperpixels(const sph::utils::DataView& data, const sph::vvui64& mappingLevelToData);
+// Averages of the given dimensions of row-major values with rowStride values per point.
+// T is the element type of the input, e.g. uint8 or uint16 sensor values that are converted to float when they are read
+template<typename T>
+std::vector<float> computeAveragePerDimensionForSuperpixels(const T* values, size_t rowStride, const std::vector<uint32_t>& dimensions, const sph::vvui64& mappingLevelToData);
+
+// Averages only of the superpixels superpixelIDs, in that order
+template<typename T>
+std::vector<float> computeAveragePerDimensionForSuperpixels(const T* values, size_t rowStride, const std::vector<uint32_t>& dimensions, const sph::vvui64& mappingLevelToData, const std::vector<uint64_t>& superpixelIDs);
+
+// Element type of the average datasets, bfloat16 halves their memory at about three significant digits
+enum class AveragePrecision
+{
+    FLOAT32,
+    BFLOAT16,
+};
+
+// T is float or biovault::bfloat16_t, the pixel averages are written in the element type of the dataset directly
+template<typename T = float>
+std::vector<T> mapSuperpixelAverageToPixels(const std::vector<float>& averagesSuperpixels, int64_t numDataPoints, const sph::vvui64& mappingLevelToData);
+
+// Scatters averages of the superpixels superpixelIDs (in that order) to the pixels in imageRect, all other pixels are 0
+template<typename T = float>
+std::vector<T> mapSuperpixelAverageToPixels(const std::vector<float>& averagesSuperpixels, const QSize& imgSize, const QRect& imageRect, const sph::vvui64& mappingLevelToData, const std::vector<uint64_t>& superpixelIDs);
 
-static inline std::vector<float> computeAveragePerDimensionForSuperpixels(const sph::utils::Data& data, const sph::vvui64& mappingLevelToData) {
-    return computeAveragePerDimensionForSuperpixels(data.getDataView(), mappingLevelToData);
+// Sets the superpixel averages in the given precision
+void setAverageData(mv::Dataset<Points>& dataset, const std::vector<float>& averages, size_t numDimensions, AveragePrecision precision);
+
+// Scatters the superpixel averages to all pixels and sets them in the given precision
+void setPixelAverageData(mv::Dataset<Points>& dataset, const std::vector<float>& averagesSuperpixels, int64_t numDataPoints, const sph::vvui64& mappingLevelToData, AveragePrecision precision);
+
+// Scatters the averages of the superpixels superpixelIDs to the pixels in imageRect and sets them in the given precision
+void setPixelAverageData(mv::Dataset<Points>& dataset, const std::vector<float>& averagesSuperpixels, const QSize& imgSize, const QRect& imageRect, const sph::vvui64& mappingLevelToData, const std::vector<uint64_t>& superpixelIDs, AveragePrecision precision);
+
+/// ///////////// ///
+/// IMAGE REGIONS ///
+/// ///////////// ///
+
+// Bounding rectangle of all image points of the superpixels superpixelIDs
+QRect computeImageRect(const sph::vvui64& mappingLevelToData, const std::vector<uint64_t>& superpixelIDs, const QSize& imgSize);
+
+// Index of an image point in a dataset that only covers imageRect of the image
+static inline uint64_t imageToRectID(uint64_t imageID, int imgWidth, const QRect& imageRect) {
+    const int64_t x = static_cast<int64_t>(imageID % imgWidth) - imageRect.left();
+    const int64_t y = static_cast<int64_t>(imageID / imgWidth) - imageRect.top();
+    return static_cast<uint64_t>(y * imageRect.width() + x);
 }
 
-std::vector<float> mapSuperpixelAverageToPixels(const std::vector<float>& averagesSuperpixels, int64_t numDataPoints, const sph::vvui64& mappingLevelToData);
+// Index in the full image of a point in a dataset that only covers imageRect of the image
+static inline uint64_t rectToImageID(uint64_t rectID, int imgWidth, const QRect& imageRect) {
+    const int64_t x = static_cast<int64_t>(rectID % imageRect.width()) + imageRect.left();
+    const int64_t y = static_cast<int64_t>(rectID / imageRect.width()) + imageRect.top();
+    return static_cast<uint64_t>(y * imgWidth + x);
+}
@@ -0,0 +1,51 @@
+#include "ExactRepulsion.h"
+
+#include "BarnesHutRepulsion.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+
+#include <cmath>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+TEST_CASE("BarnesHutRepulsion matches the exact repulsion", "[BarnesHutRepulsion]")
+{
+    std::vector<float> positions = makeClusteredPositions(3000, 6, 50.f, 2);
+
+    // identical points end in a leaf at the maximum depth that holds more than one block of points
+    const bool withDuplicates = GENERATE(false, true);
+    if (withDuplicates)
+        for (size_t copy = 0; copy < 40; copy++)
+            positions.insert(positions.end(), { positions[0], positions[1] });
+
+    const size_t numPoints = positions.size() / 2;
+
+    std::vector<double> exactForces;
+    const double exactNormalization = computeExactRepulsion(positions, exactForces);
+
+    auto computeErrors = [&](float theta) -> std::pair<double, double> {
+        BarnesHutRepulsion repulsion(theta);
+
+        std::vector<float> forces;
+        const double normalization = repulsion.compute(positions, forces);
+        REQUIRE(forces.size() == positions.size());
+        REQUIRE(repulsion.getKernelSums().size() == numPoints);
+
+        return { std::abs(normalization - exactNormalization) / exactNormalization, relativeForceError(forces, exactForces) };
+        };
+
+    // without approximation only the summation order differs
+    const auto [exactNormalizationError, exactForceError] = computeErrors(0.f);
+    CHECK(exactNormalizationError < 1e-5);
+    CHECK(exactForceError < 1e-5);
+
+    const auto [normalizationError, forceError] = computeErrors(0.5f);
+    CHECK(normalizationError < 0.01);
+    CHECK(forceError < 0.02);
+
+    const auto [accurateNormalizationError, accurateForceError] = computeErrors(0.3f);
+    CHECK(accurateNormalizationError < 0.01);
+    CHECK(accurateForceError < forceError);
+}
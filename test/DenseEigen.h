@@ -0,0 +1,80 @@
+#pragma once
+
+#include "LinearAlgebra.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <numeric>
+#include <vector>
+
+/// ////////// ///
+/// DenseEigen ///
+/// ////////// ///
+
+/** Reference eigen decomposition of a small dense symmetric matrix, eigenvalues in descending order */
+struct DenseEigen
+{
+    std::vector<double>     values = {};
+    std::vector<double>     vectors = {};   /** Row-major n x n, the eigenvectors are the columns */
+    size_t                  n = 0;
+
+    DenseEigen(const std::vector<double>& matrix, size_t size) : n(size)
+    {
+        std::vector<double> unsortedValues, unsortedVectors;
+        computeSymmetricEigen(matrix, n, unsortedValues, unsortedVectors);
+
+        std::vector<size_t> order(n);
+        std::iota(order.begin(), order.end(), size_t{ 0 });
+        std::sort(order.begin(), order.end(), [&unsortedValues](size_t a, size_t b) { return unsortedValues[a] > unsortedValues[b]; });
+
+        values.resize(n);
+        vectors.resize(n * n);
+        for (size_t col = 0; col < n; col++)
+        {
+            values[col] = unsortedValues[order[col]];
+            for (size_t row = 0; row < n; row++)
+                vectors[row * n + col] = unsortedVectors[row * n + order[col]];
+        }
+    }
+
+    std::vector<double> vector(size_t col) const
+    {
+        std::vector<double> result(n);
+        for (size_t row = 0; row < n; row++)
+            result[row] = vectors[row * n + col];
+        return result;
+    }
+
+    /** Largest |A v - lambda v| over all eigenpairs, the reference itself is only trusted if this is small */
+    double maxResidual(const std::vector<double>& matrix) const
+    {
+        double maxResidual = 0;
+        for (size_t col = 0; col < n; col++)
+        {
+            double squaredResidual = 0;
+            for (size_t row = 0; row < n; row++)
+            {
+                double product = 0;
+                for (size_t k = 0; k < n; k++)
+                    product += matrix[row * n + k] * vectors[k * n + col];
+                squaredResidual += (product - values[col] * vectors[row * n + col]) * (product - values[col] * vectors[row * n + col]);
+            }
+            maxResidual = std::max(maxResidual, std::sqrt(squaredResidual));
+        }
+        return maxResidual;
+    }
+};
+
+/** Cosine of the angle between a and b, the sign of eigenvectors is arbitrary */
+inline double absoluteCosine(const std::vector<double>& a, const std::vector<double>& b)
+{
+    double ab = 0, aa = 0, bb = 0;
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        ab += a[i] * b[i];
+        aa += a[i] * a[i];
+        bb += b[i] * b[i];
+    }
+    return aa > 0 && bb > 0 ? std::abs(ab) / std::sqrt(aa * bb) : 0.0;
+}
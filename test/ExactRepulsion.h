@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+/// /////////////// ///
+/// ExactRepulsion  ///
+/// /////////////// ///
+
+/** Reference t-SNE repulsion in O(N^2): forces sum_j w_ij^2 (y_i - y_j) and the normalization sum_{i != j} w_ij, see TsneRepulsion */
+inline double computeExactRepulsion(const std::vector<float>& positions, std::vector<double>& forces)
+{
+    const size_t numPoints = positions.size() / 2;
+    forces.assign(positions.size(), 0.0);
+
+    double normalization = 0;
+    for (size_t i = 0; i < numPoints; i++)
+    {
+        for (size_t j = 0; j < numPoints; j++)
+        {
+            if (i == j)
+                continue;
+
+            const double dx = static_cast<double>(positions[2 * i]) - positions[2 * j];
+            const double dy = static_cast<double>(positions[2 * i + 1]) - positions[2 * j + 1];
+            const double w = 1.0 / (1.0 + dx * dx + dy * dy);
+
+            normalization += w;
+            forces[2 * i] += w * w * dx;
+            forces[2 * i + 1] += w * w * dy;
+        }
+    }
+
+    return normalization;
+}
+
+/** sum_i |f_i - f_exact_i| / sum_i |f_exact_i|, the error of the force vectors relative to their total magnitude */
+inline double relativeForceError(const std::vector<float>& forces, const std::vector<double>& exactForces)
+{
+    double error = 0, magnitude = 0;
+    for (size_t i = 0; i + 1 < exactForces.size(); i += 2)
+    {
+        error += std::hypot(forces[i] - exactForces[i], forces[i + 1] - exactForces[i + 1]);
+        magnitude += std::hypot(exactForces[i], exactForces[i + 1]);
+    }
+
+    return magnitude > 0 ? error / magnitude : error;
+}
+
+/** Points in numClusters gaussian clusters of different spreads, like an embedding during the gradient descent */
+inline std::vector<float> makeClusteredPositions(size_t numPoints, size_t numClusters, float range, uint64_t seed)
+{
+    std::mt19937_64 generator(seed);
+    std::uniform_real_distribution<float> uniform(-range / 2, range / 2);
+    std::uniform_real_distribution<float> spread(0.5f, range / 10);
+    std::normal_distribution<float> normal(0.f, 1.f);
+
+    std::vector<float> centers(numClusters * 2), spreads(numClusters);
+    for (size_t cluster = 0; cluster < numClusters; cluster++)
+    {
+        centers[2 * cluster] = uniform(generator);
+        centers[2 * cluster + 1] = uniform(generator);
+        spreads[cluster] = spread(generator);
+    }
+
+    std::vector<float> positions(numPoints * 2);
+    for (size_t i = 0; i < numPoints; i++)
+    {
+        const size_t cluster = i % numClusters;
+        positions[2 * i] = centers[2 * cluster] + spreads[cluster] * normal(generator);
+        positions[2 * i + 1] = centers[2 * cluster + 1] + spreads[cluster] * normal(generator);
+    }
+
+    return positions;
+}
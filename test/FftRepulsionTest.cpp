@@ -0,0 +1,39 @@
+#include "ExactRepulsion.h"
+
+#include "FftRepulsion.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+
+#include <cmath>
+#include <vector>
+
+TEST_CASE("FftRepulsion matches the exact repulsion", "[FftRepulsion]")
+{
+    // a range below the minimum number of boxes, and ranges where the grid grows with the embedding
+    const float range = GENERATE(10.f, 100.f, 300.f);
+    std::vector<float> positions = makeClusteredPositions(3000, 6, range, 3);
+
+    FftRepulsion repulsion;
+
+    auto checkAgainstExact = [&]() {
+        std::vector<double> exactForces;
+        const double exactNormalization = computeExactRepulsion(positions, exactForces);
+
+        std::vector<float> forces;
+        const double normalization = repulsion.compute(positions, forces);
+        REQUIRE(forces.size() == positions.size());
+
+        // three interpolation nodes per box of at most one unit
+        CHECK(std::abs(normalization - exactNormalization) / exactNormalization < 5e-3);
+        CHECK(relativeForceError(forces, exactForces) < 0.03);
+        };
+
+    checkAgainstExact();
+
+    // the embedding grows slightly between iterations, the kernels of the previous grid are re-used
+    for (float& position : positions)
+        position *= 1.03f;
+
+    checkAgainstExact();
+}
@@ -0,0 +1,142 @@
+#include "ExactRepulsion.h"
+
+#include "HierarchyRepulsion.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace {
+
+    /** Nested superpixels of a size x size image, each level stored as in sph::utils::Hierarchy */
+    struct TestHierarchy
+    {
+        std::vector<sph::vvui64>    mappingLevelToData = {};
+        std::vector<sph::vui64>     mappingDataToLevel = {};
+    };
+
+    /**
+     * Level 0 splits every row into runs of 1 to 4 pixels within aligned 4 pixel segments, i.e. superpixels of uneven size.
+     * Level k > 0 are aligned blocks of 4^k x 4^k pixels, which contain whole superpixels of the level below.
+     */
+    TestHierarchy makeTestHierarchy(uint64_t size, uint64_t seed)
+    {
+        std::mt19937_64 generator(seed);
+        std::uniform_int_distribution<uint64_t> runLength(1, 4);
+
+        TestHierarchy hierarchy;
+        const uint64_t numPixels = size * size;
+
+        sph::vui64 pixelToSuperpixel(numPixels);
+        sph::vvui64 superpixelToPixels;
+        for (uint64_t y = 0; y < size; y++)
+        {
+            for (uint64_t segment = 0; segment < size; segment += 4)
+            {
+                uint64_t x = segment;
+                while (x < segment + 4)
+                {
+                    const uint64_t last = std::min(x + runLength(generator), segment + 4);
+                    auto& pixels = superpixelToPixels.emplace_back();
+                    for (; x < last; x++)
+                    {
+                        pixelToSuperpixel[y * size + x] = superpixelToPixels.size() - 1;
+                        pixels.push_back(y * size + x);
+                    }
+                }
+            }
+        }
+
+        hierarchy.mappingLevelToData.push_back(std::move(superpixelToPixels));
+        hierarchy.mappingDataToLevel.push_back(std::move(pixelToSuperpixel));
+
+        for (uint64_t blockSize = 4; blockSize <= size; blockSize *= 4)
+        {
+            const uint64_t numBlocksPerRow = size / blockSize;
+
+            sph::vui64 pixelToBlock(numPixels);
+            sph::vvui64 blockToPixels(numBlocksPerRow * numBlocksPerRow);
+            for (uint64_t pixel = 0; pixel < numPixels; pixel++)
+            {
+                const uint64_t block = (pixel / size / blockSize) * numBlocksPerRow + (pixel % size) / blockSize;
+                pixelToBlock[pixel] = block;
+                blockToPixels[block].push_back(pixel);
+            }
+
+            hierarchy.mappingLevelToData.push_back(std::move(blockToPixels));
+            hierarchy.mappingDataToLevel.push_back(std::move(pixelToBlock));
+        }
+
+        return hierarchy;
+    }
+
+    /** Superpixels are embedded close to their image location, like a layout that preserves the spatial structure */
+    std::vector<float> makeSpatialPositions(const sph::vvui64& mappingLevelToData, uint64_t size, const std::vector<uint64_t>& levelIDs, uint64_t seed)
+    {
+        std::mt19937_64 generator(seed);
+        std::normal_distribution<float> noise(0.f, 0.5f);
+
+        std::vector<float> positions(levelIDs.size() * 2);
+        for (size_t i = 0; i < levelIDs.size(); i++)
+        {
+            double x = 0, y = 0;
+            for (const uint64_t pixel : mappingLevelToData[levelIDs[i]])
+            {
+                x += static_cast<double>(pixel % size);
+                y += static_cast<double>(pixel / size);
+            }
+
+            const auto numPixels = static_cast<double>(mappingLevelToData[levelIDs[i]].size());
+            positions[2 * i] = static_cast<float>(x / numPixels / 4) + noise(generator);
+            positions[2 * i + 1] = static_cast<float>(y / numPixels / 4) + noise(generator);
+        }
+
+        return positions;
+    }
+
+}
+
+TEST_CASE("HierarchyRepulsion matches the exact repulsion", "[HierarchyRepulsion]")
+{
+    constexpr uint64_t imageSize = 128;
+    const TestHierarchy hierarchy = makeTestHierarchy(imageSize, 7);
+
+    const auto& superpixels = hierarchy.mappingLevelToData[0];
+
+    // all superpixels of the level, and every other superpixel as for a refinement that only embeds some of them
+    const uint64_t stride = GENERATE(1, 2);
+
+    std::vector<uint64_t> levelIDs;
+    for (uint64_t id = 0; id < superpixels.size(); id += stride)
+        levelIDs.push_back(id);
+
+    const std::vector<float> positions = makeSpatialPositions(superpixels, imageSize, levelIDs, 11 + stride);
+
+    std::vector<double> exactForces;
+    const double exactNormalization = computeExactRepulsion(positions, exactForces);
+
+    auto computeErrors = [&](float theta) -> std::pair<double, double> {
+        HierarchyRepulsion repulsion(hierarchy.mappingLevelToData, hierarchy.mappingDataToLevel, 0, levelIDs, theta);
+        REQUIRE(repulsion.getNumAggregateLevels() >= 2);
+
+        std::vector<float> forces;
+        const double normalization = repulsion.compute(positions, forces);
+
+        return { std::abs(normalization - exactNormalization) / exactNormalization, relativeForceError(forces, exactForces) };
+        };
+
+    const auto [normalizationError, forceError] = computeErrors(0.5f);
+    CHECK(normalizationError < 0.03);
+    CHECK(forceError < 0.1);
+
+    const auto [accurateNormalizationError, accurateForceError] = computeErrors(0.3f);
+    CHECK(accurateNormalizationError < 0.01);
+    CHECK(accurateForceError < 0.03);
+    CHECK(accurateForceError < forceError);
+}
@@ -0,0 +1,115 @@
+#include "DenseEigen.h"
+
+#include "LinearAlgebra.h"
+#include "RandomizedPca.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace {
+
+    /** Latent variables with decaying standard deviations, rotated by a random orthogonal matrix and shifted */
+    std::vector<float> makeLowRankData(size_t numPoints, size_t numDims, uint64_t seed)
+    {
+        std::mt19937_64 generator(seed);
+        std::normal_distribution<double> normal(0.0, 1.0);
+
+        std::vector<double> rotation(numDims * numDims);
+        for (double& value : rotation)
+            value = normal(generator);
+        orthonormalizeColumns(rotation, numDims, numDims);
+
+        std::vector<double> offsets(numDims);
+        for (double& offset : offsets)
+            offset = 10.0 * normal(generator);
+
+        std::vector<float> data(numPoints * numDims);
+        std::vector<double> latent(numDims);
+        for (size_t point = 0; point < numPoints; point++)
+        {
+            for (size_t dim = 0; dim < numDims; dim++)
+                latent[dim] = normal(generator) * 8.0 / (1.0 + dim * dim);
+
+            for (size_t dim = 0; dim < numDims; dim++)
+            {
+                double value = offsets[dim];
+                for (size_t k = 0; k < numDims; k++)
+                    value += rotation[dim * numDims + k] * latent[k];
+                data[point * numDims + dim] = static_cast<float>(value);
+            }
+        }
+
+        return data;
+    }
+
+}
+
+TEST_CASE("RandomizedPca matches a dense eigen decomposition of the covariance", "[RandomizedPca]")
+{
+    constexpr size_t numPoints = 2000;
+    constexpr size_t numDims = 16;
+    const std::vector<float> data = makeLowRankData(numPoints, numDims, 3);
+
+    // Dense reference: covariance of all rows
+    std::vector<double> mean(numDims, 0.0);
+    for (size_t point = 0; point < numPoints; point++)
+        for (size_t dim = 0; dim < numDims; dim++)
+            mean[dim] += data[point * numDims + dim] / static_cast<double>(numPoints);
+
+    std::vector<double> covariance(numDims * numDims, 0.0);
+    for (size_t point = 0; point < numPoints; point++)
+        for (size_t a = 0; a < numDims; a++)
+            for (size_t b = 0; b < numDims; b++)
+                covariance[a * numDims + b] += (data[point * numDims + a] - mean[a]) * (data[point * numDims + b] - mean[b]) / static_cast<double>(numPoints);
+
+    const DenseEigen reference(covariance, numDims);
+    REQUIRE(reference.maxResidual(covariance) < 1e-8 * reference.values[0]);
+
+    RandomizedPca::Settings settings;
+    settings.numComponents = GENERATE(2, 3);
+
+    const std::vector<float> projection = RandomizedPca::compute(data, numDims, settings);
+    REQUIRE(projection.size() == numPoints * settings.numComponents);
+
+    for (size_t comp = 0; comp < settings.numComponents; comp++)
+    {
+        const std::vector<double> axis = reference.vector(comp);
+
+        std::vector<double> component(numPoints), expected(numPoints);
+        double variance = 0;
+        for (size_t point = 0; point < numPoints; point++)
+        {
+            component[point] = projection[point * settings.numComponents + comp];
+            for (size_t dim = 0; dim < numDims; dim++)
+                expected[point] += (data[point * numDims + dim] - mean[dim]) * axis[dim];
+            variance += component[point] * component[point] / static_cast<double>(numPoints);
+        }
+
+        // the variance along a principal axis is its eigenvalue
+        CHECK(std::abs(variance - reference.values[comp]) < 1e-3 * reference.values[comp]);
+        CHECK(absoluteCosine(component, expected) > 1 - 1e-5);
+    }
+
+    // axes estimated on a subset of the rows are close to the axes of all rows
+    settings.maxSampledRows = numPoints / 4;
+    const std::vector<float> sampledProjection = RandomizedPca::compute(data, numDims, settings);
+    REQUIRE(sampledProjection.size() == projection.size());
+
+    for (size_t comp = 0; comp < settings.numComponents; comp++)
+    {
+        std::vector<double> component(numPoints), sampledComponent(numPoints);
+        for (size_t point = 0; point < numPoints; point++)
+        {
+            component[point] = projection[point * settings.numComponents + comp];
+            sampledComponent[point] = sampledProjection[point * settings.numComponents + comp];
+        }
+
+        CHECK(absoluteCosine(component, sampledComponent) > 0.99);
+    }
+}
@@ -0,0 +1,127 @@
+#include "DenseEigen.h"
+
+#include "SpectralEmbedding.h"
+
+#include <sph/utils/CommonDefinitions.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <random>
+#include <vector>
+
+namespace {
+
+    /**
+     * Row-normalized Gaussian transition matrix of the k nearest neighbors of random points in a 3 x 1 rectangle.
+     * The leading non-trivial eigenvectors are the first two modes along the long side, separated by a clear gap.
+     */
+    sph::SparseMatHDI makeTransitionMatrix(size_t numPoints, size_t numNeighbors, uint64_t seed)
+    {
+        std::mt19937_64 generator(seed);
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+        std::vector<double> positions(numPoints * 2);
+        for (size_t point = 0; point < numPoints; point++)
+        {
+            positions[2 * point] = 3.0 * uniform(generator);
+            positions[2 * point + 1] = uniform(generator);
+        }
+
+        sph::SparseMatHDI matrix(numPoints);
+        std::vector<double> distances(numPoints);
+        std::vector<size_t> order(numPoints);
+        for (size_t row = 0; row < numPoints; row++)
+        {
+            for (size_t col = 0; col < numPoints; col++)
+            {
+                const double dx = positions[2 * row] - positions[2 * col];
+                const double dy = positions[2 * row + 1] - positions[2 * col + 1];
+                distances[col] = dx * dx + dy * dy;
+            }
+
+            std::iota(order.begin(), order.end(), size_t{ 0 });
+            std::partial_sort(order.begin(), order.begin() + numNeighbors + 1, order.end(), [&distances](size_t a, size_t b) { return distances[a] < distances[b]; });
+
+            // order[0] is the point itself
+            const double bandwidth = distances[order[numNeighbors]];
+            double sum = 0;
+            for (size_t n = 1; n <= numNeighbors; n++)
+                sum += std::exp(-distances[order[n]] / bandwidth);
+
+            for (size_t n = 1; n <= numNeighbors; n++)
+                matrix[row][static_cast<uint32_t>(order[n])] = static_cast<float>(std::exp(-distances[order[n]] / bandwidth) / sum);
+        }
+
+        return matrix;
+    }
+
+}
+
+TEST_CASE("SpectralEmbedding matches a dense eigen decomposition of the normalized adjacency", "[SpectralEmbedding]")
+{
+    constexpr size_t numPoints = 300;
+    constexpr size_t numComponents = 2;
+    const sph::SparseMatHDI matrix = makeTransitionMatrix(numPoints, 10, 5);
+
+    // Dense reference: D^-1/2 W D^-1/2 with W = (P + P^T) / 2
+    std::vector<double> adjacency(numPoints * numPoints, 0.0);
+    for (size_t row = 0; row < numPoints; row++)
+    {
+        for (const auto& [col, value] : matrix[row])
+        {
+            adjacency[row * numPoints + col] += 0.5 * value;
+            adjacency[col * numPoints + row] += 0.5 * value;
+        }
+    }
+
+    std::vector<double> sqrtDegrees(numPoints, 0.0);
+    for (size_t row = 0; row < numPoints; row++)
+        sqrtDegrees[row] = std::sqrt(std::accumulate(adjacency.begin() + row * numPoints, adjacency.begin() + (row + 1) * numPoints, 0.0));
+
+    for (size_t row = 0; row < numPoints; row++)
+        for (size_t col = 0; col < numPoints; col++)
+            adjacency[row * numPoints + col] /= sqrtDegrees[row] * sqrtDegrees[col];
+
+    const DenseEigen reference(adjacency, numPoints);
+    REQUIRE(reference.maxResidual(adjacency) < 1e-8);
+
+    // a single connected component: the trivial eigenvalue 1 is simple and the components after it are well separated
+    REQUIRE(std::abs(reference.values[0] - 1.0) < 1e-8);
+    REQUIRE(reference.values[1] < 1.0 - 1e-4);
+    REQUIRE(reference.values[2] - reference.values[3] > 1e-3);
+
+    SpectralEmbedding::Settings settings;
+    settings.numComponents = numComponents;
+
+    const std::vector<float> embedding = SpectralEmbedding::compute(matrix, settings);
+    REQUIRE(embedding.size() == numPoints * numComponents);
+
+    for (size_t comp = 0; comp < numComponents; comp++)
+    {
+        // the embedding is the eigenvector scaled by D^-1/2
+        std::vector<double> eigenVector(numPoints);
+        for (size_t point = 0; point < numPoints; point++)
+            eigenVector[point] = embedding[point * numComponents + comp] * sqrtDegrees[point];
+
+        double norm = 0, rayleighQuotient = 0;
+        for (size_t row = 0; row < numPoints; row++)
+        {
+            double product = 0;
+            for (size_t col = 0; col < numPoints; col++)
+                product += adjacency[row * numPoints + col] * eigenVector[col];
+            rayleighQuotient += eigenVector[row] * product;
+            norm += eigenVector[row] * eigenVector[row];
+        }
+        rayleighQuotient /= norm;
+
+        // skip the trivial eigenvector
+        const double expectedValue = reference.values[comp + 1];
+        CHECK(std::abs(rayleighQuotient - expectedValue) < 1e-4);
+        CHECK(absoluteCosine(eigenVector, reference.vector(comp + 1)) > 1 - 1e-3);
+    }
+}